@@ -0,0 +1,65 @@
+#include "Allocation.h"
+#include <cstdlib>
+#include <new>
+
+namespace {
+    struct alignas(cache_line_size) GlobalHeapCounters {
+        std::atomic<std::uint64_t> allocations{};
+        std::atomic<std::uint64_t> bytes{};
+    };
+    GlobalHeapCounters heap;
+
+    thread_local std::pmr::memory_resource* t_scratch {};
+
+    void* allocate_or_throw(std::size_t size, std::size_t alignment) {
+        heap.allocations.fetch_add(1, std::memory_order_relaxed);
+        heap.bytes.fetch_add(size, std::memory_order_relaxed);
+        if (size == 0) size = 1;
+        // aligned_alloc wants a multiple of the alignment
+        if (alignment > alignof(std::max_align_t)) size = (size + alignment - 1) / alignment * alignment;
+        for (;;) {
+            void* pointer { alignment > alignof(std::max_align_t) ? std::aligned_alloc(alignment, size) : std::malloc(size) };
+            if (pointer) return pointer;
+            const std::new_handler handler { std::get_new_handler() };
+            if (!handler) throw std::bad_alloc();
+            handler();
+        }
+    }
+}
+
+// the array and nothrow forms of the standard library call these
+void* operator new(std::size_t size) { return allocate_or_throw(size, alignof(std::max_align_t)); }
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    return allocate_or_throw(size, static_cast<std::size_t>(alignment));
+}
+void operator delete(void* pointer) noexcept { std::free(pointer); }
+void operator delete(void* pointer, std::size_t) noexcept { std::free(pointer); }
+void operator delete(void* pointer, std::align_val_t) noexcept { std::free(pointer); }
+void operator delete(void* pointer, std::size_t, std::align_val_t) noexcept { std::free(pointer); }
+
+HeapCounters heap_counters() {
+    return { heap.allocations.load(std::memory_order_relaxed), heap.bytes.load(std::memory_order_relaxed) };
+}
+
+void* CountingResource::do_allocate(std::size_t bytes, std::size_t alignment) {
+    m_allocations.fetch_add(1, std::memory_order_relaxed);
+    m_bytes.fetch_add(bytes, std::memory_order_relaxed);
+    return m_upstream->allocate(bytes, alignment);
+}
+
+void CountingResource::do_deallocate(void* pointer, std::size_t bytes, std::size_t alignment) {
+    m_upstream->deallocate(pointer, bytes, alignment);
+}
+
+ScratchArena::ScratchArena(std::size_t initial_bytes)
+    : m_arena { initial_bytes, &m_upstream }, m_previous { t_scratch } {
+    t_scratch = &m_arena;
+}
+
+ScratchArena::~ScratchArena() {
+    t_scratch = m_previous;
+}
+
+std::pmr::memory_resource* scratch_resource() {
+    return t_scratch ? t_scratch : std::pmr::new_delete_resource();
+}
@@ -0,0 +1,76 @@
+#ifndef WEATHER_SENSORS_ALLOCATION_H
+#define WEATHER_SENSORS_ALLOCATION_H
+#include "structs.h"
+#include "nlohmann/json.hpp"
+#include <memory_resource>
+
+// heap allocations of the whole process, counted by the replaced global operator new
+struct HeapCounters {
+    std::uint64_t allocations;
+    std::uint64_t bytes;
+};
+HeapCounters heap_counters();
+
+/**
+ *  Memory resource that counts what it hands out and passes the requests to upstream
+ */
+class CountingResource : public std::pmr::memory_resource {
+private:
+    std::pmr::memory_resource* m_upstream;
+    std::atomic<std::uint64_t> m_allocations{};
+    std::atomic<std::uint64_t> m_bytes{};
+
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override;
+    void do_deallocate(void* pointer, std::size_t bytes, std::size_t alignment) override;
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+public:
+    explicit CountingResource(std::pmr::memory_resource* upstream = std::pmr::new_delete_resource())
+        : m_upstream { upstream } {}
+    std::uint64_t allocations() const { return m_allocations.load(std::memory_order_relaxed); }
+    std::uint64_t bytes() const { return m_bytes.load(std::memory_order_relaxed); }
+};
+
+/**
+ *  Monotonic arena for export scratch: everything allocated through ScratchAllocator on this thread
+ *  while the object lives comes from a few large blocks that are released in one step at the end
+ *  Objects built in the arena have to be destroyed before it, arenas nest
+ */
+class ScratchArena {
+private:
+    CountingResource m_upstream;
+    std::pmr::monotonic_buffer_resource m_arena;
+    std::pmr::memory_resource* m_previous;
+public:
+    explicit ScratchArena(std::size_t initial_bytes = 64 * 1024);
+    ~ScratchArena();
+    ScratchArena(const ScratchArena&) = delete;
+    ScratchArena& operator=(const ScratchArena&) = delete;
+    // bytes taken from the heap so far
+    std::uint64_t bytes() const { return m_upstream.bytes(); }
+};
+
+// the innermost ScratchArena of this thread, the heap outside of one
+std::pmr::memory_resource* scratch_resource();
+
+// allocator for types that default construct their allocators, like the nodes of nlohmann::basic_json
+template <typename T>
+class ScratchAllocator {
+private:
+    std::pmr::memory_resource* m_resource { scratch_resource() };
+    template <typename U> friend class ScratchAllocator;
+public:
+    using value_type = T;
+    ScratchAllocator() = default;
+    template <typename U>
+    ScratchAllocator(const ScratchAllocator<U>& other) : m_resource { other.m_resource } {}
+    T* allocate(std::size_t count) { return static_cast<T*>(m_resource->allocate(count * sizeof(T), alignof(T))); }
+    void deallocate(T* pointer, std::size_t count) { m_resource->deallocate(pointer, count * sizeof(T), alignof(T)); }
+    template <typename U>
+    bool operator==(const ScratchAllocator<U>& other) const { return m_resource == other.m_resource; }
+};
+
+// ordered_json whose objects and arrays live in the current ScratchArena, strings stay on the heap
+using scratch_json = nlohmann::basic_json<nlohmann::ordered_map, std::vector, std::string, bool, std::int64_t,
+                                          std::uint64_t, double, ScratchAllocator>;
+
+#endif
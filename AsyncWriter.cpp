@@ -0,0 +1,443 @@
+#include "AsyncWriter.h"
+#include "Trace.h"
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <cstdlib>
+#include <cstdio>
+#include <climits>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#define WEATHER_SENSORS_HAVE_IO_URING 1
+#endif
+
+/**
+ *  Minimal io_uring without liburing: the three syscalls and the shared rings
+ */
+struct AsyncWriter::Ring {
+#ifdef WEATHER_SENSORS_HAVE_IO_URING
+    int fd { -1 };
+    unsigned entries{};
+    void* sq_map { MAP_FAILED };
+    void* cq_map { MAP_FAILED };
+    std::size_t sq_map_size{};
+    std::size_t cq_map_size{};
+    io_uring_sqe* sqes { static_cast<io_uring_sqe*>(MAP_FAILED) };
+    unsigned* sq_tail{};
+    unsigned* sq_mask{};
+    unsigned* sq_array{};
+    unsigned* cq_head{};
+    unsigned* cq_tail{};
+    unsigned* cq_mask{};
+    io_uring_cqe* cqes{};
+    std::vector<iovec> buffers;
+    bool fixed_buffers{};
+
+    ~Ring() {
+        if (sqes != MAP_FAILED) ::munmap(sqes, entries * sizeof(io_uring_sqe));
+        if (cq_map != MAP_FAILED && cq_map != sq_map) ::munmap(cq_map, cq_map_size);
+        if (sq_map != MAP_FAILED) ::munmap(sq_map, sq_map_size);
+        if (fd >= 0) ::close(fd);
+        for (iovec& buffer : buffers) std::free(buffer.iov_base);
+    }
+
+    bool setup(unsigned queue_depth, std::size_t buffer_size) {
+        io_uring_params params {};
+        fd = static_cast<int>(::syscall(__NR_io_uring_setup, queue_depth, &params));
+        if (fd < 0) return false;
+        entries = params.sq_entries;
+
+        sq_map_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_map_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        if (params.features & IORING_FEAT_SINGLE_MMAP) sq_map_size = cq_map_size = std::max(sq_map_size, cq_map_size);
+        sq_map = ::mmap(nullptr, sq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        if (sq_map == MAP_FAILED) return false;
+        cq_map = (params.features & IORING_FEAT_SINGLE_MMAP) ? sq_map
+               : ::mmap(nullptr, cq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (cq_map == MAP_FAILED) return false;
+        sqes = static_cast<io_uring_sqe*>(::mmap(nullptr, entries * sizeof(io_uring_sqe), PROT_READ | PROT_WRITE,
+                                                 MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES));
+        if (sqes == MAP_FAILED) return false;
+
+        auto* sq { static_cast<char*>(sq_map) };
+        auto* cq { static_cast<char*>(cq_map) };
+        sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sq_mask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cq_mask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+        // one page aligned buffer per slot, registered so the kernel pins them once
+        for (unsigned i = 0; i < queue_depth; i++) {
+            void* memory { std::aligned_alloc(4096, (buffer_size + 4095) / 4096 * 4096) };
+            if (!memory) return false;
+            buffers.push_back({ memory, buffer_size });
+        }
+        fixed_buffers = ::syscall(__NR_io_uring_register, fd, IORING_REGISTER_BUFFERS,
+                                  buffers.data(), static_cast<unsigned>(buffers.size())) == 0;
+        return true;
+    }
+
+    // queues a write of length bytes of the slot's buffer from skip on, at offset in the file
+    void queue_write(int file, unsigned slot, std::size_t skip, std::size_t length, std::uint64_t offset) {
+        const unsigned tail { *sq_tail };
+        const unsigned index { tail & *sq_mask };
+        io_uring_sqe& sqe { sqes[index] };
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = fixed_buffers ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+        sqe.fd = file;
+        sqe.addr = reinterpret_cast<std::uint64_t>(static_cast<std::uint8_t*>(buffers[slot].iov_base) + skip);
+        sqe.len = static_cast<std::uint32_t>(length);
+        sqe.off = offset;
+        sqe.buf_index = static_cast<std::uint16_t>(slot);
+        sqe.user_data = slot;
+        sq_array[index] = index;
+        __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+    }
+
+    // submits queued entries and waits for at least min_complete completions, returns how many were submitted or -1
+    int enter(unsigned to_submit, unsigned min_complete) {
+        while (true) {
+            long result { ::syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+                                    min_complete > 0 ? IORING_ENTER_GETEVENTS : 0, nullptr, 0) };
+            if (result >= 0) return static_cast<int>(result);
+            if (errno != EINTR) return -1;
+        }
+    }
+
+    // takes back the last count queued entries, the kernel has not consumed them
+    void withdraw(unsigned count) {
+        __atomic_store_n(sq_tail, *sq_tail - count, __ATOMIC_RELEASE);
+    }
+
+    bool next_completion(io_uring_cqe& completion) {
+        const unsigned head { *cq_head };
+        if (head == __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) return false;
+        completion = cqes[head & *cq_mask];
+        __atomic_store_n(cq_head, head + 1, __ATOMIC_RELEASE);
+        return true;
+    }
+#endif
+};
+
+namespace {
+    // pwrite() at increasing offsets, the output without io_uring
+    class PwriteOutput : public FileOutput {
+    private:
+        int m_fd;
+        std::uint64_t m_offset{};
+    public:
+        explicit PwriteOutput(int fd) : m_fd { fd } {}
+
+        bool write(const void* data, std::size_t size) override {
+            const auto* bytes { static_cast<const std::uint8_t*>(data) };
+            while (size > 0) {
+                ssize_t result { ::pwrite(m_fd, bytes, size, static_cast<off_t>(m_offset)) };
+                if (result < 0) {
+                    if (errno == EINTR) continue;
+                    return false;
+                }
+                if (result == 0) {
+                    errno = EIO;
+                    return false;
+                }
+                bytes += result;
+                size -= static_cast<std::size_t>(result);
+                m_offset += static_cast<std::uint64_t>(result);
+            }
+            return true;
+        }
+    };
+}
+
+#ifdef WEATHER_SENSORS_HAVE_IO_URING
+/**
+ *  Copies what it is given into the registered buffers and submits each buffer once it is full,
+ *  so every buffer can be in flight while the caller produces the next chunk
+ *  A short write is resubmitted from the same buffer for the remaining bytes
+ *  After an error nothing new is queued, finish() still reaps every write in flight,
+ *  the kernel owns those buffers until then
+ */
+class AsyncWriter::RingOutput : public FileOutput {
+private:
+    struct Slot {
+        std::uint64_t offset;       // file offset of the first byte in the buffer
+        std::size_t done;           // bytes of the buffer already written
+        std::size_t length;         // bytes in the buffer
+    };
+    Ring& m_ring;
+    int m_fd;
+    std::size_t m_buffer_size;
+    std::vector<Slot> m_slots;
+    std::vector<unsigned> m_free_slots;
+    unsigned m_in_flight{};
+    std::uint64_t m_offset{};       // file offset of the next byte given to write()
+    bool m_filling{};               // m_current takes the next bytes
+    unsigned m_current{};
+    bool m_ok { true };
+    int m_error{};
+
+    void fail(int error) {
+        if (m_ok) m_error = error;
+        m_ok = false;
+    }
+
+    // submits the write queued last, it is taken back if the kernel does not take it
+    void submit(unsigned slot) {
+        const int submitted { m_ring.enter(1, 0) };
+        if (submitted == 1) {
+            m_in_flight++;
+            return;
+        }
+        fail(submitted < 0 ? errno : EAGAIN);
+        m_ring.withdraw(1);
+        m_free_slots.push_back(slot);
+    }
+
+    void queue(unsigned slot) {
+        const Slot& state { m_slots[slot] };
+        m_ring.queue_write(m_fd, slot, state.done, state.length - state.done, state.offset + state.done);
+        submit(slot);
+    }
+
+    // handles the completions that arrived, with wait at least one if any write is in flight
+    void reap(bool wait) {
+        if (wait && m_in_flight > 0) m_ring.enter(0, 1);
+        io_uring_cqe completion {};
+        while (m_ring.next_completion(completion)) {
+            const auto slot { static_cast<unsigned>(completion.user_data) };
+            Slot& state { m_slots[slot] };
+            m_in_flight--;
+            if (completion.res < 0) fail(-completion.res);
+            else if (completion.res == 0) fail(EIO);
+            else state.done += static_cast<std::size_t>(completion.res);
+            if (m_ok && state.done < state.length) queue(slot);
+            else m_free_slots.push_back(slot);
+        }
+    }
+public:
+    RingOutput(Ring& ring, int fd, std::size_t buffer_size)
+        : m_ring { ring }, m_fd { fd }, m_buffer_size { buffer_size }, m_slots(ring.buffers.size()) {
+        for (unsigned i = 0; i < m_slots.size(); i++) m_free_slots.push_back(static_cast<unsigned>(m_slots.size()) - 1 - i);
+    }
+
+    bool write(const void* data, std::size_t size) override {
+        const auto* bytes { static_cast<const std::uint8_t*>(data) };
+        while (m_ok && size > 0) {
+            if (!m_filling) {
+                while (m_ok && m_free_slots.empty()) reap(true);
+                if (!m_ok) break;
+                m_current = m_free_slots.back();
+                m_free_slots.pop_back();
+                m_slots[m_current] = { m_offset, 0, 0 };
+                m_filling = true;
+            }
+            Slot& state { m_slots[m_current] };
+            const std::size_t length { std::min(size, m_buffer_size - state.length) };
+            std::memcpy(static_cast<std::uint8_t*>(m_ring.buffers[m_current].iov_base) + state.length, bytes, length);
+            state.length += length;
+            m_offset += length;
+            bytes += length;
+            size -= length;
+            if (state.length == m_buffer_size) {
+                m_filling = false;
+                queue(m_current);
+                reap(false);
+            }
+        }
+        if (!m_ok) errno = m_error;
+        return m_ok;
+    }
+
+    // writes the buffer being filled and waits for every write in flight
+    bool finish() {
+        if (m_filling) {
+            m_filling = false;
+            if (m_ok) queue(m_current);
+            else m_free_slots.push_back(m_current);
+        }
+        while (m_in_flight > 0) reap(true);
+        // the first error is reported, not whatever the drain left in errno
+        if (!m_ok) errno = m_error;
+        return m_ok;
+    }
+};
+#endif
+
+AsyncWriter::AsyncWriter() = default;
+
+AsyncWriter::~AsyncWriter() {
+    stop();
+}
+
+void AsyncWriter::start(AsyncWriterOptions options) {
+    if (running()) return;
+    m_options = options;
+    m_stopping = false;
+#ifdef WEATHER_SENSORS_HAVE_IO_URING
+    if (m_options.use_io_uring && m_options.queue_depth > 0) {
+        m_ring = std::make_unique<Ring>();
+        if (!m_ring->setup(m_options.queue_depth, m_options.buffer_size)) {
+            std::cerr << "io_uring not available (" << std::strerror(errno) << "), using pwrite\n";
+            m_ring.reset();
+        }
+    }
+#endif
+    m_thread = std::thread(&AsyncWriter::run, this);
+}
+
+void AsyncWriter::stop() {
+    if (!running()) return;
+    {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        m_stopping = true;
+    }
+    m_condition.notify_one();
+    m_thread.join();
+    m_ring.reset();
+}
+
+std::future<bool> AsyncWriter::write_file(std::string path, std::vector<std::uint8_t> data, bool atomic_replace) {
+    std::vector<std::vector<std::uint8_t>> parts;
+    parts.push_back(std::move(data));
+    return write_file(std::move(path), std::move(parts), atomic_replace);
+}
+
+std::future<bool> AsyncWriter::write_file(std::string path, std::vector<std::vector<std::uint8_t>> parts,
+                                          bool atomic_replace) {
+    auto request { std::make_unique<Request>() };
+    request->path = std::move(path);
+    request->parts = std::move(parts);
+    request->atomic_replace = atomic_replace;
+    return queue(std::move(request));
+}
+
+std::future<bool> AsyncWriter::write_file(std::string path, std::function<bool(FileOutput& output)> write,
+                                          bool atomic_replace) {
+    auto request { std::make_unique<Request>() };
+    request->path = std::move(path);
+    request->write = std::move(write);
+    request->atomic_replace = atomic_replace;
+    return queue(std::move(request));
+}
+
+std::future<bool> AsyncWriter::queue(std::unique_ptr<Request> request) {
+    std::future<bool> result { request->done.get_future() };
+    if (!running()) {
+        // not started, write on the calling thread
+        request->done.set_value(write_request(*request));
+        return result;
+    }
+    {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        m_queue.push_back(std::move(request));
+    }
+    m_condition.notify_one();
+    return result;
+}
+
+void AsyncWriter::run() {
+    trace_set_thread_name("file_writer");
+    while (true) {
+        std::unique_ptr<Request> request;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_condition.wait(lock, [this] { return m_stopping || !m_queue.empty(); });
+            if (m_queue.empty()) return;
+            request = std::move(m_queue.front());
+            m_queue.pop_front();
+        }
+        request->done.set_value(write_request(*request));
+    }
+}
+
+bool AsyncWriter::write_request(Request& request) {
+    TraceScope trace("write file");
+    const std::string target { request.atomic_replace ? request.path + ".tmp" : request.path };
+    int fd { ::open(target.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644) };
+    if (fd < 0) {
+        std::cerr << "Could not open " << target << ": " << std::strerror(errno) << "\n";
+        return false;
+    }
+    bool ok{};
+    if (m_ring) ok = write_with_ring(fd, request);
+    else if (!request.write) ok = write_with_pwritev(fd, request.parts);
+    else {
+        PwriteOutput output { fd };
+        ok = request.write(output);
+    }
+    ok = ok && ::fdatasync(fd) == 0;
+    ::close(fd);
+    if (ok && request.atomic_replace) ok = std::rename(target.c_str(), request.path.c_str()) == 0;
+    if (!ok) {
+        std::cerr << "Could not write " << request.path << ": " << std::strerror(errno) << "\n";
+        if (request.atomic_replace) ::unlink(target.c_str());
+    }
+    return ok;
+}
+
+/**
+ *  Writes the parts back to back without joining them, at most IOV_MAX per call
+ */
+bool AsyncWriter::write_with_pwritev(int fd, const std::vector<std::vector<std::uint8_t>>& parts) {
+    std::vector<iovec> vectors;
+    for (const auto& part : parts) {
+        if (!part.empty()) vectors.push_back({ const_cast<std::uint8_t*>(part.data()), part.size() });
+    }
+    std::size_t first { 0 };
+    std::uint64_t offset { 0 };
+    while (first < vectors.size()) {
+        const int count { static_cast<int>(std::min<std::size_t>(vectors.size() - first, IOV_MAX)) };
+        ssize_t result { ::pwritev(fd, vectors.data() + first, count, static_cast<off_t>(offset)) };
+        if (result < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        if (result == 0) {
+            errno = EIO;
+            return false;
+        }
+        offset += static_cast<std::uint64_t>(result);
+        // skip what was written, a short write leaves the rest of a part for the next call
+        auto written { static_cast<std::size_t>(result) };
+        while (first < vectors.size() && written >= vectors[first].iov_len) written -= vectors[first++].iov_len;
+        if (first < vectors.size()) {
+            vectors[first].iov_base = static_cast<std::uint8_t*>(vectors[first].iov_base) + written;
+            vectors[first].iov_len -= written;
+        }
+    }
+    return true;
+}
+
+/**
+ *  Every part, or what the request's function produces, goes through the registered buffers
+ */
+bool AsyncWriter::write_with_ring(int fd, Request& request) {
+#ifdef WEATHER_SENSORS_HAVE_IO_URING
+    RingOutput output { *m_ring, fd, m_options.buffer_size };
+    bool ok { true };
+    if (request.write) ok = request.write(output);
+    else {
+        for (const auto& part : request.parts) {
+            if (!output.write(part.data(), part.size())) break;
+        }
+    }
+    const int error { errno };
+    const bool finished { output.finish() };
+    if (finished && !ok) errno = error;
+    return finished && ok;
+#else
+    (void)fd;
+    (void)request;
+    return false;
+#endif
+}
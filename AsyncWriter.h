@@ -0,0 +1,87 @@
+#ifndef WEATHER_SENSORS_ASYNCWRITER_H
+#define WEATHER_SENSORS_ASYNCWRITER_H
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <future>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+
+struct AsyncWriterOptions {
+    unsigned queue_depth { 8 };                 // writes in flight, one registered buffer each
+    std::size_t buffer_size { 256 * 1024 };
+    bool use_io_uring { true };                 // false forces the pwrite fallback
+};
+
+/**
+ *  Sequential output of one file, handed to the function given to AsyncWriter::write_file()
+ *  With io_uring write() copies into the next registered buffer and submits it once full, so the
+ *  function goes on producing while earlier chunks are written; otherwise it is a pwrite()
+ */
+class FileOutput {
+public:
+    virtual ~FileOutput() = default;
+    // false once a write failed, errno tells why
+    virtual bool write(const void* data, std::size_t size) = 0;
+};
+
+/**
+ *  Background file writer so exports and snapshots never block the calling thread
+ *  On Linux it drives an io_uring with registered buffers: every file, given as one or more parts
+ *  or produced by a function, is copied into the buffers chunk by chunk with queue_depth chunks in flight
+ *  If io_uring is not available it falls back to pwritev() straight from the parts on the same thread
+ *  write_file() takes ownership of the bytes and returns at once, the future tells when the file
+ *  is on disk (fdatasync) and whether it succeeded
+ *  A file given as a function is produced on the background thread, for data that is not copied first
+ *  Files are written one at a time in request order, the writes in flight are chunks of one file
+ *  With atomic_replace the data goes to path.tmp which is renamed to path when complete
+ */
+class AsyncWriter {
+private:
+    struct Request {
+        std::string path;
+        std::vector<std::vector<std::uint8_t>> parts;
+        std::function<bool(FileOutput&)> write;     // produces the file when set
+        bool atomic_replace;
+        std::promise<bool> done;
+    };
+    struct Ring;
+    class RingOutput;
+
+    AsyncWriterOptions m_options;
+    std::unique_ptr<Ring> m_ring;
+    std::thread m_thread;
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    std::deque<std::unique_ptr<Request>> m_queue;
+    bool m_stopping{};
+
+    void run();
+    std::future<bool> queue(std::unique_ptr<Request> request);
+    bool write_request(Request& request);
+    bool write_with_ring(int fd, Request& request);
+    bool write_with_pwritev(int fd, const std::vector<std::vector<std::uint8_t>>& parts);
+public:
+    AsyncWriter();
+    AsyncWriter(const AsyncWriter&) = delete;
+    AsyncWriter& operator=(const AsyncWriter&) = delete;
+    ~AsyncWriter();
+
+    void start(AsyncWriterOptions options = {});
+    // finishes every queued write, then stops the background thread
+    void stop();
+    bool running() const { return m_thread.joinable(); }
+    bool using_io_uring() const { return m_ring != nullptr; }
+
+    std::future<bool> write_file(std::string path, std::vector<std::uint8_t> data, bool atomic_replace = false);
+    std::future<bool> write_file(std::string path, std::vector<std::vector<std::uint8_t>> parts, bool atomic_replace = false);
+    // write produces the file into output and returns false on failure, fdatasync and rename are done here
+    std::future<bool> write_file(std::string path, std::function<bool(FileOutput& output)> write,
+                                 bool atomic_replace = false);
+};
+
+#endif
@@ -0,0 +1,122 @@
+#include "Compression.h"
+#include <cmath>
+#include <limits>
+#include <sstream>
+
+namespace {
+    double slope(const TimeDouble& from, const TimeDouble& to, double offset) {
+        return (to.value + offset - from.value) / static_cast<double>((to.time_point - from.time_point).count());
+    }
+}
+
+void CompressionFilter::archive(const TimeDouble& reading, std::vector<TimeDouble>& kept) {
+    kept.push_back(reading);
+    m_kept++;
+    m_archived = reading;
+    m_has_archived = true;
+    m_has_pending = false;
+    m_upper_slope = std::numeric_limits<double>::infinity();
+    m_lower_slope = -std::numeric_limits<double>::infinity();
+}
+
+void CompressionFilter::filter(std::span<const TimeDouble> readings, std::vector<TimeDouble>& kept) {
+    m_input += readings.size();
+    if (m_options.mode == CompressionMode::off) {
+        kept.insert(kept.end(), readings.begin(), readings.end());
+        m_kept += readings.size();
+        return;
+    }
+    for (const TimeDouble& reading : readings) {
+        if (!m_has_archived) {
+            archive(reading, kept);
+            continue;
+        }
+        const TimeDouble& newest { m_has_pending ? m_pending : m_archived };
+        if (reading.time_point <= newest.time_point) {
+            // late reading, the doors only work forward in time
+            kept.push_back(reading);
+            m_kept++;
+            continue;
+        }
+        if (m_options.mode == CompressionMode::deadband) {
+            // held value is m_archived, the pending reading only marks where the flat part ends
+            if (std::abs(reading.value - m_archived.value) > m_options.deviation) archive(reading, kept);
+            else {
+                m_pending = reading;
+                m_has_pending = true;
+            }
+            continue;
+        }
+        if (!m_has_pending) {
+            m_pending = reading;
+            m_has_pending = true;
+            continue;
+        }
+        // would the line from m_archived to reading still pass every reading up to m_pending within deviation?
+        const double upper { std::min(m_upper_slope, slope(m_archived, m_pending, m_options.deviation)) };
+        const double lower { std::max(m_lower_slope, slope(m_archived, m_pending, -m_options.deviation)) };
+        const double line { slope(m_archived, reading, 0.0) };
+        if (lower <= line && line <= upper) {
+            m_upper_slope = upper;
+            m_lower_slope = lower;
+        } else {
+            // the doors closed: m_pending is the last reading the line can end on
+            archive(m_pending, kept);
+        }
+        m_pending = reading;
+        m_has_pending = true;
+    }
+}
+
+const char* compression_mode_name(CompressionMode mode) {
+    switch (mode) {
+        case CompressionMode::off:           return "off";
+        case CompressionMode::deadband:      return "deadband";
+        case CompressionMode::swinging_door: return "swinging-door";
+    }
+    return "unknown";
+}
+
+bool parse_compression(const std::string& text, CompressionOptions (&options)[sensor_count]) {
+    CompressionOptions parsed[sensor_count];
+    std::copy(std::begin(options), std::end(options), std::begin(parsed));
+    std::istringstream input { text };
+    std::string item;
+    bool any{};
+    while (std::getline(input, item, ',')) {
+        // optional sensor= prefix, otherwise the setting is for every sensor
+        std::string sensor;
+        if (const auto equals { item.find('=') }; equals != std::string::npos) {
+            sensor = item.substr(0, equals);
+            item = item.substr(equals + 1);
+        }
+        const auto colon { item.find(':') };
+        const std::string mode_text { item.substr(0, colon) };
+        CompressionOptions setting;
+        if (mode_text == "deadband") setting.mode = CompressionMode::deadband;
+        else if (mode_text == "swinging-door") setting.mode = CompressionMode::swinging_door;
+        else if (mode_text != "off") return false;
+        if (setting.mode != CompressionMode::off) {
+            if (colon == std::string::npos) return false;
+            std::size_t used{};
+            try {
+                setting.deviation = std::stod(item.substr(colon + 1), &used);
+            } catch (const std::exception&) {
+                return false;
+            }
+            if (used != item.size() - colon - 1 || !(setting.deviation >= 0)) return false;
+        }
+        bool matched{};
+        for (SensorId id : all_sensors) {
+            if (sensor.empty() || sensor == sensor_label(id)) {
+                parsed[static_cast<std::size_t>(id)] = setting;
+                matched = true;
+            }
+        }
+        if (!matched) return false;
+        any = true;
+    }
+    if (!any) return false;
+    std::copy(std::begin(parsed), std::end(parsed), std::begin(options));
+    return true;
+}
@@ -0,0 +1,59 @@
+#ifndef WEATHER_SENSORS_COMPRESSION_H
+#define WEATHER_SENSORS_COMPRESSION_H
+#include "structs.h"
+#include <span>
+#include <string>
+
+enum class CompressionMode : std::uint8_t {
+    off,
+    deadband,           // keep a reading when it leaves deviation around the last kept one, read back as steps
+    swinging_door       // keep the fewest readings so straight lines between them stay within deviation
+};
+
+struct CompressionOptions {
+    CompressionMode mode { CompressionMode::off };
+    double deviation{};     // largest error allowed when the signal is read back from the kept readings
+};
+
+/**
+ *  Ingest filter of one sensor in the style of process historians
+ *  Readings go through in time order, the ones needed to rebuild the signal within deviation come out
+ *  The newest reading is held back as pending until a later one decides whether it is needed,
+ *  readings older than the newest one seen are passed through unchanged
+ */
+class CompressionFilter {
+private:
+    CompressionOptions m_options;
+    TimeDouble m_archived{};        // last kept reading, the doors pivot on it
+    TimeDouble m_pending{};         // newest reading, not decided yet
+    bool m_has_archived{};
+    bool m_has_pending{};
+    // swinging door: slopes (value per ns) from m_archived that keep the readings between it and m_pending within deviation
+    double m_upper_slope{};
+    double m_lower_slope{};
+    std::uint64_t m_input{};
+    std::uint64_t m_kept{};
+
+    void archive(const TimeDouble& reading, std::vector<TimeDouble>& kept);
+public:
+    CompressionFilter() = default;
+    explicit CompressionFilter(CompressionOptions options) : m_options { options } {}
+    // appends the readings that are decided and needed to kept
+    void filter(std::span<const TimeDouble> readings, std::vector<TimeDouble>& kept);
+    // newest reading that is held back, nullptr if there is none
+    const TimeDouble* pending() const { return m_has_pending ? &m_pending : nullptr; }
+    // forgets the readings seen so far, the options and counters stay
+    void reset() { m_has_archived = false; m_has_pending = false; }
+    const CompressionOptions& options() const { return m_options; }
+    std::uint64_t input() const { return m_input; }
+    std::uint64_t kept() const { return m_kept; }
+};
+
+/**
+ *  "swinging-door:0.05" for every sensor, or per sensor "temperature=swinging-door:0.05,windspeed=deadband:0.5"
+ *  Modes are off, deadband and swinging-door, false if the text is malformed
+ */
+bool parse_compression(const std::string& text, CompressionOptions (&options)[sensor_count]);
+const char* compression_mode_name(CompressionMode mode);
+
+#endif
@@ -0,0 +1,26 @@
+#include "Crc32.h"
+#include <array>
+
+// table for the reflected polynomial 0xEDB88320, built once at compile time
+static constexpr std::array<std::uint32_t, 256> make_crc_table() {
+    std::array<std::uint32_t, 256> table {};
+    for (std::uint32_t i = 0; i < 256; i++) {
+        std::uint32_t value { i };
+        for (int bit = 0; bit < 8; bit++) {
+            value = (value & 1) ? (value >> 1) ^ 0xEDB88320u : value >> 1;
+        }
+        table[i] = value;
+    }
+    return table;
+}
+
+static constexpr std::array<std::uint32_t, 256> crc_table { make_crc_table() };
+
+std::uint32_t crc32(const void* data, std::size_t size, std::uint32_t crc) {
+    const auto* bytes { static_cast<const std::uint8_t*>(data) };
+    crc = ~crc;
+    for (std::size_t i = 0; i < size; i++) {
+        crc = crc_table[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
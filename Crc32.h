@@ -0,0 +1,12 @@
+#ifndef WEATHER_SENSORS_CRC32_H
+#define WEATHER_SENSORS_CRC32_H
+#include <cstdint>
+#include <cstddef>
+
+/**
+ *  CRC-32 (IEEE 802.3, same as zlib) used to protect records in binary files
+ *  Pass the previous result as crc to continue a checksum over several buffers
+ */
+std::uint32_t crc32(const void* data, std::size_t size, std::uint32_t crc = 0);
+
+#endif
@@ -0,0 +1,148 @@
+#include "FeedServer.h"
+#include "SensorData.h"
+#include "IngestProtocol.h"
+#include "Trace.h"
+#include <iostream>
+#include <vector>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/eventfd.h>
+
+namespace {
+    // how often disconnected subscribers are cleaned up when no socket is active
+    constexpr int prune_interval_ms { 500 };
+
+    bool send_all(int fd, const std::vector<std::uint8_t>& bytes) {
+        std::size_t sent{};
+        while (sent < bytes.size()) {
+            const ssize_t written { ::send(fd, bytes.data() + sent, bytes.size() - sent, MSG_NOSIGNAL) };
+            if (written < 0 && errno == EINTR) continue;
+            if (written <= 0) return false;
+            sent += static_cast<std::size_t>(written);
+        }
+        return true;
+    }
+
+    // writes the batch as frames of at most ingest_max_records records
+    ReadingsCallback make_socket_writer(int fd) {
+        return [fd, frame = std::vector<std::uint8_t>()](const SensorReadings& batch) mutable {
+            frame.clear();
+            std::uint32_t count{};
+            std::size_t header{};
+            for (SensorId id : all_sensors) {
+                for (const TimeDouble& reading : batch[id]) {
+                    if (count == 0) {
+                        header = frame.size();
+                        append_ingest_header(frame, 0);
+                    }
+                    append_ingest_record(frame, static_cast<std::uint8_t>(id), to_epoch_ns(reading.time_point), reading.value);
+                    if (++count == ingest_max_records) {
+                        std::memcpy(frame.data() + header + 4, &count, 4);
+                        count = 0;
+                    }
+                }
+            }
+            if (count > 0) std::memcpy(frame.data() + header + 4, &count, 4);
+            // a failed send means the client is gone, the server thread notices the hang up and unsubscribes
+            send_all(fd, frame);
+        };
+    }
+}
+
+bool parse_subscriber_policy(const std::string& text, SlowSubscriberPolicy& policy) {
+    if (text == "drop-oldest") policy = SlowSubscriberPolicy::drop_oldest;
+    else if (text == "disconnect") policy = SlowSubscriberPolicy::disconnect;
+    else return false;
+    return true;
+}
+
+FeedServer::~FeedServer() {
+    stop();
+}
+
+bool FeedServer::start(const FeedServerOptions& options, SensorData& data) {
+    if (running()) return true;
+    m_data = &data;
+    m_options = options;
+    sockaddr_un local {};
+    local.sun_family = AF_UNIX;
+    if (options.unix_path.empty() || options.unix_path.size() >= sizeof(local.sun_path)) {
+        std::cerr << "Invalid Unix socket path for the feed: " << options.unix_path << "\n";
+        return false;
+    }
+    std::memcpy(local.sun_path, options.unix_path.c_str(), options.unix_path.size() + 1);
+    ::unlink(options.unix_path.c_str());        // left behind by an earlier run
+    m_listen_fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    m_stop_fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_listen_fd < 0 || m_stop_fd < 0 || ::bind(m_listen_fd, reinterpret_cast<sockaddr*>(&local), sizeof(local)) < 0
+        || ::listen(m_listen_fd, SOMAXCONN) < 0) {
+        std::cerr << "Could not listen on " << options.unix_path << ": " << std::strerror(errno) << "\n";
+        close_fds();
+        return false;
+    }
+    m_thread = std::thread(&FeedServer::run, this);
+    return true;
+}
+
+void FeedServer::stop() {
+    if (!running()) return;
+    const std::uint64_t one { 1 };
+    [[maybe_unused]] const ssize_t written { ::write(m_stop_fd, &one, sizeof(one)) };
+    m_thread.join();
+    close_fds();
+}
+
+void FeedServer::close_fds() {
+    if (m_listen_fd >= 0) {
+        ::close(m_listen_fd);
+        ::unlink(m_options.unix_path.c_str());
+    }
+    if (m_stop_fd >= 0) ::close(m_stop_fd);
+    m_listen_fd = m_stop_fd = -1;
+}
+
+void FeedServer::close_client(Client& client) {
+    // shutdown wakes a subscriber thread blocked in send() so unsubscribe() can join it
+    ::shutdown(client.fd, SHUT_RDWR);
+    client.subscription.unsubscribe();
+    ::close(client.fd);
+}
+
+void FeedServer::run() {
+    trace_set_thread_name("feed_server");
+    std::vector<pollfd> fds;
+    for (;;) {
+        fds.clear();
+        fds.push_back({ m_stop_fd, POLLIN, 0 });
+        fds.push_back({ m_listen_fd, POLLIN, 0 });
+        for (const Client& client : m_clients) fds.push_back({ client.fd, POLLRDHUP, 0 });
+        const int ready { ::poll(fds.data(), fds.size(), prune_interval_ms) };
+        if (ready < 0 && errno != EINTR) break;
+
+        if (fds[0].revents & POLLIN) break;
+        if (fds[1].revents & POLLIN) {
+            for (;;) {
+                const int fd { ::accept4(m_listen_fd, nullptr, nullptr, SOCK_CLOEXEC) };
+                if (fd < 0) break;
+                m_clients.push_back({ fd, m_data->subscribe(make_socket_writer(fd), m_options.subscriber) });
+            }
+        }
+        // clients that hung up or were disconnected by the slow subscriber policy
+        std::size_t index { 2 };
+        for (auto client { m_clients.begin() }; client != m_clients.end(); index++) {
+            const bool hung_up { index < fds.size() && (fds[index].revents & (POLLRDHUP | POLLHUP | POLLERR)) != 0 };
+            if (hung_up || !client->subscription.connected()) {
+                close_client(*client);
+                client = m_clients.erase(client);
+            } else {
+                ++client;
+            }
+        }
+    }
+    for (Client& client : m_clients) close_client(client);
+    m_clients.clear();
+}
@@ -0,0 +1,53 @@
+#ifndef WEATHER_SENSORS_FEEDSERVER_H
+#define WEATHER_SENSORS_FEEDSERVER_H
+#include "ReadingsHub.h"
+#include <string>
+#include <list>
+#include <thread>
+
+class SensorData;
+
+struct FeedServerOptions {
+    std::string unix_path;
+    SubscriberOptions subscriber;       // queue bound and slow subscriber policy of every connection
+};
+
+/**
+ *  Streams every stored reading to the clients of a Unix stream socket
+ *  Each connection is a SensorData subscriber, its thread writes the batches as ingest protocol
+ *  frames (IngestProtocol.h), so a feed can be read with the same decoder or piped into another
+ *  station's ingest socket
+ *  A client that does not keep up loses readings or is disconnected, as set by the policy
+ */
+class FeedServer {
+private:
+    struct Client {
+        int fd;
+        Subscription subscription;
+    };
+    SensorData* m_data{};
+    FeedServerOptions m_options;
+    std::thread m_thread;
+    std::list<Client> m_clients;        // only touched by the server thread
+    int m_listen_fd { -1 };
+    int m_stop_fd { -1 };
+
+    void run();
+    void close_client(Client& client);
+    void close_fds();
+public:
+    FeedServer() = default;
+    FeedServer(const FeedServer&) = delete;
+    FeedServer& operator=(const FeedServer&) = delete;
+    ~FeedServer();
+
+    // binds the socket and starts the thread, false (with a message on std::cerr) on failure
+    bool start(const FeedServerOptions& options, SensorData& data);
+    void stop();
+    bool running() const { return m_thread.joinable(); }
+};
+
+// "drop-oldest" or "disconnect"
+bool parse_subscriber_policy(const std::string& text, SlowSubscriberPolicy& policy);
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef WEATHER_SENSORS_INGESTPROTOCOL_H
+#define WEATHER_SENSORS_INGESTPROTOCOL_H
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+/**
+ *  Binary batch protocol of the ingest server, shared with the load generator
+ *  A frame is an 8 byte header followed by count packed 17 byte records:
+ *      header  u32 magic "WSB1", u32 count
+ *      record  u8 sensor id, i64 timestamp (ns since epoch, 0 = time of arrival), f64 value
+ *  Integers and doubles are in host byte order, the protocol is for local clients only
+ *  A Unix stream connection carries any number of frames back to back,
+ *  a UDP datagram carries exactly one frame
+ */
+
+constexpr std::uint32_t ingest_magic { 0x31425357 };     // "WSB1" in little endian
+constexpr std::size_t ingest_header_size { 8 };
+constexpr std::size_t ingest_record_size { 17 };
+constexpr std::uint32_t ingest_max_records { 65536 };
+// largest frame that fits in one UDP datagram over IPv4
+constexpr std::uint32_t ingest_max_datagram_records { (65507 - ingest_header_size) / ingest_record_size };
+
+inline void append_ingest_header(std::vector<std::uint8_t>& frame, std::uint32_t count) {
+    const std::size_t offset { frame.size() };
+    frame.resize(offset + ingest_header_size);
+    std::memcpy(frame.data() + offset, &ingest_magic, 4);
+    std::memcpy(frame.data() + offset + 4, &count, 4);
+}
+
+inline void append_ingest_record(std::vector<std::uint8_t>& frame, std::uint8_t sensor, std::int64_t epoch_ns, double value) {
+    const std::size_t offset { frame.size() };
+    frame.resize(offset + ingest_record_size);
+    frame[offset] = sensor;
+    std::memcpy(frame.data() + offset + 1, &epoch_ns, 8);
+    std::memcpy(frame.data() + offset + 9, &value, 8);
+}
+
+#endif
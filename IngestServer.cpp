@@ -0,0 +1,259 @@
+#include "IngestServer.h"
+#include "SensorData.h"
+#include "Trace.h"
+#include <iostream>
+#include <memory>
+#include <unordered_map>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+
+namespace {
+    // holds the largest frame with room to spare, so a read never has to wait for a compaction
+    constexpr std::size_t stream_buffer_size { 2 * (ingest_header_size + ingest_max_records * ingest_record_size) };
+    constexpr unsigned datagrams_per_read { 16 };
+    constexpr std::size_t datagram_size { 65536 };
+    // a batch is handed to SensorData when it gets this big even if more data is ready
+    constexpr std::size_t flush_readings { 1 << 16 };
+
+    struct StreamBuffer {
+        std::unique_ptr<std::uint8_t[]> bytes { new std::uint8_t[stream_buffer_size] };
+        std::size_t begin{};
+        std::size_t end{};
+    };
+
+    enum class DecodeResult { complete, incomplete, rejected };
+
+    /**
+     *  Decodes the frame at the start of bytes into batch
+     *  complete: consumed is set to the frame size, incomplete: more bytes are needed
+     *  rejected: the frame is malformed and nothing was added to batch
+     */
+    DecodeResult decode_frame(const std::uint8_t* bytes, std::size_t size, std::chrono::system_clock::time_point arrival,
+                              SensorReadings& batch, std::size_t& consumed) {
+        if (size < ingest_header_size) return DecodeResult::incomplete;
+        std::uint32_t magic{}, count{};
+        std::memcpy(&magic, bytes, 4);
+        std::memcpy(&count, bytes + 4, 4);
+        if (magic != ingest_magic || count > ingest_max_records) return DecodeResult::rejected;
+        const std::size_t frame_size { ingest_header_size + count * ingest_record_size };
+        if (size < frame_size) return DecodeResult::incomplete;
+
+        const std::size_t before[sensor_count] { batch.temperature.size(), batch.humidity.size(), batch.windspeed.size() };
+        const std::uint8_t* record { bytes + ingest_header_size };
+        for (std::uint32_t i = 0; i < count; i++, record += ingest_record_size) {
+            if (record[0] >= sensor_count) {
+                for (SensorId id : all_sensors) batch[id].resize(before[static_cast<std::size_t>(id)]);
+                return DecodeResult::rejected;
+            }
+            std::int64_t epoch_ns{};
+            double value{};
+            std::memcpy(&epoch_ns, record + 1, 8);
+            std::memcpy(&value, record + 9, 8);
+            batch[static_cast<SensorId>(record[0])].emplace_back(epoch_ns == 0 ? arrival : from_epoch_ns(epoch_ns), value);
+        }
+        consumed = frame_size;
+        return DecodeResult::complete;
+    }
+
+    std::size_t batch_size(const SensorReadings& batch) {
+        return batch.temperature.size() + batch.humidity.size() + batch.windspeed.size();
+    }
+}
+
+IngestServer::~IngestServer() {
+    stop();
+}
+
+bool IngestServer::start(const IngestServerOptions& options, SensorData& data) {
+    if (running()) return true;
+    m_data = &data;
+    if (!options.unix_path.empty()) {
+        sockaddr_un local {};
+        local.sun_family = AF_UNIX;
+        if (options.unix_path.size() >= sizeof(local.sun_path)) {
+            std::cerr << "Unix socket path too long: " << options.unix_path << "\n";
+            return false;
+        }
+        std::memcpy(local.sun_path, options.unix_path.c_str(), options.unix_path.size() + 1);
+        ::unlink(options.unix_path.c_str());        // left behind by an earlier run
+        m_unix_fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (m_unix_fd < 0 || ::bind(m_unix_fd, reinterpret_cast<sockaddr*>(&local), sizeof(local)) < 0
+            || ::listen(m_unix_fd, SOMAXCONN) < 0) {
+            std::cerr << "Could not listen on " << options.unix_path << ": " << std::strerror(errno) << "\n";
+            close_fds();
+            return false;
+        }
+        m_unix_path = options.unix_path;
+    }
+    if (options.udp_port >= 0) {
+        sockaddr_in local {};
+        local.sin_family = AF_INET;
+        local.sin_port = htons(static_cast<std::uint16_t>(options.udp_port));
+        local.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        m_udp_fd = ::socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        // a large receive buffer absorbs bursts while a batch is being stored
+        const int receive_buffer { 8 << 20 };
+        if (m_udp_fd >= 0) ::setsockopt(m_udp_fd, SOL_SOCKET, SO_RCVBUF, &receive_buffer, sizeof(receive_buffer));
+        socklen_t length { sizeof(local) };
+        if (m_udp_fd < 0 || ::bind(m_udp_fd, reinterpret_cast<sockaddr*>(&local), sizeof(local)) < 0
+            || ::getsockname(m_udp_fd, reinterpret_cast<sockaddr*>(&local), &length) < 0) {
+            std::cerr << "Could not bind UDP port " << options.udp_port << ": " << std::strerror(errno) << "\n";
+            close_fds();
+            return false;
+        }
+        m_udp_port = ntohs(local.sin_port);
+    }
+
+    m_epoll_fd = ::epoll_create1(EPOLL_CLOEXEC);
+    m_stop_fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_epoll_fd < 0 || m_stop_fd < 0) {
+        std::cerr << "Could not create the ingest event loop: " << std::strerror(errno) << "\n";
+        close_fds();
+        return false;
+    }
+    for (int fd : { m_unix_fd, m_udp_fd, m_stop_fd }) {
+        if (fd < 0) continue;
+        epoll_event event {};
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        ::epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, fd, &event);
+    }
+    m_thread = std::thread(&IngestServer::run, this);
+    return true;
+}
+
+void IngestServer::stop() {
+    if (!running()) return;
+    const std::uint64_t one { 1 };
+    [[maybe_unused]] const ssize_t written { ::write(m_stop_fd, &one, sizeof(one)) };
+    m_thread.join();
+    close_fds();
+}
+
+void IngestServer::close_fds() {
+    for (int* fd : { &m_unix_fd, &m_udp_fd, &m_epoll_fd, &m_stop_fd }) {
+        if (*fd >= 0) ::close(*fd);
+        *fd = -1;
+    }
+    if (!m_unix_path.empty()) ::unlink(m_unix_path.c_str());
+    m_unix_path.clear();
+    m_udp_port = -1;
+}
+
+void IngestServer::run() {
+    trace_set_thread_name("ingest");
+    std::unordered_map<int, StreamBuffer> connections;
+    SensorReadings batch;
+    for (SensorId id : all_sensors) batch[id].reserve(flush_readings);
+
+    auto flush = [&] {
+        const std::size_t size { batch_size(batch) };
+        if (size == 0) return;
+        m_data->store_batch(batch);
+        m_readings.fetch_add(size, std::memory_order_relaxed);
+        for (SensorId id : all_sensors) batch[id].clear();
+    };
+
+    // recvmmsg buffers, one per datagram
+    std::unique_ptr<std::uint8_t[]> datagrams;
+    mmsghdr messages[datagrams_per_read] {};
+    iovec vectors[datagrams_per_read] {};
+    if (m_udp_fd >= 0) {
+        datagrams.reset(new std::uint8_t[datagrams_per_read * datagram_size]);
+        for (unsigned i = 0; i < datagrams_per_read; i++) {
+            vectors[i] = { datagrams.get() + i * datagram_size, datagram_size };
+            messages[i].msg_hdr.msg_iov = &vectors[i];
+            messages[i].msg_hdr.msg_iovlen = 1;
+        }
+    }
+
+    epoll_event events[64];
+    for (;;) {
+        const int ready { ::epoll_wait(m_epoll_fd, events, 64, -1) };
+        if (ready < 0 && errno == EINTR) continue;
+        if (ready < 0) break;
+        const auto arrival { m_data->clock().now() };
+        for (int i = 0; i < ready; i++) {
+            const int fd { events[i].data.fd };
+            if (fd == m_stop_fd) {
+                flush();
+                for (auto& [client, buffer] : connections) ::close(client);
+                return;
+            }
+            if (fd == m_unix_fd) {
+                for (;;) {
+                    const int client { ::accept4(m_unix_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC) };
+                    if (client < 0) break;
+                    epoll_event event {};
+                    event.events = EPOLLIN;
+                    event.data.fd = client;
+                    ::epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, client, &event);
+                    connections[client];
+                }
+                continue;
+            }
+            if (fd == m_udp_fd) {
+                TraceScope trace("ingest udp");
+                const int received { ::recvmmsg(m_udp_fd, messages, datagrams_per_read, MSG_DONTWAIT, nullptr) };
+                for (int m = 0; m < received; m++) {
+                    // a datagram is exactly one frame, a truncated one can not be completed later
+                    const std::size_t length { messages[m].msg_len };
+                    const auto* bytes { static_cast<const std::uint8_t*>(vectors[m].iov_base) };
+                    std::uint32_t count{};
+                    if (length >= ingest_header_size) std::memcpy(&count, bytes + 4, 4);
+                    std::size_t consumed{};
+                    if (length == ingest_header_size + std::size_t { count } * ingest_record_size
+                        && decode_frame(bytes, length, arrival, batch, consumed) == DecodeResult::complete) {
+                        m_frames.fetch_add(1, std::memory_order_relaxed);
+                    } else {
+                        m_rejected.fetch_add(1, std::memory_order_relaxed);
+                    }
+                }
+                if (batch_size(batch) >= flush_readings) flush();
+                continue;
+            }
+
+            auto found { connections.find(fd) };
+            if (found == connections.end()) continue;
+            TraceScope trace("ingest stream");
+            StreamBuffer& buffer { found->second };
+            if (buffer.end == stream_buffer_size) {
+                std::memmove(buffer.bytes.get(), buffer.bytes.get() + buffer.begin, buffer.end - buffer.begin);
+                buffer.end -= buffer.begin;
+                buffer.begin = 0;
+            }
+            const ssize_t received { ::recv(fd, buffer.bytes.get() + buffer.end, stream_buffer_size - buffer.end, 0) };
+            if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) continue;
+            bool keep { received > 0 };
+            if (keep) buffer.end += static_cast<std::size_t>(received);
+            for (;;) {
+                std::size_t consumed{};
+                const DecodeResult result { decode_frame(buffer.bytes.get() + buffer.begin, buffer.end - buffer.begin,
+                                                         arrival, batch, consumed) };
+                if (result == DecodeResult::incomplete) break;
+                if (result == DecodeResult::rejected) {
+                    // the stream can not be resynchronised after a bad frame
+                    m_rejected.fetch_add(1, std::memory_order_relaxed);
+                    keep = false;
+                    break;
+                }
+                m_frames.fetch_add(1, std::memory_order_relaxed);
+                buffer.begin += consumed;
+                if (batch_size(batch) >= flush_readings) flush();
+            }
+            if (buffer.begin == buffer.end) buffer.begin = buffer.end = 0;
+            if (!keep) {
+                ::close(fd);
+                connections.erase(found);
+            }
+        }
+        // one store_batch() for everything read in this round
+        flush();
+    }
+}
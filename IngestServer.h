@@ -0,0 +1,57 @@
+#ifndef WEATHER_SENSORS_INGESTSERVER_H
+#define WEATHER_SENSORS_INGESTSERVER_H
+#include "IngestProtocol.h"
+#include <string>
+#include <atomic>
+#include <thread>
+#include <cstdint>
+
+class SensorData;
+
+struct IngestServerOptions {
+    std::string unix_path;      // stream socket, empty for none
+    int udp_port { -1 };        // datagram socket on 127.0.0.1, -1 for none, 0 picks a free port
+};
+
+/**
+ *  Receives readings from external collectors (protocol in IngestProtocol.h)
+ *  One epoll thread reads every socket, decodes all complete frames of a read straight into
+ *  per-sensor batches and hands them to SensorData::store_batch(), so sensor_mutex is taken
+ *  once per read instead of once per reading
+ *  A frame with a bad magic, an oversized count or an unknown sensor id is rejected,
+ *  on a stream connection that also closes the connection
+ */
+class IngestServer {
+private:
+    SensorData* m_data{};
+    std::thread m_thread;
+    std::string m_unix_path;
+    int m_unix_fd { -1 };
+    int m_udp_fd { -1 };
+    int m_udp_port { -1 };
+    int m_epoll_fd { -1 };
+    int m_stop_fd { -1 };
+    std::atomic<std::uint64_t> m_frames{};
+    std::atomic<std::uint64_t> m_readings{};
+    std::atomic<std::uint64_t> m_rejected{};
+
+    void run();
+    void close_fds();
+public:
+    IngestServer() = default;
+    IngestServer(const IngestServer&) = delete;
+    IngestServer& operator=(const IngestServer&) = delete;
+    ~IngestServer();
+
+    // binds the sockets and starts the thread, false (with a message on std::cerr) on failure
+    bool start(const IngestServerOptions& options, SensorData& data);
+    void stop();
+    bool running() const { return m_thread.joinable(); }
+    int udp_port() const { return m_udp_port; }
+
+    std::uint64_t frames() const { return m_frames.load(std::memory_order_relaxed); }
+    std::uint64_t readings() const { return m_readings.load(std::memory_order_relaxed); }
+    std::uint64_t rejected() const { return m_rejected.load(std::memory_order_relaxed); }
+};
+
+#endif
@@ -0,0 +1,83 @@
+#include "LatestValues.h"
+#include <iostream>
+#include <new>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+LatestValueWriter::~LatestValueWriter() {
+    close();
+}
+
+bool LatestValueWriter::create(const std::string& name) {
+    close();
+    const int fd { ::shm_open(name.c_str(), O_CREAT | O_RDWR | O_CLOEXEC, 0644) };
+    if (fd < 0) {
+        std::cerr << "Could not create shared memory " << name << ": " << std::strerror(errno) << "\n";
+        return false;
+    }
+    void* memory { MAP_FAILED };
+    if (::ftruncate(fd, sizeof(LatestValueTable)) == 0) {
+        memory = ::mmap(nullptr, sizeof(LatestValueTable), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+    if (memory == MAP_FAILED) {
+        std::cerr << "Could not map shared memory " << name << ": " << std::strerror(errno) << "\n";
+        ::shm_unlink(name.c_str());
+        return false;
+    }
+
+    // the magic is written last, a reader that opens the segment early sees an invalid table
+    auto* table { new (memory) LatestValueTable {} };
+    table->version = latest_values_version;
+    table->slot_count = sensor_count;
+    for (SensorId id : all_sensors) {
+        table->slots[static_cast<std::size_t>(id)].sensor.store(static_cast<std::uint32_t>(id), std::memory_order_relaxed);
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(table->magic, latest_values_magic, sizeof(table->magic));
+    m_table = table;
+    m_name = name;
+    return true;
+}
+
+void LatestValueWriter::close() {
+    if (!m_table) return;
+    ::munmap(m_table, sizeof(LatestValueTable));
+    ::shm_unlink(m_name.c_str());
+    m_table = nullptr;
+    m_name.clear();
+}
+
+LatestValueReader::~LatestValueReader() {
+    close();
+}
+
+bool LatestValueReader::open(const std::string& name) {
+    close();
+    const int fd { ::shm_open(name.c_str(), O_RDONLY | O_CLOEXEC, 0) };
+    if (fd < 0) return false;
+    struct stat status {};
+    void* memory { MAP_FAILED };
+    if (::fstat(fd, &status) == 0 && static_cast<std::size_t>(status.st_size) >= sizeof(LatestValueTable)) {
+        memory = ::mmap(nullptr, sizeof(LatestValueTable), PROT_READ, MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+    if (memory == MAP_FAILED) return false;
+    const auto* table { static_cast<const LatestValueTable*>(memory) };
+    if (std::memcmp(table->magic, latest_values_magic, sizeof(table->magic)) != 0
+        || table->version != latest_values_version || table->slot_count != sensor_count) {
+        ::munmap(memory, sizeof(LatestValueTable));
+        return false;
+    }
+    m_table = table;
+    return true;
+}
+
+void LatestValueReader::close() {
+    if (!m_table) return;
+    ::munmap(const_cast<LatestValueTable*>(m_table), sizeof(LatestValueTable));
+    m_table = nullptr;
+}
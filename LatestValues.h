@@ -0,0 +1,116 @@
+#ifndef WEATHER_SENSORS_LATESTVALUES_H
+#define WEATHER_SENSORS_LATESTVALUES_H
+#include "structs.h"
+#include <string>
+#include <cstring>
+
+/**
+ *  Latest value of every sensor in a POSIX shared memory segment (shm_open)
+ *  One cache line per sensor, each guarded by a seqlock: the writer makes the sequence odd,
+ *  stores the fields and makes it even again, a reader retries while the sequence is odd or
+ *  changed under it. Reading is a handful of loads from the mapping, no syscall and no lock
+ *  Fields are relaxed atomics so the concurrent access is well defined, they have to be lock
+ *  free to work across processes
+ *  There must be a single writer per slot at a time, SensorData writes under sensor_mutex
+ */
+
+constexpr char latest_values_magic[8] { 'W', 'S', 'L', 'A', 'T', 'E', 'S', 'T' };
+constexpr std::uint32_t latest_values_version { 1 };
+
+struct alignas(64) LatestValueSlot {
+    std::atomic<std::uint64_t> sequence;    // even when stable, 0 until the first reading
+    std::atomic<std::uint32_t> sensor;      // SensorId
+    std::atomic<std::int64_t> epoch_ns;
+    std::atomic<std::uint64_t> value_bits;  // the double, as bits
+};
+
+struct LatestValueTable {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t slot_count;
+    alignas(64) LatestValueSlot slots[sensor_count];
+};
+
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free && std::atomic<std::int64_t>::is_always_lock_free
+              && std::atomic<std::uint32_t>::is_always_lock_free, "shared memory atomics must be lock free");
+static_assert(sizeof(LatestValueSlot) == 64);
+
+struct LatestValue {
+    SensorId sensor;
+    std::chrono::system_clock::time_point time_point;
+    double value;
+    std::uint64_t sequence;     // grows by 2 with every update, readers can use it to detect new values
+};
+
+// seqlock write, the caller makes sure no other thread writes the same slot at the same time
+inline void write_latest_value(LatestValueSlot& slot, std::int64_t epoch_ns, double value) {
+    const std::uint64_t sequence { slot.sequence.load(std::memory_order_relaxed) };
+    slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    std::uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    slot.epoch_ns.store(epoch_ns, std::memory_order_relaxed);
+    slot.value_bits.store(bits, std::memory_order_relaxed);
+    slot.sequence.store(sequence + 2, std::memory_order_release);
+}
+
+// seqlock read, false if the sensor has no reading yet
+inline bool read_latest_value(const LatestValueSlot& slot, LatestValue& out) {
+    for (;;) {
+        const std::uint64_t before { slot.sequence.load(std::memory_order_acquire) };
+        if (before == 0) return false;
+        if (before & 1) continue;       // a write is in progress
+        const std::uint32_t sensor { slot.sensor.load(std::memory_order_relaxed) };
+        const std::int64_t epoch_ns { slot.epoch_ns.load(std::memory_order_relaxed) };
+        const std::uint64_t bits { slot.value_bits.load(std::memory_order_relaxed) };
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.sequence.load(std::memory_order_relaxed) != before) continue;
+        out.sensor = static_cast<SensorId>(sensor);
+        out.time_point = std::chrono::system_clock::time_point { std::chrono::nanoseconds { epoch_ns } };
+        std::memcpy(&out.value, &bits, sizeof(bits));
+        out.sequence = before;
+        return true;
+    }
+}
+
+/**
+ *  Owner of the segment, creates it and removes the name again on close()
+ */
+class LatestValueWriter {
+private:
+    std::string m_name;
+    LatestValueTable* m_table{};
+public:
+    LatestValueWriter() = default;
+    LatestValueWriter(const LatestValueWriter&) = delete;
+    LatestValueWriter& operator=(const LatestValueWriter&) = delete;
+    ~LatestValueWriter();
+
+    // name as for shm_open, e.g. "/weather_sensors", false (with a message on std::cerr) on failure
+    bool create(const std::string& name);
+    void close();
+    LatestValueTable* table() const { return m_table; }
+};
+
+/**
+ *  Reader library: maps the segment read only, after open() every read is done in user space
+ */
+class LatestValueReader {
+private:
+    const LatestValueTable* m_table{};
+public:
+    LatestValueReader() = default;
+    LatestValueReader(const LatestValueReader&) = delete;
+    LatestValueReader& operator=(const LatestValueReader&) = delete;
+    ~LatestValueReader();
+
+    // false if the segment does not exist or was made by an incompatible version
+    bool open(const std::string& name);
+    void close();
+    bool is_open() const { return m_table != nullptr; }
+    bool read(SensorId id, LatestValue& out) const {
+        return read_latest_value(m_table->slots[static_cast<std::size_t>(id)], out);
+    }
+};
+
+#endif
@@ -0,0 +1,106 @@
+#include "LockStats.h"
+#include <iomanip>
+#include <bit>
+#include <algorithm>
+
+const char* lock_site_name(LockSite site) {
+    switch (site) {
+        case LockSite::store_new_reading:     return "store_new_reading";
+        case LockSite::store_batch:           return "store_batch";
+        case LockSite::sensor_statistics:     return "sensor_statistics";
+        case LockSite::print_latest_readings: return "print_latest_readings";
+        case LockSite::print_statistics:      return "print_statistics";
+        case LockSite::other:                 break;
+        case LockSite::count:                 break;
+    }
+    return "other";
+}
+
+#ifdef WEATHER_SENSORS_LOCK_STATS
+
+namespace {
+    constexpr std::size_t site_count { static_cast<std::size_t>(LockSite::count) };
+    LockHistogram wait_histograms[site_count];
+    LockHistogram hold_histograms[site_count];
+
+    std::uint64_t nanoseconds(std::chrono::steady_clock::duration duration) {
+        return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count());
+    }
+}
+
+void LockHistogram::record(std::uint64_t ns) {
+    const int bucket { std::min(bucket_count - 1, std::max(0, static_cast<int>(std::bit_width(ns)) - 1)) };
+    buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    total_ns.fetch_add(ns, std::memory_order_relaxed);
+    std::uint64_t previous { max_ns.load(std::memory_order_relaxed) };
+    while (ns > previous && !max_ns.compare_exchange_weak(previous, ns, std::memory_order_relaxed)) {}
+}
+
+std::uint64_t LockHistogram::count() const {
+    std::uint64_t total { 0 };
+    for (const auto& bucket : buckets) total += bucket.load(std::memory_order_relaxed);
+    return total;
+}
+
+std::uint64_t LockHistogram::percentile_ns(double fraction) const {
+    const std::uint64_t total { count() };
+    if (total == 0) return 0;
+    const auto target { static_cast<std::uint64_t>(fraction * static_cast<double>(total)) };
+    std::uint64_t seen { 0 };
+    for (int i = 0; i < bucket_count; i++) {
+        seen += buckets[i].load(std::memory_order_relaxed);
+        if (seen > target) return (std::uint64_t { 1 } << (i + 1)) - 1;
+    }
+    return max_ns.load(std::memory_order_relaxed);
+}
+
+void InstrumentedMutex::lock(LockSite site) {
+    const auto start { std::chrono::steady_clock::now() };
+    m_mutex.lock();
+    m_acquired = std::chrono::steady_clock::now();
+    m_site = site;
+    wait_histograms[static_cast<std::size_t>(site)].record(nanoseconds(m_acquired - start));
+}
+
+void InstrumentedMutex::unlock() {
+    // read the members before unlocking, the next owner overwrites them
+    const LockSite site { m_site };
+    const auto held { std::chrono::steady_clock::now() - m_acquired };
+    m_mutex.unlock();
+    hold_histograms[static_cast<std::size_t>(site)].record(nanoseconds(held));
+}
+
+bool lock_stats_enabled() {
+    return true;
+}
+
+void print_lock_statistics(std::ostream& out) {
+    out << "\nsensor_mutex lock statistics (ns)\n"
+        << std::left << std::setw(24) << "site" << std::right
+        << std::setw(6) << "" << std::setw(12) << "count" << std::setw(12) << "mean"
+        << std::setw(12) << "p50" << std::setw(12) << "p99" << std::setw(14) << "max" << "\n";
+    for (std::size_t i = 0; i < site_count; i++) {
+        for (bool wait : { true, false }) {
+            const LockHistogram& histogram { wait ? wait_histograms[i] : hold_histograms[i] };
+            const std::uint64_t count { histogram.count() };
+            if (count == 0) continue;
+            out << std::left << std::setw(24) << lock_site_name(static_cast<LockSite>(i)) << std::right
+                << std::setw(6) << (wait ? "wait" : "hold")
+                << std::setw(12) << count
+                << std::setw(12) << histogram.total_ns.load(std::memory_order_relaxed) / count
+                << std::setw(12) << histogram.percentile_ns(0.5)
+                << std::setw(12) << histogram.percentile_ns(0.99)
+                << std::setw(14) << histogram.max_ns.load(std::memory_order_relaxed) << "\n";
+        }
+    }
+}
+
+#else
+
+bool lock_stats_enabled() {
+    return false;
+}
+
+void print_lock_statistics(std::ostream&) {}
+
+#endif
@@ -0,0 +1,94 @@
+#ifndef WEATHER_SENSORS_LOCKSTATS_H
+#define WEATHER_SENSORS_LOCKSTATS_H
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include "Trace.h"
+
+/**
+ *  Places where sensor_mutex is taken, each gets its own wait and hold histograms
+ */
+enum class LockSite : std::uint8_t {
+    store_new_reading,
+    store_batch,
+    sensor_statistics,
+    print_latest_readings,
+    print_statistics,
+    other,
+    count
+};
+
+const char* lock_site_name(LockSite site);
+
+#ifdef WEATHER_SENSORS_LOCK_STATS
+
+/**
+ *  Histogram with power of two buckets: bucket i counts durations in [2^i, 2^(i+1)) ns
+ *  Relaxed atomics, so it can be read while other threads record
+ */
+struct LockHistogram {
+    static constexpr int bucket_count { 40 };
+    std::atomic<std::uint64_t> buckets[bucket_count] {};
+    std::atomic<std::uint64_t> total_ns {};
+    std::atomic<std::uint64_t> max_ns {};
+
+    void record(std::uint64_t ns);
+    // upper bound of the bucket holding the given fraction (0.5 for the median)
+    std::uint64_t percentile_ns(double fraction) const;
+    std::uint64_t count() const;
+};
+
+/**
+ *  std::mutex that measures how long each site waited for it and how long it was held
+ *  lock()/unlock() without a site count as LockSite::other, so it also works with std::lock_guard
+ */
+class InstrumentedMutex {
+private:
+    std::mutex m_mutex;
+    std::chrono::steady_clock::time_point m_acquired;
+    LockSite m_site { LockSite::other };
+public:
+    void lock(LockSite site);
+    void lock() { lock(LockSite::other); }
+    void unlock();
+};
+
+using SensorMutex = InstrumentedMutex;
+
+#else
+
+// instrumentation off: a plain std::mutex, the site is dropped at compile time
+using SensorMutex = std::mutex;
+
+#endif
+
+/**
+ *  Scoped lock on sensor_mutex that names the call site
+ *  The time spent waiting shows up as "sensor_mutex wait" in the thread trace
+ */
+class SensorLock {
+private:
+    SensorMutex& m_mutex;
+public:
+    SensorLock(SensorMutex& mutex, [[maybe_unused]] LockSite site) : m_mutex { mutex } {
+        TraceScope wait("sensor_mutex wait");
+#ifdef WEATHER_SENSORS_LOCK_STATS
+        m_mutex.lock(site);
+#else
+        m_mutex.lock();
+#endif
+    }
+    ~SensorLock() { m_mutex.unlock(); }
+    SensorLock(const SensorLock&) = delete;
+    SensorLock& operator=(const SensorLock&) = delete;
+};
+
+// true when built with WEATHER_SENSORS_LOCK_STATS
+bool lock_stats_enabled();
+
+// prints count, mean, p50, p99 and max of wait and hold time per site, nothing when disabled
+void print_lock_statistics(std::ostream& out);
+
+#endif
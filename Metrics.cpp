@@ -0,0 +1,142 @@
+#include "Metrics.h"
+
+const char* metric_timer_name(MetricTimer timer) {
+    switch (timer) {
+        case MetricTimer::statistics_pass: return "statistics_pass";
+        case MetricTimer::display_frame:   return "display_frame";
+        case MetricTimer::save:            return "save";
+        case MetricTimer::count:           break;
+    }
+    return "unknown";
+}
+
+void Metrics::set_backlog(SensorId id, std::size_t backlog) {
+    m_sensor[static_cast<std::size_t>(id)].backlog.store(backlog, std::memory_order_relaxed);
+}
+
+void Metrics::set_history(SensorId id, std::size_t readings, std::size_t bytes) {
+    SensorCounters& counters { m_sensor[static_cast<std::size_t>(id)] };
+    counters.history_readings.store(readings, std::memory_order_relaxed);
+    counters.history_bytes.store(bytes, std::memory_order_relaxed);
+}
+
+void Metrics::set_compression(SensorId id, std::uint64_t input, std::uint64_t kept) {
+    SensorCounters& counters { m_sensor[static_cast<std::size_t>(id)] };
+    counters.compression_input.store(input, std::memory_order_relaxed);
+    counters.compression_kept.store(kept, std::memory_order_relaxed);
+}
+
+void Metrics::record_duration(MetricTimer timer, std::chrono::steady_clock::duration duration) {
+    TimerCounters& counters { m_timer[static_cast<std::size_t>(timer)] };
+    const auto ns { static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count()) };
+    counters.count.fetch_add(1, std::memory_order_relaxed);
+    counters.total_ns.fetch_add(ns, std::memory_order_relaxed);
+    counters.last_ns.store(ns, std::memory_order_relaxed);
+    std::uint64_t previous { counters.max_ns.load(std::memory_order_relaxed) };
+    while (ns > previous && !counters.max_ns.compare_exchange_weak(previous, ns, std::memory_order_relaxed)) {}
+}
+
+void Metrics::update_rates() {
+    const auto now { std::chrono::steady_clock::now() };
+    const double seconds { std::chrono::duration<double>(now - m_rate_time).count() };
+    m_rate_time = now;
+    for (SensorCounters& counters : m_sensor) {
+        const std::uint64_t total { counters.readings_total.load(std::memory_order_relaxed) };
+        if (seconds > 0) {
+            counters.readings_per_second.store(static_cast<double>(total - counters.rate_base) / seconds,
+                                               std::memory_order_relaxed);
+        }
+        counters.rate_base = total;
+    }
+    const HeapCounters heap { heap_counters() };
+    if (seconds > 0) {
+        m_heap_allocations_per_second.store(static_cast<double>(heap.allocations - m_heap_base.allocations) / seconds,
+                                            std::memory_order_relaxed);
+        m_heap_bytes_per_second.store(static_cast<double>(heap.bytes - m_heap_base.bytes) / seconds,
+                                      std::memory_order_relaxed);
+    }
+    m_heap_base = heap;
+}
+
+MetricsSnapshot Metrics::snapshot() const {
+    MetricsSnapshot snapshot;
+    snapshot.uptime_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+    snapshot.heap_allocations_total = heap_counters().allocations;
+    snapshot.heap_allocations_per_second = m_heap_allocations_per_second.load(std::memory_order_relaxed);
+    snapshot.heap_bytes_per_second = m_heap_bytes_per_second.load(std::memory_order_relaxed);
+    snapshot.export_scratch_bytes = m_export_scratch_bytes.load(std::memory_order_relaxed);
+    for (std::size_t i = 0; i < sensor_count; i++) {
+        const SensorCounters& counters { m_sensor[i] };
+        snapshot.sensor[i] = { counters.readings_total.load(std::memory_order_relaxed),
+                               counters.readings_per_second.load(std::memory_order_relaxed),
+                               counters.backlog.load(std::memory_order_relaxed),
+                               counters.history_readings.load(std::memory_order_relaxed),
+                               counters.history_bytes.load(std::memory_order_relaxed),
+                               counters.compression_input.load(std::memory_order_relaxed),
+                               counters.compression_kept.load(std::memory_order_relaxed) };
+        SensorMetricsSnapshot& sensor { snapshot.sensor[i] };
+        sensor.compression_ratio = sensor.compression_kept > 0
+            ? static_cast<double>(sensor.compression_input) / static_cast<double>(sensor.compression_kept) : 1.0;
+    }
+    for (std::size_t i = 0; i < static_cast<std::size_t>(MetricTimer::count); i++) {
+        const TimerCounters& counters { m_timer[i] };
+        DurationSummary& summary { snapshot.timer[i] };
+        summary.count = counters.count.load(std::memory_order_relaxed);
+        summary.last_ns = counters.last_ns.load(std::memory_order_relaxed);
+        summary.max_ns = counters.max_ns.load(std::memory_order_relaxed);
+        summary.total_ns = counters.total_ns.load(std::memory_order_relaxed);
+        summary.mean_ns = summary.count > 0 ? summary.total_ns / summary.count : 0;
+    }
+    return snapshot;
+}
+
+void print_metrics(const MetricsSnapshot& snapshot, std::ostream& out) {
+    out << "\nSelf Metrics (uptime " << snapshot.uptime_seconds << " s)\n";
+    for (std::size_t i = 0; i < sensor_count; i++) {
+        const SensorMetricsSnapshot& sensor { snapshot.sensor[i] };
+        out << sensor_name(all_sensors[i]) << ": "
+            << sensor.readings_total << " readings, "
+            << sensor.readings_per_second << " readings/s, "
+            << "backlog " << sensor.backlog << ", "
+            << "history " << sensor.history_readings << " readings in " << sensor.history_bytes << " bytes, "
+            << "compression " << sensor.compression_ratio << "x\n";
+    }
+    for (std::size_t i = 0; i < static_cast<std::size_t>(MetricTimer::count); i++) {
+        const DurationSummary& timer { snapshot.timer[i] };
+        out << metric_timer_name(static_cast<MetricTimer>(i)) << ": "
+            << timer.count << " times, last " << timer.last_ns / 1000 << " us, "
+            << "mean " << timer.mean_ns / 1000 << " us, max " << timer.max_ns / 1000 << " us\n";
+    }
+    out << "heap: " << snapshot.heap_allocations_total << " allocations, "
+        << snapshot.heap_allocations_per_second << " allocations/s, "
+        << snapshot.heap_bytes_per_second << " bytes/s, "
+        << "last save used " << snapshot.export_scratch_bytes << " bytes of scratch\n";
+}
+
+nlohmann::ordered_json metrics_to_json(const MetricsSnapshot& snapshot) {
+    nlohmann::ordered_json result;
+    result["uptime_seconds"] = snapshot.uptime_seconds;
+    result["heap"] = { { "allocations_total", snapshot.heap_allocations_total },
+                       { "allocations_per_second", snapshot.heap_allocations_per_second },
+                       { "bytes_per_second", snapshot.heap_bytes_per_second },
+                       { "export_scratch_bytes", snapshot.export_scratch_bytes } };
+    for (std::size_t i = 0; i < sensor_count; i++) {
+        const SensorMetricsSnapshot& sensor { snapshot.sensor[i] };
+        result["sensors"][sensor_name(all_sensors[i])] = {
+            { "readings_total", sensor.readings_total },
+            { "readings_per_second", sensor.readings_per_second },
+            { "backlog", sensor.backlog },
+            { "history_readings", sensor.history_readings },
+            { "history_bytes", sensor.history_bytes },
+            { "compression_input", sensor.compression_input },
+            { "compression_kept", sensor.compression_kept },
+            { "compression_ratio", sensor.compression_ratio } };
+    }
+    for (std::size_t i = 0; i < static_cast<std::size_t>(MetricTimer::count); i++) {
+        const DurationSummary& timer { snapshot.timer[i] };
+        result["timers"][metric_timer_name(static_cast<MetricTimer>(i))] = {
+            { "count", timer.count }, { "last_ns", timer.last_ns },
+            { "mean_ns", timer.mean_ns }, { "max_ns", timer.max_ns } };
+    }
+    return result;
+}
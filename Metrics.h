@@ -0,0 +1,124 @@
+#ifndef WEATHER_SENSORS_METRICS_H
+#define WEATHER_SENSORS_METRICS_H
+#include "structs.h"
+#include "Allocation.h"
+#include "nlohmann/json.hpp"
+#include <ostream>
+
+// timed activities of the thread loops
+enum class MetricTimer : std::uint8_t {
+    statistics_pass,
+    display_frame,
+    save,
+    count
+};
+
+const char* metric_timer_name(MetricTimer timer);
+
+struct DurationSummary {
+    std::uint64_t count{};
+    std::uint64_t last_ns{};
+    std::uint64_t max_ns{};
+    std::uint64_t mean_ns{};
+    std::uint64_t total_ns{};
+};
+
+struct SensorMetricsSnapshot {
+    std::uint64_t readings_total{};     // readings stored since start
+    double readings_per_second{};       // over the last statistics pass
+    std::uint64_t backlog{};            // readings waiting in m_new_readings
+    std::uint64_t history_readings{};   // readings in m_readings
+    std::uint64_t history_bytes{};      // memory reserved for m_readings
+    std::uint64_t compression_input{};  // readings given to the compression filter
+    std::uint64_t compression_kept{};   // readings it kept in history
+    double compression_ratio{};         // input / kept, 1 without a filter
+};
+
+struct MetricsSnapshot {
+    double uptime_seconds{};
+    std::uint64_t heap_allocations_total{};     // operator new calls of the whole process
+    double heap_allocations_per_second{};       // over the last statistics pass
+    double heap_bytes_per_second{};
+    std::uint64_t export_scratch_bytes{};       // arena used by the last save
+    SensorMetricsSnapshot sensor[sensor_count];
+    DurationSummary timer[static_cast<std::size_t>(MetricTimer::count)];
+};
+
+/**
+ *  Internal counters of SensorData and the thread loops
+ *  Every counter is a relaxed atomic, so recording never takes a lock
+ *  and snapshot() can be called from any thread at any time
+ */
+class Metrics {
+private:
+    // each sensor on its own cache lines, what producers write on every reading apart from what
+    // the statistics thread writes, so neither invalidates the other's line or another sensor's
+    struct alignas(cache_line_size) SensorCounters {
+        std::atomic<std::uint64_t> readings_total{};
+        std::atomic<std::uint64_t> backlog{};
+        alignas(cache_line_size) std::atomic<double> readings_per_second{};
+        std::atomic<std::uint64_t> history_readings{};
+        std::atomic<std::uint64_t> history_bytes{};
+        std::atomic<std::uint64_t> compression_input{};
+        std::atomic<std::uint64_t> compression_kept{};
+        std::uint64_t rate_base{};      // readings_total at the last update_rates(), statistics thread only
+    };
+    struct alignas(cache_line_size) TimerCounters {
+        std::atomic<std::uint64_t> count{};
+        std::atomic<std::uint64_t> total_ns{};
+        std::atomic<std::uint64_t> last_ns{};
+        std::atomic<std::uint64_t> max_ns{};
+    };
+
+    const std::chrono::steady_clock::time_point m_start { std::chrono::steady_clock::now() };
+    std::chrono::steady_clock::time_point m_rate_time { m_start };
+    HeapCounters m_heap_base { heap_counters() };   // at the last update_rates(), statistics thread only
+    std::atomic<double> m_heap_allocations_per_second{};
+    std::atomic<double> m_heap_bytes_per_second{};
+    std::atomic<std::uint64_t> m_export_scratch_bytes{};
+    SensorCounters m_sensor[sensor_count];
+    TimerCounters m_timer[static_cast<std::size_t>(MetricTimer::count)];
+public:
+    void record_reading(SensorId id, std::size_t backlog) {
+        SensorCounters& counters { m_sensor[static_cast<std::size_t>(id)] };
+        counters.readings_total.fetch_add(1, std::memory_order_relaxed);
+        counters.backlog.store(backlog, std::memory_order_relaxed);
+    }
+    void record_readings(SensorId id, std::size_t count, std::size_t backlog) {
+        SensorCounters& counters { m_sensor[static_cast<std::size_t>(id)] };
+        counters.readings_total.fetch_add(count, std::memory_order_relaxed);
+        counters.backlog.store(backlog, std::memory_order_relaxed);
+    }
+    void set_backlog(SensorId id, std::size_t backlog);
+    void set_history(SensorId id, std::size_t readings, std::size_t bytes);
+    void set_compression(SensorId id, std::uint64_t input, std::uint64_t kept);
+    void record_duration(MetricTimer timer, std::chrono::steady_clock::duration duration);
+    void set_export_scratch(std::uint64_t bytes) { m_export_scratch_bytes.store(bytes, std::memory_order_relaxed); }
+    // readings per second since the previous call, called once per statistics pass
+    void update_rates();
+    MetricsSnapshot snapshot() const;
+    // one counter without a whole snapshot
+    double readings_per_second(SensorId id) const {
+        return m_sensor[static_cast<std::size_t>(id)].readings_per_second.load(std::memory_order_relaxed);
+    }
+};
+
+/**
+ *  Adds the lifetime of the object to a timer
+ */
+class MetricScope {
+private:
+    Metrics& m_metrics;
+    MetricTimer m_timer;
+    std::chrono::steady_clock::time_point m_start { std::chrono::steady_clock::now() };
+public:
+    MetricScope(Metrics& metrics, MetricTimer timer) : m_metrics { metrics }, m_timer { timer } {}
+    ~MetricScope() { m_metrics.record_duration(m_timer, std::chrono::steady_clock::now() - m_start); }
+    MetricScope(const MetricScope&) = delete;
+    MetricScope& operator=(const MetricScope&) = delete;
+};
+
+void print_metrics(const MetricsSnapshot& snapshot, std::ostream& out);
+nlohmann::ordered_json metrics_to_json(const MetricsSnapshot& snapshot);
+
+#endif
@@ -0,0 +1,358 @@
+#include "MetricsServer.h"
+#include "SensorData.h"
+#include "Trace.h"
+#include <iostream>
+#include <charconv>
+#include <unordered_map>
+#include <algorithm>
+#include <cstring>
+#include <cctype>
+#include <cerrno>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+namespace {
+    constexpr std::size_t max_request_size { 8192 };
+
+    void append_number(std::string& out, double value) {
+        char buffer[32];
+        const auto result { std::to_chars(buffer, buffer + sizeof(buffer), value) };
+        out.append(buffer, result.ptr);
+    }
+
+    void append_number(std::string& out, std::uint64_t value) {
+        char buffer[24];
+        const auto result { std::to_chars(buffer, buffer + sizeof(buffer), value) };
+        out.append(buffer, result.ptr);
+    }
+
+    void append_family(std::string& out, const char* name, const char* type, const char* help) {
+        out += "# TYPE "; out += name; out += ' '; out += type; out += '\n';
+        out += "# HELP "; out += name; out += ' '; out += help; out += '\n';
+    }
+
+    // name{label="value"} number
+    template <typename Number>
+    void append_sample(std::string& out, const char* name, const char* label, const char* value, Number number) {
+        out += name; out += '{'; out += label; out += "=\""; out += value; out += "\"} ";
+        append_number(out, number);
+        out += '\n';
+    }
+
+    std::shared_ptr<const std::string> make_response(const char* status, const char* content_type, const std::string& body) {
+        std::string response { "HTTP/1.1 " };
+        response += status;
+        response += "\r\nContent-Type: ";
+        response += content_type;
+        response += "\r\nContent-Length: ";
+        append_number(response, static_cast<std::uint64_t>(body.size()));
+        response += "\r\n\r\n";
+        response += body;
+        return std::make_shared<const std::string>(std::move(response));
+    }
+
+    const std::shared_ptr<const std::string> not_found {
+        make_response("404 Not Found", "text/plain; charset=utf-8", "Only GET /metrics is served\n") };
+
+    struct Connection {
+        std::string request;
+        std::shared_ptr<const std::string> response;    // being written, the buffer stays alive across publish()
+        std::size_t sent{};
+        bool close_after{};
+    };
+}
+
+std::string render_openmetrics(const SensorData& data) {
+    std::string out;
+    out.reserve(4096);
+    const MetricsSnapshot metrics { data.metrics().snapshot() };
+
+    append_family(out, "weather_reading", "gauge", "Latest committed reading of the sensor.");
+    for (SensorId id : all_sensors) {
+        const SensorSeries& readings { data.committed_readings(id) };
+        if (readings.empty()) continue;
+        const TimeDouble newest { readings.back() };
+        // sample timestamp in seconds, so the scraper stores when the value was measured
+        out += "weather_reading{sensor=\""; out += sensor_label(id); out += "\"} ";
+        append_number(out, newest.value);
+        out += ' ';
+        append_number(out, static_cast<double>(to_epoch_ns(newest.time_point)) / 1e9);
+        out += '\n';
+    }
+
+    append_family(out, "weather_statistic", "gauge", "Maximum, minimum and average of every reading so far.");
+    for (SensorId id : all_sensors) {
+        const Stats& stat { data.statistic(id) };
+        if (stat.count == 0) continue;
+        const std::pair<const char*, double> values[] {
+            { "max", stat.max.value }, { "min", stat.min.value }, { "average", stat.average } };
+        for (const auto& [name, value] : values) {
+            out += "weather_statistic{sensor=\""; out += sensor_label(id); out += "\",stat=\""; out += name; out += "\"} ";
+            append_number(out, value);
+            out += '\n';
+        }
+    }
+
+    append_family(out, "weather_statistic_readings", "counter", "Readings included in the statistics.");
+    for (SensorId id : all_sensors) {
+        append_sample(out, "weather_statistic_readings_total", "sensor", sensor_label(id),
+                      static_cast<std::uint64_t>(data.statistic(id).count));
+    }
+
+    append_family(out, "weather_readings", "counter", "Readings stored since the program started.");
+    for (std::size_t i = 0; i < sensor_count; i++) {
+        append_sample(out, "weather_readings_total", "sensor", sensor_label(all_sensors[i]), metrics.sensor[i].readings_total);
+    }
+    append_family(out, "weather_readings_per_second", "gauge", "Ingest rate over the last statistics pass.");
+    for (std::size_t i = 0; i < sensor_count; i++) {
+        append_sample(out, "weather_readings_per_second", "sensor", sensor_label(all_sensors[i]),
+                      metrics.sensor[i].readings_per_second);
+    }
+    append_family(out, "weather_backlog_readings", "gauge", "Readings waiting for the statistics thread.");
+    for (std::size_t i = 0; i < sensor_count; i++) {
+        append_sample(out, "weather_backlog_readings", "sensor", sensor_label(all_sensors[i]), metrics.sensor[i].backlog);
+    }
+    append_family(out, "weather_history_readings", "gauge", "Readings kept in history.");
+    for (std::size_t i = 0; i < sensor_count; i++) {
+        append_sample(out, "weather_history_readings", "sensor", sensor_label(all_sensors[i]),
+                      metrics.sensor[i].history_readings);
+    }
+    append_family(out, "weather_history_bytes", "gauge", "Memory reserved for the history.");
+    for (std::size_t i = 0; i < sensor_count; i++) {
+        append_sample(out, "weather_history_bytes", "sensor", sensor_label(all_sensors[i]), metrics.sensor[i].history_bytes);
+    }
+    append_family(out, "weather_compression_ratio", "gauge", "Readings given to the compression filter per reading kept.");
+    for (std::size_t i = 0; i < sensor_count; i++) {
+        append_sample(out, "weather_compression_ratio", "sensor", sensor_label(all_sensors[i]),
+                      metrics.sensor[i].compression_ratio);
+    }
+
+    append_family(out, "weather_loop_duration_seconds", "summary", "Duration of statistics passes, display frames and saves.");
+    for (std::size_t i = 0; i < static_cast<std::size_t>(MetricTimer::count); i++) {
+        const char* loop { metric_timer_name(static_cast<MetricTimer>(i)) };
+        append_sample(out, "weather_loop_duration_seconds_count", "loop", loop, metrics.timer[i].count);
+        append_sample(out, "weather_loop_duration_seconds_sum", "loop", loop,
+                      static_cast<double>(metrics.timer[i].total_ns) / 1e9);
+    }
+    append_family(out, "weather_loop_duration_max_seconds", "gauge", "Longest statistics pass, display frame and save.");
+    for (std::size_t i = 0; i < static_cast<std::size_t>(MetricTimer::count); i++) {
+        append_sample(out, "weather_loop_duration_max_seconds", "loop", metric_timer_name(static_cast<MetricTimer>(i)),
+                      static_cast<double>(metrics.timer[i].max_ns) / 1e9);
+    }
+
+    append_family(out, "weather_heap_allocations", "counter", "Heap allocations of the process.");
+    out += "weather_heap_allocations_total ";
+    append_number(out, metrics.heap_allocations_total);
+    out += '\n';
+    append_family(out, "weather_export_scratch_bytes", "gauge", "Arena bytes used by the last save.");
+    out += "weather_export_scratch_bytes ";
+    append_number(out, metrics.export_scratch_bytes);
+    out += '\n';
+
+    append_family(out, "weather_uptime_seconds", "gauge", "Seconds since the program started.");
+    out += "weather_uptime_seconds ";
+    append_number(out, metrics.uptime_seconds);
+    out += "\n# EOF\n";
+    return out;
+}
+
+MetricsServer::MetricsServer()
+    : m_response { make_response("503 Service Unavailable", "text/plain; charset=utf-8", "No metrics published yet\n") } {}
+
+MetricsServer::~MetricsServer() {
+    stop();
+}
+
+void MetricsServer::publish(const std::string& body) {
+    m_response.store(make_response("200 OK", "application/openmetrics-text; version=1.0.0; charset=utf-8", body),
+                     std::memory_order_release);
+}
+
+bool MetricsServer::start(const MetricsServerOptions& options) {
+    if (running()) return true;
+    const std::string& address { options.address };
+    if (address.rfind("unix:", 0) == 0) {
+        sockaddr_un local {};
+        local.sun_family = AF_UNIX;
+        m_unix_path = address.substr(5);
+        if (m_unix_path.empty() || m_unix_path.size() >= sizeof(local.sun_path)) {
+            std::cerr << "Invalid Unix socket path in " << address << "\n";
+            return false;
+        }
+        std::memcpy(local.sun_path, m_unix_path.c_str(), m_unix_path.size() + 1);
+        ::unlink(m_unix_path.c_str());      // left behind by an earlier run
+        m_listen_fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (m_listen_fd < 0 || ::bind(m_listen_fd, reinterpret_cast<sockaddr*>(&local), sizeof(local)) < 0) {
+            std::cerr << "Could not bind " << address << ": " << std::strerror(errno) << "\n";
+            m_unix_path.clear();
+            close_fds();
+            return false;
+        }
+    } else {
+        // only the loopback interface, the endpoint has no authentication
+        const std::size_t colon { address.rfind(':') };
+        const std::string host { colon == std::string::npos ? "" : address.substr(0, colon) };
+        const std::string port { colon == std::string::npos ? address : address.substr(colon + 1) };
+        if (!host.empty() && host != "127.0.0.1" && host != "localhost") {
+            std::cerr << "The metrics endpoint only binds to localhost, not " << host << "\n";
+            return false;
+        }
+        int port_number{};
+        const auto parsed { std::from_chars(port.data(), port.data() + port.size(), port_number) };
+        if (parsed.ec != std::errc {} || parsed.ptr != port.data() + port.size() || port_number < 0 || port_number > 65535) {
+            std::cerr << "Invalid port in " << address << "\n";
+            return false;
+        }
+        sockaddr_in local {};
+        local.sin_family = AF_INET;
+        local.sin_port = htons(static_cast<std::uint16_t>(port_number));
+        local.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        m_listen_fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        const int reuse { 1 };
+        if (m_listen_fd >= 0) ::setsockopt(m_listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        if (m_listen_fd < 0 || ::bind(m_listen_fd, reinterpret_cast<sockaddr*>(&local), sizeof(local)) < 0) {
+            std::cerr << "Could not bind " << address << ": " << std::strerror(errno) << "\n";
+            close_fds();
+            return false;
+        }
+    }
+
+    m_epoll_fd = ::epoll_create1(EPOLL_CLOEXEC);
+    m_stop_fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (::listen(m_listen_fd, SOMAXCONN) < 0 || m_epoll_fd < 0 || m_stop_fd < 0) {
+        std::cerr << "Could not listen on " << address << ": " << std::strerror(errno) << "\n";
+        close_fds();
+        return false;
+    }
+    epoll_event event {};
+    event.events = EPOLLIN;
+    event.data.fd = m_listen_fd;
+    ::epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, m_listen_fd, &event);
+    event.data.fd = m_stop_fd;
+    ::epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, m_stop_fd, &event);
+
+    m_thread = std::thread(&MetricsServer::run, this);
+    return true;
+}
+
+void MetricsServer::stop() {
+    if (!running()) return;
+    const std::uint64_t one { 1 };
+    [[maybe_unused]] const ssize_t written { ::write(m_stop_fd, &one, sizeof(one)) };
+    m_thread.join();
+    close_fds();
+}
+
+void MetricsServer::close_fds() {
+    if (m_listen_fd >= 0) ::close(m_listen_fd);
+    if (m_epoll_fd >= 0) ::close(m_epoll_fd);
+    if (m_stop_fd >= 0) ::close(m_stop_fd);
+    m_listen_fd = m_epoll_fd = m_stop_fd = -1;
+    if (!m_unix_path.empty()) ::unlink(m_unix_path.c_str());
+    m_unix_path.clear();
+}
+
+void MetricsServer::run() {
+    trace_set_thread_name("metrics_http");
+    std::unordered_map<int, Connection> connections;
+
+    auto close_connection = [&](int fd) {
+        ::close(fd);        // also removes it from the epoll set
+        connections.erase(fd);
+    };
+
+    // answers every complete request in the buffer, returns false when the connection should be closed
+    auto serve = [&](int fd, Connection& connection) {
+        for (;;) {
+            if (connection.response) {
+                const std::string& response { *connection.response };
+                while (connection.sent < response.size()) {
+                    const ssize_t sent { ::send(fd, response.data() + connection.sent, response.size() - connection.sent,
+                                                MSG_NOSIGNAL) };
+                    if (sent < 0 && errno == EINTR) continue;
+                    if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                        epoll_event event {};
+                        event.events = EPOLLIN | EPOLLOUT;
+                        event.data.fd = fd;
+                        ::epoll_ctl(m_epoll_fd, EPOLL_CTL_MOD, fd, &event);
+                        return true;
+                    }
+                    if (sent <= 0) return false;
+                    connection.sent += static_cast<std::size_t>(sent);
+                }
+                connection.response.reset();
+                connection.sent = 0;
+                if (connection.close_after) return false;
+                epoll_event event {};
+                event.events = EPOLLIN;
+                event.data.fd = fd;
+                ::epoll_ctl(m_epoll_fd, EPOLL_CTL_MOD, fd, &event);
+            }
+
+            const std::size_t end { connection.request.find("\r\n\r\n") };
+            if (end == std::string::npos) return connection.request.size() < max_request_size;
+            std::string head { connection.request.substr(0, end) };
+            connection.request.erase(0, end + 4);
+            std::transform(head.begin(), head.end(), head.begin(), [](unsigned char c) { return std::tolower(c); });
+            const bool is_metrics { head.rfind("get /metrics ", 0) == 0 || head.rfind("get /metrics?", 0) == 0 };
+            const bool http10 { head.find(" http/1.0") != std::string::npos };
+            connection.close_after = head.find("connection: close") != std::string::npos
+                                  || (http10 && head.find("connection: keep-alive") == std::string::npos);
+            if (is_metrics) {
+                m_scrapes.fetch_add(1, std::memory_order_relaxed);
+                connection.response = m_response.load(std::memory_order_acquire);
+            } else {
+                connection.response = not_found;
+            }
+        }
+    };
+
+    epoll_event events[64];
+    for (;;) {
+        const int ready { ::epoll_wait(m_epoll_fd, events, 64, -1) };
+        if (ready < 0 && errno == EINTR) continue;
+        if (ready < 0) break;
+        for (int i = 0; i < ready; i++) {
+            const int fd { events[i].data.fd };
+            if (fd == m_stop_fd) {
+                for (auto& [client, connection] : connections) ::close(client);
+                return;
+            }
+            if (fd == m_listen_fd) {
+                for (;;) {
+                    const int client { ::accept4(m_listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC) };
+                    if (client < 0) break;
+                    epoll_event event {};
+                    event.events = EPOLLIN;
+                    event.data.fd = client;
+                    ::epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, client, &event);
+                    connections[client];
+                }
+                continue;
+            }
+            auto found { connections.find(fd) };
+            if (found == connections.end()) continue;
+            Connection& connection { found->second };
+            bool keep { true };
+            if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                char buffer[4096];
+                for (;;) {
+                    const ssize_t received { ::recv(fd, buffer, sizeof(buffer), 0) };
+                    if (received > 0) { connection.request.append(buffer, static_cast<std::size_t>(received)); continue; }
+                    if (received < 0 && errno == EINTR) continue;
+                    if (received == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) keep = false;
+                    break;
+                }
+            }
+            // a response in progress is still finished when the client already half closed
+            if (keep || connection.response || !connection.request.empty()) keep = serve(fd, connection) && keep;
+            if (!keep) close_connection(fd);
+        }
+    }
+}
@@ -0,0 +1,57 @@
+#ifndef WEATHER_SENSORS_METRICSSERVER_H
+#define WEATHER_SENSORS_METRICSSERVER_H
+#include <string>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <cstdint>
+
+class SensorData;
+
+struct MetricsServerOptions {
+    // "9100" or "127.0.0.1:9100" for TCP (always bound to localhost), "unix:/path/to/socket" for a Unix socket
+    std::string address;
+};
+
+/**
+ *  Latest readings, Stats and self metrics in OpenMetrics text format (ends with "# EOF")
+ *  Reads committed_readings() and statistic() without the lock,
+ *  so call it from the statistics thread or before the threads start
+ */
+std::string render_openmetrics(const SensorData& data);
+
+/**
+ *  Minimal HTTP/1.1 server for GET /metrics, one epoll thread, keep-alive connections
+ *  publish() swaps in a complete pre-rendered response through an atomic shared_ptr,
+ *  a scrape only loads that pointer and writes the bytes, so it never takes sensor_mutex
+ *  and never renders anything
+ */
+class MetricsServer {
+private:
+    std::atomic<std::shared_ptr<const std::string>> m_response;
+    std::atomic<std::uint64_t> m_scrapes{};
+    std::thread m_thread;
+    std::string m_unix_path;
+    int m_listen_fd { -1 };
+    int m_epoll_fd { -1 };
+    int m_stop_fd { -1 };
+
+    void run();
+    void close_fds();
+public:
+    MetricsServer();
+    MetricsServer(const MetricsServer&) = delete;
+    MetricsServer& operator=(const MetricsServer&) = delete;
+    ~MetricsServer();
+
+    // binds and starts the server thread, false (with a message on std::cerr) if the address can not be used
+    bool start(const MetricsServerOptions& options);
+    void stop();
+    bool running() const { return m_thread.joinable(); }
+
+    // body in OpenMetrics text format, served to every scrape until the next publish()
+    void publish(const std::string& body);
+    std::uint64_t scrapes() const { return m_scrapes.load(std::memory_order_relaxed); }
+};
+
+#endif
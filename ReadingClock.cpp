@@ -0,0 +1,105 @@
+#include "ReadingClock.h"
+
+thread_local std::int64_t ReadingClock::t_batch_ns {};
+
+namespace {
+    std::int64_t realtime_ns() {
+        timespec now;
+        ::clock_gettime(CLOCK_REALTIME, &now);
+        return std::int64_t { now.tv_sec } * 1'000'000'000 + now.tv_nsec;
+    }
+
+#ifdef WEATHER_SENSORS_HAS_TSC
+    // TSC and realtime read as close together as possible: the pair with the shortest TSC window wins
+    std::pair<std::uint64_t, std::int64_t> tsc_realtime_pair() {
+        std::pair<std::uint64_t, std::int64_t> best {};
+        std::uint64_t best_window { ~std::uint64_t {} };
+        for (int i = 0; i < 8; i++) {
+            const std::uint64_t before { __rdtsc() };
+            const std::int64_t ns { realtime_ns() };
+            const std::uint64_t after { __rdtsc() };
+            if (after - before < best_window) {
+                best_window = after - before;
+                best = { before + (after - before) / 2, ns };
+            }
+        }
+        return best;
+    }
+#endif
+}
+
+std::int64_t ReadingClock::tsc_ns() const {
+#ifdef WEATHER_SENSORS_HAS_TSC
+    for (;;) {
+        const std::uint64_t before { m_sequence.load(std::memory_order_acquire) };
+        const std::uint64_t tsc_base { m_tsc_base.load(std::memory_order_relaxed) };
+        const std::int64_t ns_base { m_ns_base.load(std::memory_order_relaxed) };
+        const double ns_per_tick { m_ns_per_tick.load(std::memory_order_relaxed) };
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if ((before & 1) == 0 && m_sequence.load(std::memory_order_relaxed) == before) {
+            const auto ticks { static_cast<std::int64_t>(__rdtsc() - tsc_base) };
+            return ns_base + static_cast<std::int64_t>(static_cast<double>(ticks) * ns_per_tick);
+        }
+    }
+#else
+    return realtime_ns();
+#endif
+}
+
+bool ReadingClock::set_source(ClockSource source) {
+#ifdef WEATHER_SENSORS_HAS_TSC
+    if (source == ClockSource::tsc) {
+        // first scale over 20 ms, every recalibrate() measures over a longer time
+        const auto [tsc_first, ns_first] { tsc_realtime_pair() };
+        ::timespec pause { 0, 20'000'000 };
+        ::nanosleep(&pause, nullptr);
+        const auto [tsc_now, ns_now] { tsc_realtime_pair() };
+        if (tsc_now <= tsc_first) return false;
+        m_tsc_first = tsc_first;
+        m_ns_first = ns_first;
+        m_tsc_base.store(tsc_now, std::memory_order_relaxed);
+        m_ns_base.store(ns_now, std::memory_order_relaxed);
+        m_ns_per_tick.store(static_cast<double>(ns_now - ns_first) / static_cast<double>(tsc_now - tsc_first),
+                            std::memory_order_relaxed);
+    }
+#else
+    if (source == ClockSource::tsc) return false;
+#endif
+    m_source = source;
+    return true;
+}
+
+void ReadingClock::recalibrate() {
+#ifdef WEATHER_SENSORS_HAS_TSC
+    if (m_source != ClockSource::tsc) return;
+    const auto [tsc_now, ns_now] { tsc_realtime_pair() };
+    if (tsc_now <= m_tsc_first) return;
+    const std::uint64_t sequence { m_sequence.load(std::memory_order_relaxed) };
+    m_sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    m_tsc_base.store(tsc_now, std::memory_order_relaxed);
+    m_ns_base.store(ns_now, std::memory_order_relaxed);
+    m_ns_per_tick.store(static_cast<double>(ns_now - m_ns_first) / static_cast<double>(tsc_now - m_tsc_first),
+                        std::memory_order_relaxed);
+    m_sequence.store(sequence + 2, std::memory_order_release);
+#endif
+}
+
+bool parse_clock_source(const std::string& text, ClockSource& source) {
+    if (text == "system") source = ClockSource::system;
+    else if (text == "coarse") source = ClockSource::coarse;
+    else if (text == "tsc") source = ClockSource::tsc;
+    else if (text == "batch") source = ClockSource::batch;
+    else return false;
+    return true;
+}
+
+const char* clock_source_name(ClockSource source) {
+    switch (source) {
+        case ClockSource::system: return "system";
+        case ClockSource::coarse: return "coarse";
+        case ClockSource::tsc:    return "tsc";
+        case ClockSource::batch:  return "batch";
+    }
+    return "unknown";
+}
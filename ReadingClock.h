@@ -0,0 +1,84 @@
+#ifndef WEATHER_SENSORS_READINGCLOCK_H
+#define WEATHER_SENSORS_READINGCLOCK_H
+#include "structs.h"
+#include <string>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define WEATHER_SENSORS_HAS_TSC 1
+#endif
+
+// where a reading's timestamp comes from
+enum class ClockSource : std::uint8_t {
+    system,             // std::chrono::system_clock::now(), a vDSO clock_gettime per reading
+    coarse,             // CLOCK_REALTIME_COARSE, resolution of a timer tick (1-4 ms)
+    tsc,                // time stamp counter scaled to the realtime clock, recalibrated every statistics pass
+    batch               // one coarse timestamp per ClockBatch scope, shared by every reading stored inside it
+};
+
+/**
+ *  Timestamp source of SensorData::store_new_reading(), chosen once per deployment (--clock)
+ *  now() is lock free and can be called from every producer thread; the TSC calibration is a
+ *  seqlock so recalibrate() can run concurrently with readers
+ */
+class ReadingClock {
+private:
+    ClockSource m_source { ClockSource::system };
+    // TSC calibration: time = ns_base + (tsc - tsc_base) * ns_per_tick
+    std::atomic<std::uint64_t> m_sequence{};
+    std::atomic<std::uint64_t> m_tsc_base{};
+    std::atomic<std::int64_t> m_ns_base{};
+    std::atomic<double> m_ns_per_tick{};
+    std::uint64_t m_tsc_first{};    // first calibration point, the scale is taken over the whole run
+    std::int64_t m_ns_first{};
+
+    static std::int64_t coarse_ns() {
+        timespec now;
+        ::clock_gettime(CLOCK_REALTIME_COARSE, &now);
+        return std::int64_t { now.tv_sec } * 1'000'000'000 + now.tv_nsec;
+    }
+    std::int64_t tsc_ns() const;
+    static thread_local std::int64_t t_batch_ns;    // 0 outside a ClockBatch
+    friend class ClockBatch;
+public:
+    // false if the source is not available here (tsc on other CPUs than x86)
+    bool set_source(ClockSource source);
+    ClockSource source() const { return m_source; }
+    // new TSC scale and base from the realtime clock, called once per statistics pass
+    void recalibrate();
+
+    std::chrono::system_clock::time_point now() const {
+        switch (m_source) {
+            case ClockSource::system: break;
+            case ClockSource::coarse: return from_ns(coarse_ns());
+            case ClockSource::tsc: return from_ns(tsc_ns());
+            case ClockSource::batch: return from_ns(t_batch_ns != 0 ? t_batch_ns : coarse_ns());
+        }
+        return std::chrono::system_clock::now();
+    }
+    static std::chrono::system_clock::time_point from_ns(std::int64_t ns) {
+        return std::chrono::system_clock::time_point { std::chrono::nanoseconds { ns } };
+    }
+};
+
+/**
+ *  Readings stored on this thread while the object lives share one timestamp when the source is batch,
+ *  with the other sources it does nothing
+ */
+class ClockBatch {
+private:
+    std::int64_t m_previous;
+public:
+    explicit ClockBatch(const ReadingClock& clock) : m_previous { ReadingClock::t_batch_ns } {
+        if (clock.source() == ClockSource::batch) ReadingClock::t_batch_ns = ReadingClock::coarse_ns();
+    }
+    ~ClockBatch() { ReadingClock::t_batch_ns = m_previous; }
+    ClockBatch(const ClockBatch&) = delete;
+    ClockBatch& operator=(const ClockBatch&) = delete;
+};
+
+// system, coarse, tsc or batch, false if the text is none of them
+bool parse_clock_source(const std::string& text, ClockSource& source);
+const char* clock_source_name(ClockSource source);
+
+#endif
@@ -0,0 +1,168 @@
+#include "ReadingsHub.h"
+#include "Trace.h"
+
+struct Subscription::State {
+    ReadingsCallback callback;
+    SubscriberOptions options;
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::deque<std::shared_ptr<const SensorReadings>> queue;
+    std::size_t queued_readings{};
+    bool stopping{};
+    ReadingsHub* hub{};                 // guarded by mutex, cleared when the hub goes away first
+    std::atomic<bool> connected { true };
+    std::atomic<std::uint64_t> delivered{};
+    std::atomic<std::uint64_t> dropped{};
+    std::thread thread;
+
+    void run() {
+        // only stores the name, a trace ring is allocated once this thread records while tracing is on
+        trace_set_thread_name("subscriber");
+        for (;;) {
+            std::shared_ptr<const SensorReadings> batch;
+            std::size_t count{};
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                condition.wait(lock, [this] { return stopping || !queue.empty(); });
+                if (stopping) return;
+                batch = std::move(queue.front());
+                queue.pop_front();
+                count = batch_readings(*batch);
+                queued_readings -= count;
+            }
+            TraceScope trace("deliver");
+            callback(*batch);
+            delivered.fetch_add(count, std::memory_order_relaxed);
+        }
+    }
+
+    // applies the slow subscriber policy when the batch does not fit
+    void push(const std::shared_ptr<const SensorReadings>& batch, std::size_t count) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (stopping) return;
+            // a batch larger than the whole queue is still taken when the queue is empty
+            while (!queue.empty() && queued_readings + count > options.queue_readings) {
+                if (options.policy == SlowSubscriberPolicy::disconnect) {
+                    dropped.fetch_add(queued_readings + count, std::memory_order_relaxed);
+                    queue.clear();
+                    queued_readings = 0;
+                    stopping = true;
+                    connected.store(false, std::memory_order_relaxed);
+                    condition.notify_one();
+                    return;
+                }
+                const std::size_t oldest { batch_readings(*queue.front()) };
+                dropped.fetch_add(oldest, std::memory_order_relaxed);
+                queued_readings -= oldest;
+                queue.pop_front();
+            }
+            queue.push_back(batch);
+            queued_readings += count;
+        }
+        condition.notify_one();
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+            connected.store(false, std::memory_order_relaxed);
+        }
+        condition.notify_one();
+        if (!thread.joinable()) return;
+        // unsubscribing from inside the callback, the thread returns once the callback does
+        if (thread.get_id() == std::this_thread::get_id()) thread.detach();
+        else thread.join();
+    }
+
+    static std::size_t batch_readings(const SensorReadings& batch) {
+        return batch.temperature.size() + batch.humidity.size() + batch.windspeed.size();
+    }
+};
+
+Subscription::Subscription(std::shared_ptr<State> state) : m_state { std::move(state) } {}
+
+Subscription::Subscription(Subscription&& other) noexcept : m_state { std::move(other.m_state) } {}
+
+Subscription& Subscription::operator=(Subscription&& other) noexcept {
+    if (this != &other) {
+        unsubscribe();
+        m_state = std::move(other.m_state);
+    }
+    return *this;
+}
+
+Subscription::~Subscription() {
+    unsubscribe();
+}
+
+void Subscription::unsubscribe() {
+    if (!m_state) return;
+    ReadingsHub* hub;
+    {
+        std::lock_guard<std::mutex> lock(m_state->mutex);
+        hub = m_state->hub;
+        m_state->hub = nullptr;
+    }
+    if (hub) hub->remove(m_state.get());
+    m_state->stop();
+    m_state.reset();
+}
+
+bool Subscription::connected() const {
+    return m_state && m_state->connected.load(std::memory_order_relaxed);
+}
+
+std::uint64_t Subscription::delivered() const {
+    return m_state ? m_state->delivered.load(std::memory_order_relaxed) : 0;
+}
+
+std::uint64_t Subscription::dropped() const {
+    return m_state ? m_state->dropped.load(std::memory_order_relaxed) : 0;
+}
+
+ReadingsHub::~ReadingsHub() {
+    // subscriptions that outlive the hub just stop receiving
+    std::lock_guard<std::mutex> guard(m_change_mutex);
+    for (const auto& state : *m_subscribers.load()) {
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            state->hub = nullptr;
+        }
+        state->stop();
+    }
+}
+
+Subscription ReadingsHub::subscribe(ReadingsCallback callback, SubscriberOptions options) {
+    auto state { std::make_shared<Subscription::State>() };
+    state->callback = std::move(callback);
+    state->options = options;
+    state->hub = this;
+    // the thread keeps the state alive, it may still be in the callback after a detach in stop()
+    state->thread = std::thread([state] { state->run(); });
+
+    std::lock_guard<std::mutex> guard(m_change_mutex);
+    auto subscribers { std::make_shared<SubscriberList>(*m_subscribers.load()) };
+    subscribers->push_back(state);
+    m_subscribers.store(std::move(subscribers));
+    m_active.store(true, std::memory_order_relaxed);
+    return Subscription { std::move(state) };
+}
+
+void ReadingsHub::remove(const Subscription::State* state) {
+    std::lock_guard<std::mutex> guard(m_change_mutex);
+    auto subscribers { std::make_shared<SubscriberList>(*m_subscribers.load()) };
+    std::erase_if(*subscribers, [state](const auto& subscriber) { return subscriber.get() == state; });
+    m_active.store(!subscribers->empty(), std::memory_order_relaxed);
+    m_subscribers.store(std::move(subscribers));
+}
+
+void ReadingsHub::publish(std::shared_ptr<const SensorReadings> batch) {
+    TraceScope trace("publish");
+    const std::size_t count { Subscription::State::batch_readings(*batch) };
+    const auto subscribers { m_subscribers.load() };
+    for (const auto& subscriber : *subscribers) {
+        if (subscriber->connected.load(std::memory_order_relaxed)) subscriber->push(batch, count);
+    }
+}
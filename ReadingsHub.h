@@ -0,0 +1,76 @@
+#ifndef WEATHER_SENSORS_READINGSHUB_H
+#define WEATHER_SENSORS_READINGSHUB_H
+#include "structs.h"
+#include <deque>
+#include <memory>
+#include <functional>
+#include <condition_variable>
+
+// what happens when a subscriber's queue is full
+enum class SlowSubscriberPolicy : std::uint8_t {
+    drop_oldest,    // the oldest queued batches are discarded to make room
+    disconnect      // the subscription is ended, its callback is not called again
+};
+
+struct SubscriberOptions {
+    std::size_t queue_readings { 1 << 16 };     // bound of the queue, counted in readings
+    SlowSubscriberPolicy policy { SlowSubscriberPolicy::drop_oldest };
+};
+
+// called on the subscriber's own thread with the readings of one stored batch
+using ReadingsCallback = std::function<void(const SensorReadings& readings)>;
+
+class ReadingsHub;
+
+/**
+ *  Handle of one subscriber, unsubscribes when destroyed
+ */
+class Subscription {
+private:
+    friend class ReadingsHub;
+    struct State;
+    std::shared_ptr<State> m_state;
+    explicit Subscription(std::shared_ptr<State> state);
+public:
+    Subscription() = default;
+    Subscription(Subscription&& other) noexcept;
+    Subscription& operator=(Subscription&& other) noexcept;
+    ~Subscription();
+
+    // stops delivery, waits for a callback in progress to return
+    void unsubscribe();
+    // false after unsubscribe() or when the disconnect policy ended it
+    bool connected() const;
+    std::uint64_t delivered() const;    // readings passed to the callback
+    std::uint64_t dropped() const;      // readings discarded because the queue was full
+};
+
+/**
+ *  Fans every stored batch out to the subscribers
+ *  publish() puts one shared copy of the batch into each subscriber's bounded queue and returns,
+ *  every subscriber has its own thread that drains its queue into its callback,
+ *  so a slow subscriber only fills its own queue and never slows ingest
+ *  The subscriber list is swapped as a whole through an atomic shared_ptr,
+ *  publish() does not lock anything shared by all subscribers
+ */
+class ReadingsHub {
+private:
+    using SubscriberList = std::vector<std::shared_ptr<Subscription::State>>;
+    std::atomic<std::shared_ptr<const SubscriberList>> m_subscribers { std::make_shared<const SubscriberList>() };
+    std::mutex m_change_mutex;      // serialises subscribe and unsubscribe
+    std::atomic<bool> m_active{};   // any subscribers, checked before building a batch
+
+    friend class Subscription;
+    void remove(const Subscription::State* state);
+public:
+    ReadingsHub() = default;
+    ReadingsHub(const ReadingsHub&) = delete;
+    ReadingsHub& operator=(const ReadingsHub&) = delete;
+    ~ReadingsHub();
+
+    Subscription subscribe(ReadingsCallback callback, SubscriberOptions options = {});
+    bool active() const { return m_active.load(std::memory_order_relaxed); }
+    void publish(std::shared_ptr<const SensorReadings> batch);
+};
+
+#endif
@@ -0,0 +1,128 @@
+#include "Rollup.h"
+#include "TimeFormat.h"
+#include <sstream>
+
+namespace {
+    // floor division, so readings before 1970 still get the right bucket
+    std::int64_t bucket_number(std::int64_t epoch_ns, std::int64_t resolution_ns) {
+        const std::int64_t quotient { epoch_ns / resolution_ns };
+        return (epoch_ns % resolution_ns < 0) ? quotient - 1 : quotient;
+    }
+}
+
+RollupTier::RollupTier(RollupTierOptions options)
+    : m_options { options },
+      m_resolution_ns { std::chrono::duration_cast<std::chrono::nanoseconds>(options.resolution).count() },
+      m_slots(std::max<std::size_t>(options.retention, 1)) {}
+
+void RollupTier::add(const TimeDouble& reading) {
+    const std::int64_t number { bucket_number(to_epoch_ns(reading.time_point), m_resolution_ns) };
+    const auto retention { static_cast<std::int64_t>(m_slots.size()) };
+    // too old for the ring
+    if (m_newest != empty && number <= m_newest - retention) return;
+    Slot& target { slot(number) };
+    if (target.number != number) {
+        target.number = number;
+        target.bucket = { from_epoch_ns(number * m_resolution_ns), 1, reading.value, reading.value, reading.value,
+                        reading.value, reading.time_point };
+    } else {
+        RollupBucket& bucket { target.bucket };
+        bucket.count++;
+        bucket.sum += reading.value;
+        bucket.min = std::min(bucket.min, reading.value);
+        bucket.max = std::max(bucket.max, reading.value);
+        if (reading.time_point >= bucket.last_time) {
+            bucket.last = reading.value;
+            bucket.last_time = reading.time_point;
+        }
+    }
+    m_newest = std::max(m_newest, number);
+}
+
+RollupTier::Slot& RollupTier::slot(std::int64_t number) {
+    const auto retention { static_cast<std::int64_t>(m_slots.size()) };
+    return m_slots[static_cast<std::size_t>((number % retention + retention) % retention)];
+}
+
+const RollupTier::Slot& RollupTier::slot(std::int64_t number) const {
+    const auto retention { static_cast<std::int64_t>(m_slots.size()) };
+    return m_slots[static_cast<std::size_t>((number % retention + retention) % retention)];
+}
+
+void RollupTier::clear() {
+    for (Slot& cleared : m_slots) cleared.number = empty;
+    m_newest = empty;
+}
+
+std::vector<RollupBucket> RollupTier::buckets(std::chrono::system_clock::time_point from,
+                                              std::chrono::system_clock::time_point to) const {
+    std::vector<RollupBucket> result;
+    if (m_newest == empty || to <= from) return result;
+    const auto retention { static_cast<std::int64_t>(m_slots.size()) };
+    const std::int64_t first { std::max(bucket_number(to_epoch_ns(from), m_resolution_ns), m_newest - retention + 1) };
+    // the bucket holding to - 1 ns is the last one that overlaps
+    const std::int64_t last { std::min(bucket_number(to_epoch_ns(to) - 1, m_resolution_ns), m_newest) };
+    if (last >= first) result.reserve(static_cast<std::size_t>(last - first + 1));
+    for (std::int64_t number = first; number <= last; number++) {
+        const Slot& held { slot(number) };
+        if (held.number == number) result.push_back(held.bucket);
+    }
+    return result;
+}
+
+std::chrono::system_clock::time_point RollupTier::retained_from() const {
+    if (m_newest == empty) return std::chrono::system_clock::time_point::max();
+    return from_epoch_ns((m_newest - static_cast<std::int64_t>(m_slots.size()) + 1) * m_resolution_ns);
+}
+
+RollupSeries::RollupSeries() : RollupSeries(default_rollup_tiers) {}
+
+RollupSeries::RollupSeries(const std::vector<RollupTierOptions>& tiers) {
+    m_tiers.reserve(tiers.size());
+    for (const RollupTierOptions& options : tiers) m_tiers.emplace_back(options);
+    std::sort(m_tiers.begin(), m_tiers.end(), [](const RollupTier& a, const RollupTier& b) {
+        return a.options().resolution < b.options().resolution;
+    });
+}
+
+void RollupSeries::add(std::span<const TimeDouble> readings) {
+    for (RollupTier& tier : m_tiers) {
+        for (const TimeDouble& reading : readings) tier.add(reading);
+    }
+}
+
+void RollupSeries::clear() {
+    for (RollupTier& tier : m_tiers) tier.clear();
+}
+
+std::vector<RollupBucket> RollupSeries::query(std::chrono::system_clock::time_point from,
+                                              std::chrono::system_clock::time_point to, std::size_t max_points) const {
+    if (m_tiers.empty()) return {};
+    for (const RollupTier& tier : m_tiers) {
+        const auto buckets_in_range { (to - from) / tier.options().resolution };
+        if (tier.retained_from() <= from && static_cast<std::size_t>(std::max<std::int64_t>(buckets_in_range, 0)) <= max_points) {
+            return tier.buckets(from, to);
+        }
+    }
+    return m_tiers.back().buckets(from, to);
+}
+
+bool parse_rollup_tiers(const std::string& text, std::vector<RollupTierOptions>& tiers) {
+    std::vector<RollupTierOptions> parsed;
+    std::istringstream input { text };
+    std::string item;
+    while (std::getline(input, item, ',')) {
+        long long amount{};
+        char unit{};
+        char colon{};
+        std::size_t retention{};
+        std::istringstream fields { item };
+        if (!(fields >> amount >> unit >> colon >> retention) || colon != ':' || amount <= 0 || retention == 0) return false;
+        const long long seconds_per_unit { unit == 's' ? 1 : unit == 'm' ? 60 : unit == 'h' ? 3600 : unit == 'd' ? 86400 : 0 };
+        if (seconds_per_unit == 0) return false;
+        parsed.push_back({ std::chrono::seconds { amount * seconds_per_unit }, retention });
+    }
+    if (parsed.empty()) return false;
+    tiers = std::move(parsed);
+    return true;
+}
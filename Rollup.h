@@ -0,0 +1,83 @@
+#ifndef WEATHER_SENSORS_ROLLUP_H
+#define WEATHER_SENSORS_ROLLUP_H
+#include "structs.h"
+#include <span>
+#include <string>
+#include <limits>
+
+// readings of one bucket of a rollup tier
+struct RollupBucket {
+    std::chrono::system_clock::time_point start;
+    std::size_t count;
+    double sum;
+    double min;
+    double max;
+    double last;    // value of the latest reading in the bucket
+    std::chrono::system_clock::time_point last_time;
+};
+
+struct RollupTierOptions {
+    std::chrono::seconds resolution;
+    std::size_t retention;      // buckets kept, older ones are overwritten
+};
+
+// 1 s for an hour, 1 min for a week, 1 h for a year: 64 bytes a bucket, 1.4 MB per sensor
+inline const std::vector<RollupTierOptions> default_rollup_tiers {
+    { std::chrono::seconds { 1 }, 3600 },
+    { std::chrono::seconds { 60 }, 7 * 24 * 60 },
+    { std::chrono::seconds { 3600 }, 365 * 24 } };
+
+/**
+ *  Fixed size ring of buckets in the style of RRDtool: bucket number n (time / resolution)
+ *  lives in slot n % retention, a newer bucket simply overwrites the slot
+ *  A late reading still lands in its bucket while that bucket is retained, older ones are dropped
+ */
+class RollupTier {
+private:
+    struct Slot {
+        std::int64_t number { empty };  // bucket number held by the slot
+        RollupBucket bucket{};
+    };
+    static constexpr std::int64_t empty { std::numeric_limits<std::int64_t>::min() };
+    RollupTierOptions m_options;
+    std::int64_t m_resolution_ns;
+    std::int64_t m_newest { empty };
+    std::vector<Slot> m_slots;
+    Slot& slot(std::int64_t number);
+    const Slot& slot(std::int64_t number) const;
+public:
+    explicit RollupTier(RollupTierOptions options);
+    void add(const TimeDouble& reading);
+    void clear();
+    // buckets overlapping [from, to) that are still retained and not empty, oldest first
+    std::vector<RollupBucket> buckets(std::chrono::system_clock::time_point from,
+                                      std::chrono::system_clock::time_point to) const;
+    // earliest time still covered by the ring
+    std::chrono::system_clock::time_point retained_from() const;
+    const RollupTierOptions& options() const { return m_options; }
+};
+
+/**
+ *  The tiers of one sensor, all updated from the same readings
+ */
+class RollupSeries {
+private:
+    std::vector<RollupTier> m_tiers;
+public:
+    RollupSeries();
+    explicit RollupSeries(const std::vector<RollupTierOptions>& tiers);
+    void add(std::span<const TimeDouble> readings);
+    void clear();
+    /**
+     *  Buckets of [from, to) from the finest tier that still retains from and returns
+     *  at most max_points buckets, or from the coarsest tier if none does
+     */
+    std::vector<RollupBucket> query(std::chrono::system_clock::time_point from,
+                                    std::chrono::system_clock::time_point to, std::size_t max_points) const;
+    const std::vector<RollupTier>& tiers() const { return m_tiers; }
+};
+
+// "1s:3600,1m:10080,1h:8760", resolutions take s, m, h or d, false if the text is malformed
+bool parse_rollup_tiers(const std::string& text, std::vector<RollupTierOptions>& tiers);
+
+#endif
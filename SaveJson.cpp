@@ -1,6 +1,48 @@
 #include "SaveJson.h"
+#include <algorithm>
+#include <iterator>
+#include <numeric>
+#include <stdexcept>
+#include <thread>
+
+namespace sensor_data {
+    extern AsyncWriter file_writer;
+}
+
 
 
+std::string format_name(SaveFormat format) {
+    switch (format) {
+        case SaveFormat::json:    return "json";
+        case SaveFormat::cbor:    return "cbor";
+        case SaveFormat::msgpack: return "msgpack";
+        case SaveFormat::ubjson:  return "ubjson";
+        case SaveFormat::bjdata:  return "bjdata";
+    }
+    return "json";
+}
+
+std::string format_extension(SaveFormat format) {
+    return "." + format_name(format);
+}
+
+bool parse_save_format(const std::string& name, SaveFormat& format) {
+    for (SaveFormat candidate : { SaveFormat::json, SaveFormat::cbor, SaveFormat::msgpack,
+                                  SaveFormat::ubjson, SaveFormat::bjdata }) {
+        if (name == format_name(candidate)) {
+            format = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+SaveFormat format_from_filename(const std::string& filename) {
+    SaveFormat format { SaveFormat::json };
+    std::size_t dot { filename.rfind('.') };
+    if (dot != std::string::npos) parse_save_format(filename.substr(dot + 1), format);
+    return format;
+}
 
 bool file_exists(const std::string& filename) {
     std::ifstream file(filename);
@@ -9,31 +51,163 @@ bool file_exists(const std::string& filename) {
 
 std::string get_current_date_cstyle() {
     std::time_t t = std::time(nullptr);
-    char time_string[100]; 
+    char time_string[100];
     if (std::strftime(time_string, sizeof(time_string), "%d%b%Y", std::localtime(&t))){
         return time_string;
     }
     else return "date_error";
 }
 
-std::string generate_free_json_filename(const std::string& filename) {
+std::string generate_free_filename(const std::string& filename, const std::string& extension) {
     const std::string namebase { filename + "-" + get_current_date_cstyle() };
-    std::string name_to_check { namebase + ".json" };
+    std::string name_to_check { namebase + extension };
     int suffix { 0 };
     while (1) {
         if (!file_exists(name_to_check)) return name_to_check;
         suffix++;
-        name_to_check = namebase + "-" + std::to_string(suffix) + ".json";
+        name_to_check = namebase + "-" + std::to_string(suffix) + extension;
+    }
+    return " ";
+}
+
+std::string generate_free_json_filename(const std::string& filename) {
+    return generate_free_filename(filename, ".json");
+}
+
+namespace {
+    // a value encoded on its own is encoded the same inside a document, text only needs re-indenting
+    template <typename Json>
+    std::vector<std::uint8_t> encode_value(const Json& json_data, SaveFormat format) {
+        switch (format) {
+            case SaveFormat::cbor:    return Json::to_cbor(json_data);
+            case SaveFormat::msgpack: return Json::to_msgpack(json_data);
+            case SaveFormat::ubjson:  return Json::to_ubjson(json_data);
+            case SaveFormat::bjdata:  return Json::to_bjdata(json_data);
+            case SaveFormat::json:    break;
+        }
+        // same layout as the original text output: indent 3
+        const std::string text { json_data.dump(3) };
+        return std::vector<std::uint8_t>(text.begin(), text.end());
+    }
+
+    template <typename Json>
+    std::vector<std::uint8_t> encode_document(const Json& json_data, SaveFormat format) {
+        std::vector<std::uint8_t> bytes { encode_value(json_data, format) };
+        // and a trailing newline
+        if (format == SaveFormat::json) bytes.push_back('\n');
+        return bytes;
     }
-    return " ";    
+
+    // puts indent more spaces after every line break of pretty printed text
+    void indent_lines(std::vector<std::uint8_t>& text, std::size_t indent) {
+        const auto breaks { static_cast<std::size_t>(std::count(text.begin(), text.end(), '\n')) };
+        if (breaks == 0 || indent == 0) return;
+        std::vector<std::uint8_t> indented(text.size() + breaks * indent);
+        auto out { indented.begin() };
+        for (std::uint8_t byte : text) {
+            *out++ = byte;
+            if (byte == '\n') out = std::fill_n(out, indent, ' ');
+        }
+        text = std::move(indented);
+    }
+}
+
+std::vector<std::uint8_t> encode_json(const json& json_data, SaveFormat format) {
+    return encode_document(json_data, format);
+}
+
+std::vector<std::uint8_t> encode_json(const scratch_json& json_data, SaveFormat format) {
+    return encode_document(json_data, format);
 }
 
-std::string save_sensordata_to_json(const std::string& filename, const SensorData& data){
-    json json_data { data.construct_json_object() };
-    std::string filename_json { generate_free_json_filename(filename) };
-    // open file stream
-    std::ofstream o(filename_json);
-    // save data to file
-    o << std::setw(3) << json_data << std::endl;
-    return std::move(filename_json);
-}
\ No newline at end of file
+json decode_json(const std::vector<std::uint8_t>& bytes, SaveFormat format) {
+    switch (format) {
+        case SaveFormat::cbor:    return json::from_cbor(bytes);
+        case SaveFormat::msgpack: return json::from_msgpack(bytes);
+        case SaveFormat::ubjson:  return json::from_ubjson(bytes);
+        case SaveFormat::bjdata:  return json::from_bjdata(bytes);
+        case SaveFormat::json:    break;
+    }
+    return json::parse(bytes);
+}
+
+std::vector<std::vector<std::uint8_t>> encode_sensordata(const SensorData& data, SaveFormat format,
+                                                         TimestampFormat timestamps, std::uint64_t* scratch_bytes) {
+    TraceScope trace("encode sensordata");
+    // the skeleton first, it is small and tells where the reading arrays go and at which indent
+    std::vector<std::vector<std::uint8_t>> parts;
+    std::size_t indents[sensor_count] {};
+    std::uint64_t scratch[sensor_count + 1] {};
+    {
+        // the document is scratch: its nodes come from one arena, released as a whole after encoding
+        ScratchArena arena;
+        // the file holds the document in a one element array, moved in rather than copied
+        scratch_json document = scratch_json::array();
+        document.push_back(data.construct_scratch_skeleton(timestamps));
+        const std::vector<std::uint8_t> skeleton { encode_document(document, format) };
+        auto from { skeleton.begin() };
+        for (SensorId id : all_sensors) {
+            const std::vector<std::uint8_t> placeholder { encode_value(scratch_json(readings_placeholder(id)), format) };
+            const auto found { std::search(from, skeleton.end(), placeholder.begin(), placeholder.end()) };
+            if (found == skeleton.end()) throw std::logic_error(std::string("export placeholder missing for ") + sensor_name(id));
+            const auto line { std::find(std::make_reverse_iterator(found), skeleton.rend(), '\n').base() };
+            indents[static_cast<std::size_t>(id)] = static_cast<std::size_t>(
+                std::find_if(line, found, [](std::uint8_t byte) { return byte != ' '; }) - line);
+            parts.emplace_back(from, found);
+            parts.emplace_back();
+            from = found + static_cast<std::ptrdiff_t>(placeholder.size());
+        }
+        parts.emplace_back(from, skeleton.end());
+        scratch[sensor_count] = arena.bytes();
+    }
+    // every sensor's array is built and encoded on a thread of its own, in an arena of its own
+    std::vector<std::thread> workers;
+    for (SensorId id : all_sensors) {
+        workers.emplace_back([&, id] {
+            trace_set_thread_name("export");
+            const auto index { static_cast<std::size_t>(id) };
+            std::vector<std::uint8_t>& section { parts[2 * index + 1] };
+            {
+                ScratchArena arena;
+                const scratch_json readings = data.construct_scratch_readings(id, timestamps);
+                section = encode_value(readings, format);
+                scratch[index] = arena.bytes();
+            }
+            if (format == SaveFormat::json) indent_lines(section, indents[index]);
+        });
+    }
+    for (std::thread& worker : workers) worker.join();
+    if (scratch_bytes) *scratch_bytes = std::accumulate(std::begin(scratch), std::end(scratch), std::uint64_t {});
+    return parts;
+}
+
+std::string save_sensordata(const std::string& filename, SensorData& data, SaveFormat format,
+                            TimestampFormat timestamps){
+    TraceScope trace("save");
+    MetricScope timer(data.metrics(), MetricTimer::save);
+    std::uint64_t scratch_bytes{};
+    std::vector<std::vector<std::uint8_t>> parts { encode_sensordata(data, format, timestamps, &scratch_bytes) };
+    data.metrics().set_export_scratch(scratch_bytes);
+    std::string filename_out { generate_free_filename(filename, format_extension(format)) };
+    // the background writer does the disk I/O, wait for it since the caller expects the file to exist,
+    // the parts go out in one pwritev without being joined
+    sensor_data::file_writer.write_file(filename_out, std::move(parts)).get();
+    return filename_out;
+}
+
+std::string save_sensordata_to_json(const std::string& filename, SensorData& data){
+    return save_sensordata(filename, data, SaveFormat::json);
+}
+
+json load_sensordata(const std::string& filename, SaveFormat format) {
+    std::ifstream i(filename, std::ios::binary);
+    if (format == SaveFormat::json) {
+        return json::parse(i);
+    }
+    std::vector<std::uint8_t> bytes { std::istreambuf_iterator<char>(i), std::istreambuf_iterator<char>() };
+    return decode_json(bytes, format);
+}
+
+json load_sensordata(const std::string& filename) {
+    return load_sensordata(filename, format_from_filename(filename));
+}
@@ -6,23 +6,80 @@
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <vector>
+#include <cstdint>
 #include <chrono>
 using json = nlohmann::ordered_json;
 
+/**
+ *  File formats that SensorData can be saved in
+ *  json is the pretty printed text format (setw(3)),
+ *  the others are the binary formats of the bundled nlohmann serializers
+ */
+enum class SaveFormat {
+    json,
+    cbor,
+    msgpack,
+    ubjson,
+    bjdata
+};
+
+// name of the format, e.g. "cbor"
+std::string format_name(SaveFormat format);
+
+// file extension including the dot, e.g. ".cbor"
+std::string format_extension(SaveFormat format);
+
+// converts a name like "msgpack" to a SaveFormat, returns false if unknown
+bool parse_save_format(const std::string& name, SaveFormat& format);
+
+// guesses the format from the file extension, defaults to json
+SaveFormat format_from_filename(const std::string& filename);
 
 // checks if file exists in current directory
-bool file_exists(const std::string& filename); 
+bool file_exists(const std::string& filename);
 
 // get current date in format suitable for a filename
 std::string get_current_date_cstyle();
 
-// Function takes a base filename, adds the current date and .json,
+// Function takes a base filename, adds the current date and the extension,
 // if file already exists it adds integers starting with 1
 // until it finds an unused filename
+std::string generate_free_filename(const std::string& filename, const std::string& extension);
+
+// same as above with the .json extension
 std::string generate_free_json_filename(const std::string& filename);
 
+// serializes a json object to bytes in the given format
+std::vector<std::uint8_t> encode_json(const json& json_data, SaveFormat format);
+std::vector<std::uint8_t> encode_json(const scratch_json& json_data, SaveFormat format);
+
+// parses bytes in the given format back to a json object
+json decode_json(const std::vector<std::uint8_t>& bytes, SaveFormat format);
+
+/**
+ *  The file save_sensordata writes, as parts to be written back to back: the readings of each sensor
+ *  are built and encoded in parallel, the rest of the document around them on the calling thread
+ *  scratch_bytes gets the arena memory it used
+ */
+std::vector<std::vector<std::uint8_t>> encode_sensordata(const SensorData& data, SaveFormat format,
+                                                         TimestampFormat timestamps = TimestampFormat::epoch_ns,
+                                                         std::uint64_t* scratch_bytes = nullptr);
+
 // function use SensorData methods to construct a json object,
-// generates a filenamne and saves it in the current folder
-std::string save_sensordata_to_json(const std::string& filename, const SensorData& data);
+// generates a filename and saves it in the current folder in the given format,
+// timestamps are epoch nanoseconds unless another TimestampFormat is given,
+// the save duration is recorded in the metrics of data
+std::string save_sensordata(const std::string& filename, SensorData& data, SaveFormat format,
+                            TimestampFormat timestamps = TimestampFormat::epoch_ns);
+
+// same as above, always text json
+std::string save_sensordata_to_json(const std::string& filename, SensorData& data);
+
+// loads a file written by save_sensordata, throws json::exception on malformed data
+json load_sensordata(const std::string& filename, SaveFormat format);
+
+// same as above, format is taken from the file extension
+json load_sensordata(const std::string& filename);
 
-#endif
\ No newline at end of file
+#endif
@@ -1,39 +1,148 @@
 #include "SensorData.h"
 
-extern std::mutex sensor_mutex;
+extern SensorMutex sensor_mutex;
+
+void SensorData::store_new_reading(double reading, SensorId id) {
+    TraceScope trace("store");
+    const TimeDouble stored { m_clock.now(), reading };
+    {
+        SensorLock guard(sensor_mutex, LockSite::store_new_reading);
+        std::vector<TimeDouble>& readings { m_new_readings[id] };
+        readings.push_back(stored);
+        m_metrics.record_reading(id, readings.size());
+        if (m_latest_values) {
+            write_latest_value(m_latest_values->slots[static_cast<std::size_t>(id)], to_epoch_ns(stored.time_point), reading);
+        }
+        // subscribers get single readings in one batch per pass, the buffer keeps its capacity
+        if (m_hub.active()) m_unpublished[id].push_back(stored);
+    }
+}
 
-void SensorData::store_new_reading(double reading, std::vector<TimeDouble>& readings) {
-    std::lock_guard<std::mutex> guard(sensor_mutex);
-    readings.emplace_back(std::chrono::system_clock::now(), reading);
+/**
+ *  Hands the single readings stored since the last call to the subscribers as one batch,
+ *  called by the statistics thread once per pass
+ */
+void SensorData::publish_stored_readings() {
+    auto batch { std::make_shared<SensorReadings>() };
+    {
+        SensorLock guard(sensor_mutex, LockSite::sensor_statistics);
+        // readings buffered before the last subscriber left are not sent to the next one
+        const bool active { m_hub.active() };
+        for (SensorId id : all_sensors) {
+            if (active) (*batch)[id].assign(m_unpublished[id].begin(), m_unpublished[id].end());
+            m_unpublished[id].clear();
+        }
+    }
+    if (!batch->temperature.empty() || !batch->humidity.empty() || !batch->windspeed.empty()) {
+        m_hub.publish(std::move(batch));
+    }
 }
 
 /**
  *  Public setter functions 
  */
 void SensorData::store_temperature_reading(double reading){
-    store_new_reading(reading, m_new_readings.temperature);
+    store_new_reading(reading, SensorId::temperature);
 }
 
 void SensorData::store_humidity_reading(double reading){
-    store_new_reading(reading, m_new_readings.humidity);
+    store_new_reading(reading, SensorId::humidity);
 }
 void SensorData::store_windspeed_reading(double reading){
-    store_new_reading(reading, m_new_readings.windspeed);
+    store_new_reading(reading, SensorId::windspeed);
+}
+
+/**
+ *  Appends readings to m_new_readings, called with sensor_mutex held
+ *  Grows the buffer once for the whole span, at least doubling it so repeated batches stay amortized
+ */
+void SensorData::append_new_readings(SensorId id, std::span<const TimeDouble> source) {
+    if (source.empty()) return;
+    std::vector<TimeDouble>& readings { m_new_readings[id] };
+    const std::size_t needed { readings.size() + source.size() };
+    if (needed > readings.capacity()) readings.reserve(std::max(needed, 2 * readings.capacity()));
+    readings.insert(readings.end(), source.begin(), source.end());
+    m_metrics.record_readings(id, source.size(), readings.size());
+    if (m_latest_values) {
+        write_latest_value(m_latest_values->slots[static_cast<std::size_t>(id)],
+                           to_epoch_ns(source.back().time_point), source.back().value);
+    }
+}
+
+/**
+ *  Appends readings of one sensor that already carry their time point, one lock for the whole span
+ */
+void SensorData::store_readings(SensorId id, std::span<const TimeDouble> readings) {
+    if (readings.empty()) return;
+    TraceScope trace("store readings");
+    {
+        SensorLock guard(sensor_mutex, LockSite::store_batch);
+        append_new_readings(id, readings);
+    }
+    if (m_hub.active()) {
+        auto batch { std::make_shared<SensorReadings>() };
+        (*batch)[id].assign(readings.begin(), readings.end());
+        m_hub.publish(std::move(batch));
+    }
+}
+
+/**
+ *  Stamps values with clock() and stores them like store_readings(), the stamping happens before
+ *  the lock is taken; with the batch clock every value gets the same time
+ */
+void SensorData::store_readings(SensorId id, std::span<const double> values) {
+    if (values.empty()) return;
+    std::vector<TimeDouble> stamped;
+    stamped.reserve(values.size());
+    {
+        ClockBatch clock_batch { m_clock };
+        for (double value : values) stamped.push_back({ m_clock.now(), value });
+    }
+    store_readings(id, stamped);
+}
+
+/**
+ *  Appends readings of every sensor that already carry their time point, one lock for the whole batch
+ */
+void SensorData::store_batch(const SensorReadings& batch) {
+    TraceScope trace("store batch");
+    {
+        SensorLock guard(sensor_mutex, LockSite::store_batch);
+        for (SensorId id : all_sensors) append_new_readings(id, batch[id]);
+    }
+    // one shared copy for all subscribers, made outside the lock
+    if (m_hub.active()) m_hub.publish(std::make_shared<const SensorReadings>(batch));
+}
+
+Subscription SensorData::subscribe(ReadingsCallback callback, SubscriberOptions options) {
+    return m_hub.subscribe(std::move(callback), options);
 }
 
+/**
+ *  Starts publishing the newest reading of each sensor to table, nullptr stops it
+ *  The table starts out with the newest reading already in history
+ */
+void SensorData::attach_latest_values(LatestValueTable* table) {
+    SensorLock guard(sensor_mutex, LockSite::other);
+    m_latest_values = table;
+    if (!table) return;
+    for (SensorId id : all_sensors) {
+        if (m_new_readings[id].empty() && m_readings[id].empty()) continue;
+        const TimeDouble newest { m_new_readings[id].empty() ? m_readings[id].back() : m_new_readings[id].back() };
+        write_latest_value(table->slots[static_cast<std::size_t>(id)], to_epoch_ns(newest.time_point), newest.value);
+    }
+}
 
 /**
  *  Calculates Max, Min and Average
  *  @param first_reading    If true set max and min, then update first_reading to false
- *  @param sum              Calculate sum of readings and new_readings to get average
+ *  @param sum              Calculate sum of earlier readings (stat.count) and new_readings to get average
  *  @param stat             Stats variable gets updated by the function
  */
 void SensorData::calculate_statistics(Stats& stat, bool& first_reading,
-    // Stats& stat, bool& first_reading,
-    const std::vector<TimeDouble>& readings,
-    const std::vector<TimeDouble>& new_readings) {
+    std::span<const TimeDouble> new_readings) {
 
-    double sum{ stat.average * readings.size() };
+    double sum{ stat.average * stat.count };
     for (auto& reading : new_readings) {
         if (first_reading) {
             // set max
@@ -57,21 +166,21 @@ void SensorData::calculate_statistics(Stats& stat, bool& first_reading,
         // add value to sum
         sum += reading.value;
     }
-    int num_of_entries { static_cast<int>(readings.size() + new_readings.size()) };
-    stat.average = sum / num_of_entries;
+    stat.count += new_readings.size();
+    if (stat.count > 0) stat.average = sum / stat.count;
 }
 
 
 void SensorData::calculate_temperature_statistic(bool& first_reading){
-    calculate_statistics(m_statistics.temperature, first_reading, m_readings.temperature, m_new_readings.temperature);
+    calculate_statistics(m_statistics.temperature, first_reading, m_new_readings.temperature);
 }
 
 void SensorData::calculate_humidity_statistic(bool& first_reading){
-    calculate_statistics(m_statistics.humidity, first_reading, m_readings.humidity, m_new_readings.humidity);
+    calculate_statistics(m_statistics.humidity, first_reading, m_new_readings.humidity);
 }
 
 void SensorData::calculate_windspeed_statistic(bool& first_reading){
-    calculate_statistics(m_statistics.windspeed, first_reading, m_readings.windspeed, m_new_readings.windspeed);
+    calculate_statistics(m_statistics.windspeed, first_reading, m_new_readings.windspeed);
 }
 
 
@@ -79,43 +188,225 @@ void SensorData::calculate_windspeed_statistic(bool& first_reading){
 /**
  *  Move from new_readings to readings 
  */
-void SensorData::move_sensor_data( std::vector<TimeDouble>& readings, std::vector<TimeDouble>& new_readings ) {
-    // move data into readings
-    readings.insert(readings.end(), 
-                    std::make_move_iterator(new_readings.begin()), 
-                    std::make_move_iterator(new_readings.end()) );
+void SensorData::move_sensor_data(SensorId id) {
+    std::vector<TimeDouble>& new_readings { m_new_readings[id] };
+    commit_readings(id, new_readings);
     // clear new_readings
     new_readings.clear();
+    m_metrics.set_backlog(id, 0);
+}
+
+/**
+ *  Appends readings that passed statistics to the history, through the compression filter if one is set
+ *  The reading the filter holds back is kept at the end of the history so it always reaches the newest
+ *  reading, the next commit takes it out again and the filter decides whether it stays
+ */
+void SensorData::commit_readings(SensorId id, const std::vector<TimeDouble>& new_readings) {
+    const std::size_t index { static_cast<std::size_t>(id) };
+    SensorSeries& readings { m_readings[id] };
+    CompressionFilter& filter { m_filters[index] };
+    m_rollups[index].add(new_readings);
+    if (filter.options().mode == CompressionMode::off) {
+        const std::size_t old_size { readings.size() };
+        readings.append(new_readings);
+        index_history(id, old_size);
+        return;
+    }
+    // the flag alone decides: with implicit times the stored time is the run's, not the pending reading's
+    if (m_pending_in_history[index] && !readings.empty()) readings.pop_back();
+    const std::size_t old_size { readings.size() };
+    std::vector<TimeDouble> kept;
+    filter.filter(new_readings, kept);
+    readings.append(kept);
+    const TimeDouble* pending { filter.pending() };
+    if (pending) readings.push_back(*pending);
+    m_pending_in_history[index] = pending != nullptr;
+    m_metrics.set_compression(id, filter.input(), filter.kept() + (pending ? 1 : 0));
+    index_history(id, old_size);
+}
+
+void SensorData::update_history_metrics(SensorId id) {
+    m_metrics.set_history(id, m_readings[id].size(), m_readings[id].memory_bytes());
+}
+
+/**
+ *  Keeps the history in time order and its index current after readings were appended at appended_from
+ *  Readings normally arrive in order and this is one is_sorted pass over the new readings,
+ *  late ones (ingested with their own timestamps) are sorted and merged into the tail
+ */
+void SensorData::index_history(SensorId id, std::size_t appended_from) {
+    SensorSeries& readings { m_readings[id] };
+    const std::size_t changed_from { readings.restore_order(appended_from) };
+    m_time_index[static_cast<std::size_t>(id)].update(readings, changed_from);
+    update_history_metrics(id);
 }
 
 void SensorData::move_temperature_data(){
-    move_sensor_data(m_readings.temperature, m_new_readings.temperature);
+    move_sensor_data(SensorId::temperature);
 }
 void SensorData::move_humidity_data(){
-    move_sensor_data(m_readings.humidity, m_new_readings.humidity);
+    move_sensor_data(SensorId::humidity);
 }
 void SensorData::move_windspeed_data(){
-    move_sensor_data(m_readings.windspeed, m_new_readings.windspeed);
+    move_sensor_data(SensorId::windspeed);
 }
 
 
+/**
+ *  Copies the readings that the next move will commit, used to write them to the log
+ *  Note: called with sensor_mutex held, like the move functions
+ */
+void SensorData::copy_new_readings(SensorReadings& batch) const {
+    for (SensorId id : all_sensors) {
+        batch[id].assign(m_new_readings[id].begin(), m_new_readings[id].end());
+    }
+}
+
+/**
+ *  Adds readings from the write-ahead log as if they had passed a statistics pass
+ */
+void SensorData::replay_readings(SensorId id, const std::vector<TimeDouble>& readings) {
+    SensorLock guard(sensor_mutex, LockSite::other);
+    bool first_reading { m_statistics[id].count == 0 };
+    calculate_statistics(m_statistics[id], first_reading, readings);
+    commit_readings(id, readings);
+}
+
+/**
+ *  Replaces the history of a sensor with readings loaded from a snapshot
+ */
+void SensorData::restore_readings(SensorId id, const TimeDouble* readings, std::size_t count, const Stats& stat) {
+    SensorLock guard(sensor_mutex, LockSite::other);
+    // headroom so the first commits after a restart do not reallocate the whole history
+    m_readings[id].clear();
+    m_readings[id].reserve(count + count / 4);
+    m_readings[id].append({ readings, count });
+    m_statistics[id] = stat;
+    // rollups are not part of the snapshot, they are rebuilt from the readings
+    m_rollups[static_cast<std::size_t>(id)].clear();
+    m_rollups[static_cast<std::size_t>(id)].add({ readings, count });
+    // the snapshot holds what the filter kept, filtering starts over after it
+    m_filters[static_cast<std::size_t>(id)].reset();
+    m_pending_in_history[static_cast<std::size_t>(id)] = false;
+    index_history(id, 0);
+}
+
+// Note: no lock, only the statistics thread changes m_readings and m_statistics,
+// so these are safe to call from that thread or after the threads have stopped
+const SensorSeries& SensorData::committed_readings(SensorId id) const {
+    return m_readings[id];
+}
+
+const Stats& SensorData::statistic(SensorId id) const {
+    return m_statistics[id];
+}
+
+// true if readings have been committed (moved or replayed), new readings are not counted
+bool SensorData::has_readings(SensorId id) const {
+    SensorLock guard(sensor_mutex, LockSite::other);
+    return !m_readings[id].empty();
+}
+
+/**
+ *  Committed readings of a sensor with from <= time_point < to
+ *  Same rule as committed_readings(): call from the statistics thread, with sensor_mutex held
+ *  or after the threads have stopped
+ */
+ReadingRange SensorData::range(SensorId id, std::chrono::system_clock::time_point from,
+                               std::chrono::system_clock::time_point to) const {
+    const SensorSeries& readings { m_readings[id] };
+    const TimeIndex& index { m_time_index[static_cast<std::size_t>(id)] };
+    const std::size_t first { index.lower_bound(readings, from) };
+    const std::size_t last { std::max(first, index.lower_bound(readings, to)) };
+    return { readings, first, last };
+}
+
+/**
+ *  Buckets covering [from, to) from the finest rollup tier that still has from
+ *  and needs at most max_points buckets, same calling rule as range()
+ */
+std::vector<RollupBucket> SensorData::rollup(SensorId id, std::chrono::system_clock::time_point from,
+                                             std::chrono::system_clock::time_point to, std::size_t max_points) const {
+    return m_rollups[static_cast<std::size_t>(id)].query(from, to, max_points);
+}
+
+const RollupSeries& SensorData::rollups(SensorId id) const {
+    return m_rollups[static_cast<std::size_t>(id)];
+}
+
+// replaces the tiers of every sensor and fills them from the committed readings
+void SensorData::set_rollup_tiers(const std::vector<RollupTierOptions>& tiers) {
+    SensorLock guard(sensor_mutex, LockSite::other);
+    for (SensorId id : all_sensors) {
+        RollupSeries& series { m_rollups[static_cast<std::size_t>(id)] };
+        series = RollupSeries { tiers };
+        for (std::span<const TimeDouble> chunk : ReadingRange { m_readings[id], 0, m_readings[id].size() }) series.add(chunk);
+    }
+}
+
+// filter for the readings committed from now on, the history so far stays as it is
+void SensorData::set_compression(SensorId id, CompressionOptions options) {
+    SensorLock guard(sensor_mutex, LockSite::other);
+    m_filters[static_cast<std::size_t>(id)] = CompressionFilter { options };
+    m_pending_in_history[static_cast<std::size_t>(id)] = false;
+}
+
+const CompressionFilter& SensorData::compression(SensorId id) const {
+    return m_filters[static_cast<std::size_t>(id)];
+}
+
+/**
+ *  Stores the values of a sensor as codes of step within its range, 0 stores doubles
+ *  The history is converted, so its values and index change to the quantized ones
+ */
+bool SensorData::set_quantization(SensorId id, double step) {
+    SensorLock guard(sensor_mutex, LockSite::other);
+    if (!m_readings[id].set_quantization(step, sensor_range(id))) return false;
+    m_time_index[static_cast<std::size_t>(id)].update(m_readings[id], 0);
+    update_history_metrics(id);
+    return true;
+}
+
+/**
+ *  Stores the times of a sensor as runs of start time and period, readings more than tolerance
+ *  off their run keep their own time, the others read back up to tolerance off
+ *  Keep tolerance well below the period so the history stays in time order
+ */
+void SensorData::set_implicit_times(SensorId id, bool enabled, std::chrono::nanoseconds tolerance) {
+    SensorLock guard(sensor_mutex, LockSite::other);
+    m_readings[id].set_implicit_times(enabled, tolerance);
+    // block first/last times now read back from the runs, up to tolerance off the exact ones
+    m_time_index[static_cast<std::size_t>(id)].update(m_readings[id], 0);
+    update_history_metrics(id);
+}
+
+// max, min, average and count of the readings range() would return
+Stats SensorData::range_statistics(SensorId id, std::chrono::system_clock::time_point from,
+                                   std::chrono::system_clock::time_point to) const {
+    const SensorSeries& readings { m_readings[id] };
+    const TimeIndex& index { m_time_index[static_cast<std::size_t>(id)] };
+    const std::size_t first { index.lower_bound(readings, from) };
+    const std::size_t last { std::max(first, index.lower_bound(readings, to)) };
+    return index.aggregate(readings, first, last);
+}
 
 
 // https://en.cppreference.com/w/cpp/container/vector/back
-void SensorData::print_reading( const std::vector<TimeDouble>& readings, const std::vector<TimeDouble>& new_readings) {
+void SensorData::print_reading( const SensorSeries& readings, const std::vector<TimeDouble>& new_readings) {
     if (new_readings.size() > 0) {
         std::cout << new_readings.back().value << ", "
-                  << new_readings.back().time_point;
+                  << format_console_time(new_readings.back().time_point);
     } else if (readings.size() > 0) {
         std::cout << readings.back().value << ", "
-                  << readings.back().time_point;
+                  << format_console_time(readings.back().time_point);
     } else {
         std::cout << "<no sensor data>";
     }
 }
 
 void SensorData::print_latest_readings(){
-    std::lock_guard<std::mutex> guard(sensor_mutex);
+    TraceScope trace("print readings");
+    SensorLock guard(sensor_mutex, LockSite::print_latest_readings);
     // std::cout << "\nLatest Sensor Data";
     std::cout << "\n"
               << "Temperature: ";
@@ -132,15 +423,16 @@ void SensorData::print_latest_readings(){
 
 
 void SensorData::print_single_statistic(Stats stat){
-    std::cout << "Max: " << stat.max.value << ", " << stat.max.time_point << "\n"
-              << "Min: " << stat.min.value << ", " << stat.min.time_point << "\n"
+    std::cout << "Max: " << stat.max.value << ", " << format_console_time(stat.max.time_point) << "\n"
+              << "Min: " << stat.min.value << ", " << format_console_time(stat.min.time_point) << "\n"
               << "Average: " << stat.average << "\n";
 }
 
 void SensorData::print_statistics(){
-    std::lock_guard<std::mutex> guard(sensor_mutex);
+    TraceScope trace("print statistics");
+    SensorLock guard(sensor_mutex, LockSite::print_statistics);
     std::cout << "\nSensor Statistics\n"
-              << std::chrono::system_clock::now() << "\n"
+              << format_console_time(std::chrono::system_clock::now()) << "\n"
 
               << "Temperature: \n";
     print_single_statistic(m_statistics.temperature);
@@ -152,50 +444,73 @@ void SensorData::print_statistics(){
     print_single_statistic(m_statistics.windspeed);
 }
 
-std::string SensorData::timepoint_to_string(std::chrono::system_clock::time_point time_point) const {
-    time_t time { std::chrono::system_clock::to_time_t(time_point) };
-    char time_string[100];
-    if (std::strftime(time_string, sizeof(time_string), "%c", std::localtime(&time))){
-        return time_string;
+/**
+ *  Timestamp as it is written to the export
+ *  Numeric formats are stored as integers, so no string is allocated
+ */
+template <typename Json>
+Json SensorData::timepoint_to_json(std::chrono::system_clock::time_point time_point, TimestampFormat format) const {
+    switch (format) {
+        case TimestampFormat::epoch_ns: return to_epoch_ns(time_point);
+        case TimestampFormat::epoch_ms: return to_epoch_ms(time_point);
+        case TimestampFormat::rfc3339: {
+            char buffer[rfc3339_length];
+            format_rfc3339(time_point, buffer);
+            return std::string(buffer, rfc3339_length);
+        }
+        case TimestampFormat::local_string: break;
     }
-    else return "timepoint_to_string Conversion Error";
+    return format_local_string(time_point);
+}
+
+// the [time, value] array of one sensor, null without readings
+template <typename Json>
+Json SensorData::build_readings_json(SensorId id, TimestampFormat format) const {
+    const SensorSeries& readings { m_readings[id] };
+    Json json_readings;
+    if (readings.empty()) return json_readings;
+    // sized up front, so building the array copies no nodes and leaves no dead buffers in an arena
+    json_readings = Json::array();
+    json_readings.template get_ref<typename Json::array_t&>().reserve(readings.size());
+    for (const auto& reading : readings) {
+        json_readings.push_back( { timepoint_to_json<Json>(reading.time_point, format), reading.value } );
+    }
+    return json_readings;
 }
 
 // Could be more elegant with two helper functions (add_reading, add_statistic) but works for now.
 // Note: This is used in main as a single thread, so no mutex/lockguard is utilised.
-json SensorData::construct_json_object() const {
-    json json_readings;
-    json json_temporary;
-    json json_stats_temporary;
+// readings_of(id) gives what goes under the sensor's name, its readings or a placeholder
+template <typename Json, typename Readings>
+Json SensorData::build_json_object(TimestampFormat format, Readings readings_of) const {
+    TraceScope trace("construct json");
+    Json json_readings;
+    Json json_temporary;
+    Json json_stats_temporary;
+    // ordered_map copies its entries when it grows (the keys are const), reading arrays included,
+    // so room for all five keys is made first
+    json_readings = Json::object();
+    json_readings.template get_ref<typename Json::object_t&>().reserve(5);
+    // tells a loader how to read the timestamps below
+    json_readings["Timestamp Format"] = timestamp_format_name(format);
     // add readings
-    for (const auto& reading : m_readings.temperature) {
-        json_temporary.push_back( { timepoint_to_string(reading.time_point), reading.value } );
-    }
-    json_readings["Temperature"] = std::move(json_temporary);
-    
-    for (const auto& reading : m_readings.humidity) {
-        json_temporary.push_back( { timepoint_to_string(reading.time_point), reading.value } );
-    }
-    json_readings["Humidity"] = std::move(json_temporary);
-
-    for (const auto& reading : m_readings.windspeed) {
-        json_temporary.push_back( { timepoint_to_string(reading.time_point), reading.value } );
-    }
-    json_readings["Wind Speed"] = std::move(json_temporary);
+    json_readings["Temperature"] = readings_of(SensorId::temperature);
+    json_readings["Humidity"] = readings_of(SensorId::humidity);
+    json_readings["Wind Speed"] = readings_of(SensorId::windspeed);
 
     // add statistics
-    json_temporary["Max"].push_back({m_statistics.temperature.max.value, timepoint_to_string(m_statistics.temperature.max.time_point)});
-    json_temporary["Min"].push_back({m_statistics.temperature.min.value, timepoint_to_string(m_statistics.temperature.min.time_point)});
+    json_temporary["Max"].push_back({m_statistics.temperature.max.value, timepoint_to_json<Json>(m_statistics.temperature.max.time_point, format)});
+    json_temporary["Min"].push_back({m_statistics.temperature.min.value, timepoint_to_json<Json>(m_statistics.temperature.min.time_point, format)});
     json_temporary["Average"].push_back({m_statistics.temperature.average});
     json_stats_temporary["Temperature"] = std::move(json_temporary);
 
-    json_temporary["Max"].push_back({m_statistics.humidity.max.value, timepoint_to_string(m_statistics.humidity.max.time_point)});
-    json_temporary["Min"].push_back({m_statistics.humidity.min.value, timepoint_to_string(m_statistics.humidity.min.time_point)});
+    json_temporary["Max"].push_back({m_statistics.humidity.max.value, timepoint_to_json<Json>(m_statistics.humidity.max.time_point, format)});
+    json_temporary["Min"].push_back({m_statistics.humidity.min.value, timepoint_to_json<Json>(m_statistics.humidity.min.time_point, format)});
     json_temporary["Average"].push_back({m_statistics.humidity.average});
     json_stats_temporary["Humidity"] = std::move(json_temporary);
 
-    json_temporary["Max"].push_back({m_statistics.windspeed.max.value, timepoint_to_string(m_statistics.windspeed.max.time_point)});
-    json_temporary["Min"].push_back({m_statistics.windspeed.min.value, timepoint_to_string(m_statistics.windspeed.min.time_point)});
+    json_temporary["Max"].push_back({m_statistics.windspeed.max.value, timepoint_to_json<Json>(m_statistics.windspeed.max.time_point, format)});
+    json_temporary["Min"].push_back({m_statistics.windspeed.min.value, timepoint_to_json<Json>(m_statistics.windspeed.min.time_point, format)});
     json_temporary["Average"].push_back({m_statistics.windspeed.average});
     json_stats_temporary["Wind Speed"] = std::move(json_temporary);
 
@@ -203,3 +518,23 @@ json SensorData::construct_json_object() const {
 
     return std::move(json_readings);
 }
+
+json SensorData::construct_json_object(TimestampFormat format) const {
+    return build_json_object<json>(format, [&](SensorId id) { return build_readings_json<json>(id, format); });
+}
+
+scratch_json SensorData::construct_scratch_json(TimestampFormat format) const {
+    return build_json_object<scratch_json>(format, [&](SensorId id) { return build_readings_json<scratch_json>(id, format); });
+}
+
+scratch_json SensorData::construct_scratch_skeleton(TimestampFormat format) const {
+    return build_json_object<scratch_json>(format, [](SensorId id) { return scratch_json(readings_placeholder(id)); });
+}
+
+scratch_json SensorData::construct_scratch_readings(SensorId id, TimestampFormat format) const {
+    return build_readings_json<scratch_json>(id, format);
+}
+
+std::string readings_placeholder(SensorId id) {
+    return std::string("\x01readings of ") + sensor_label(id) + "\x01";
+}
@@ -2,6 +2,15 @@
 #define WEATHER_SENSORS_SENSORDATA_H
 #include "structs.h"
 #include "globals.h"
+#include "TimeFormat.h"
+#include "Metrics.h"
+#include "ReadingsHub.h"
+#include "LatestValues.h"
+#include "TimeIndex.h"
+#include "Rollup.h"
+#include "Compression.h"
+#include "ReadingClock.h"
+#include "Allocation.h"
 #include "nlohmann/json.hpp"
 using json = nlohmann::ordered_json;
 
@@ -9,39 +18,110 @@ using json = nlohmann::ordered_json;
  *  Class to store and manipulate sensor data
  *  Specifically: Temperature, Humidity, Wind Speed
  *  New sensor data is stored in m_new_readings
+ *  store_readings() appends a span of readings of one sensor, store_batch() readings of every sensor,
+ *  each under one lock, e.g. what the ingest server decoded in one round
  *  calculate_statistics() updates m_statistics with data from m_new_readings
  *  move_sensor_data() moves data from m_new_readings to m_readings
+ *  replay_readings() rebuilds m_readings and m_statistics from the write-ahead log
+ *  restore_readings() loads them from a snapshot
+ *  metrics() gives the internal counters (ingest rate, backlog, memory, pass durations)
+ *  subscribe() delivers every stored reading to a callback on the subscriber's own thread,
+ *  batches as they are stored and single readings once per statistics pass (publish_stored_readings())
+ *  attach_latest_values() keeps the newest reading of each sensor in a shared memory table
+ *  m_readings is kept in time order with a sparse TimeIndex per sensor,
+ *  range() and range_statistics() answer time range queries from it
+ *  m_rollups keeps count/sum/min/max/last per 1 s, 1 min and 1 h bucket, updated on every commit,
+ *  rollup() reads the coarsest detail a long range needs without touching the readings
+ *  set_compression() thins out what is committed to m_readings with a deadband or swinging door filter,
+ *  statistics, rollups and the write-ahead log still get every reading
+ *  set_quantization() stores the values of m_readings as small integer codes (SensorSeries),
+ *  set_implicit_times() stores their times as periodic runs
+ *  clock() is where store_*_reading() takes timestamps from (system, coarse, TSC or one per batch)
  *  std::lock_guard<std::mutex> used where needed
  */
 
 class SensorData {
 private:
     SensorReadings m_new_readings;
-    SensorReadings m_readings;
-    SensorStatistics m_statistics;
+    SensorReadings m_unpublished;       // single readings not yet handed to subscribers
+    SensorHistory m_readings;
+    SensorStatistics m_statistics {};
+    TimeIndex m_time_index[sensor_count];
+    RollupSeries m_rollups[sensor_count];
+    CompressionFilter m_filters[sensor_count];
+    bool m_pending_in_history[sensor_count] {};     // m_readings ends with the reading the filter holds back
+    Metrics m_metrics;
+    ReadingsHub m_hub;
+    LatestValueTable* m_latest_values{};    // written under sensor_mutex, so there is one writer at a time
+    ReadingClock m_clock;
 
-    void calculate_statistics(Stats& stat, bool& first_reading, 
-                              const std::vector<TimeDouble>& readings, 
-                              const std::vector<TimeDouble>& new_reading);
-    void move_sensor_data(std::vector<TimeDouble>& readings, std::vector<TimeDouble>& new_readings);
-    void print_reading(const std::vector<TimeDouble>& readings, const std::vector<TimeDouble>& new_readings);
+    void move_sensor_data(SensorId id);
+    void commit_readings(SensorId id, const std::vector<TimeDouble>& readings);
+    void update_history_metrics(SensorId id);
+    void index_history(SensorId id, std::size_t appended_from);
+    void print_reading(const SensorSeries& readings, const std::vector<TimeDouble>& new_readings);
     void print_single_statistic(Stats stat);
-    void store_new_reading(double reading, std::vector<TimeDouble>& readings);
-    std::string timepoint_to_string(std::chrono::system_clock::time_point time_point) const;
+    void store_new_reading(double reading, SensorId id);
+    void append_new_readings(SensorId id, std::span<const TimeDouble> readings);
+    template <typename Json>
+    Json timepoint_to_json(std::chrono::system_clock::time_point time_point, TimestampFormat format) const;
+    template <typename Json>
+    Json build_readings_json(SensorId id, TimestampFormat format) const;
+    template <typename Json, typename Readings>
+    Json build_json_object(TimestampFormat format, Readings readings_of) const;
 public:
+    // adds readings to stat, also used by tools that aggregate saved files
+    static void calculate_statistics(Stats& stat, bool& first_reading, std::span<const TimeDouble> new_readings);
     void store_temperature_reading(double reading);
     void store_humidity_reading(double reading);
     void store_windspeed_reading(double reading);
+    void store_readings(SensorId id, std::span<const TimeDouble> readings);
+    void store_readings(SensorId id, std::span<const double> values);
+    void store_batch(const SensorReadings& batch);
     void calculate_temperature_statistic(bool& first_reading);
     void calculate_humidity_statistic(bool& first_reading);
     void calculate_windspeed_statistic(bool& first_reading);
     void move_temperature_data();
     void move_humidity_data();
     void move_windspeed_data();    
+    void copy_new_readings(SensorReadings& batch) const;
+    void publish_stored_readings();
+    void replay_readings(SensorId id, const std::vector<TimeDouble>& readings);
+    void restore_readings(SensorId id, const TimeDouble* readings, std::size_t count, const Stats& stat);
+    const SensorSeries& committed_readings(SensorId id) const;
+    const Stats& statistic(SensorId id) const;
+    bool has_readings(SensorId id) const;
+    ReadingRange range(SensorId id, std::chrono::system_clock::time_point from,
+                       std::chrono::system_clock::time_point to) const;
+    Stats range_statistics(SensorId id, std::chrono::system_clock::time_point from,
+                           std::chrono::system_clock::time_point to) const;
+    std::vector<RollupBucket> rollup(SensorId id, std::chrono::system_clock::time_point from,
+                                     std::chrono::system_clock::time_point to, std::size_t max_points) const;
+    const RollupSeries& rollups(SensorId id) const;
+    void set_rollup_tiers(const std::vector<RollupTierOptions>& tiers);
+    void set_compression(SensorId id, CompressionOptions options);
+    const CompressionFilter& compression(SensorId id) const;
+    bool set_quantization(SensorId id, double step);
+    void set_implicit_times(SensorId id, bool enabled, std::chrono::nanoseconds tolerance);
     void print_latest_readings();
     void print_statistics();
-    json construct_json_object() const;
+    json construct_json_object(TimestampFormat format = TimestampFormat::epoch_ns) const;
+    // same document built in the current ScratchArena, it has to be destroyed before the arena
+    scratch_json construct_scratch_json(TimestampFormat format = TimestampFormat::epoch_ns) const;
+    // the document with the reading arrays replaced by readings_placeholder(), for exports that
+    // serialize the arrays separately with construct_scratch_readings()
+    scratch_json construct_scratch_skeleton(TimestampFormat format = TimestampFormat::epoch_ns) const;
+    scratch_json construct_scratch_readings(SensorId id, TimestampFormat format = TimestampFormat::epoch_ns) const;
+    // readers take a snapshot, the threads that do the work record through the non-const one
+    const Metrics& metrics() const { return m_metrics; }
+    Metrics& metrics() { return m_metrics; }
+    ReadingClock& clock() { return m_clock; }
+    const ReadingClock& clock() const { return m_clock; }
+    Subscription subscribe(ReadingsCallback callback, SubscriberOptions options = {});
+    void attach_latest_values(LatestValueTable* table);
 };
 
+// string that stands in for a sensor's reading array in construct_scratch_skeleton()
+std::string readings_placeholder(SensorId id);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,390 @@
+#include "SensorSeries.h"
+#include <cmath>
+#include <limits>
+#include <sstream>
+#include <type_traits>
+
+namespace {
+    std::chrono::system_clock::time_point time_of(std::int64_t ns) {
+        return std::chrono::system_clock::time_point { std::chrono::nanoseconds { ns } };
+    }
+
+    std::int64_t ns_of(std::chrono::system_clock::time_point time_point) {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(time_point.time_since_epoch()).count();
+    }
+
+    // entry for index in a list of (index, something) pairs kept in index order, end if there is none
+    template <typename Entries>
+    auto find_index(const Entries& entries, std::size_t index) {
+        const auto found { std::lower_bound(entries.begin(), entries.end(), index,
+                                            [](const auto& entry, std::size_t wanted) { return entry.first < wanted; }) };
+        return (found != entries.end() && found->first == index) ? found : entries.end();
+    }
+
+    /**
+     *  Summary straight from the value array: min, max and sum are plain loops the compiler vectorizes,
+     *  the readings behind min and max are found afterwards
+     */
+    template <typename Code, typename TimeAt>
+    BlockSummary summarize_codes(const Code* codes, TimeAt time_at, std::size_t first, std::size_t last,
+                                 double offset, double step) {
+        using Sum = std::conditional_t<std::is_integral_v<Code>, std::int64_t, double>;
+        Code low { codes[first] };
+        Code high { codes[first] };
+        Sum sum{};
+        for (std::size_t i = first; i < last; i++) {
+            low = std::min(low, codes[i]);
+            high = std::max(high, codes[i]);
+            sum += codes[i];
+        }
+        const auto low_index { static_cast<std::size_t>(std::find(codes + first, codes + last, low) - codes) };
+        const auto high_index { static_cast<std::size_t>(std::find(codes + first, codes + last, high) - codes) };
+        const auto count { last - first };
+        return { time_at(first), time_at(last - 1),
+                 { time_at(low_index), offset + low * step }, { time_at(high_index), offset + high * step },
+                 offset * static_cast<double>(count) + step * static_cast<double>(sum), count };
+    }
+}
+
+// the lowest code of the type marks a reading whose value is in m_outliers
+std::int32_t SensorSeries::outlier_code() const {
+    return m_narrow ? std::numeric_limits<std::int16_t>::min() : std::numeric_limits<std::int32_t>::min();
+}
+
+template <typename Change>
+void SensorSeries::convert(Change change) {
+    std::vector<TimeDouble> readings(size());
+    decode(0, readings.size(), readings.data());
+    clear();
+    change();
+    m_split = m_quantized || m_implicit_times;
+    // drop the memory of the storage that is no longer used
+    std::vector<TimeDouble>().swap(m_plain);
+    std::vector<double>().swap(m_values);
+    std::vector<std::int16_t>().swap(m_narrow_codes);
+    std::vector<std::int32_t>().swap(m_wide_codes);
+    std::vector<std::int64_t>().swap(m_times);
+    reserve(readings.size());
+    append(readings);
+}
+
+bool SensorSeries::set_quantization(double step, SensorRange range) {
+    const double half_span { (range.max - range.min) / 2 };
+    if (step > 0 && !(half_span / step < std::numeric_limits<std::int32_t>::max() - 1)) return false;
+    convert([&] {
+        m_quantized = step > 0;
+        m_step = step;
+        m_range = range;
+        // codes are centred on the middle of the range, so -15..30 at 0.01 needs only +-2250
+        m_offset = range.min + half_span;
+        m_narrow = m_quantized && std::ceil(half_span / step) < std::numeric_limits<std::int16_t>::max();
+    });
+    return true;
+}
+
+void SensorSeries::set_implicit_times(bool enabled, std::chrono::nanoseconds tolerance) {
+    convert([&] {
+        m_implicit_times = enabled;
+        m_tolerance_ns = tolerance.count();
+    });
+}
+
+double SensorSeries::value(std::size_t index) const {
+    if (!m_quantized) return m_values[index];
+    const std::int32_t stored { code(index) };
+    if (stored != outlier_code()) return m_offset + stored * m_step;
+    return find_index(m_outliers, index)->second;
+}
+
+std::int64_t SensorSeries::time_ns(std::size_t index) const {
+    if (!m_implicit_times) return m_times[index];
+    if (!m_time_exceptions.empty()) {
+        const auto exception { find_index(m_time_exceptions, index) };
+        if (exception != m_time_exceptions.end()) return exception->second;
+    }
+    const auto run { std::prev(std::upper_bound(m_runs.begin(), m_runs.end(), index,
+                                                [](std::size_t wanted, const TimeRun& entry) { return wanted < entry.first; })) };
+    return run->start_ns + static_cast<std::int64_t>(index - run->first) * run->period_ns;
+}
+
+SensorSeries::const_iterator::const_iterator(const SensorSeries* series, std::size_t index)
+    : m_series { series }, m_index { index } {
+    if (!series->m_implicit_times) return;
+    const auto& runs { series->m_runs };
+    const auto after { std::upper_bound(runs.begin(), runs.end(), index,
+                                        [](std::size_t wanted, const TimeRun& entry) { return wanted < entry.first; }) };
+    m_run = after == runs.begin() ? 0 : static_cast<std::size_t>(after - runs.begin()) - 1;
+    const auto& exceptions { series->m_time_exceptions };
+    const auto exception { std::lower_bound(exceptions.begin(), exceptions.end(), index,
+                                            [](const auto& entry, std::size_t wanted) { return entry.first < wanted; }) };
+    m_exception = static_cast<std::size_t>(exception - exceptions.begin());
+}
+
+// moves the run and exception cursors up to m_index, a step at a time like decode()
+void SensorSeries::const_iterator::follow_times() {
+    const auto& runs { m_series->m_runs };
+    const auto& exceptions { m_series->m_time_exceptions };
+    while (m_run + 1 < runs.size() && runs[m_run + 1].first <= m_index) m_run++;
+    while (m_exception < exceptions.size() && exceptions[m_exception].first < m_index) m_exception++;
+}
+
+TimeDouble SensorSeries::const_iterator::split_reading() const {
+    if (!m_series->m_implicit_times) return (*m_series)[m_index];
+    const auto& exceptions { m_series->m_time_exceptions };
+    std::int64_t ns{};
+    if (m_exception < exceptions.size() && exceptions[m_exception].first == m_index) {
+        ns = exceptions[m_exception].second;
+    } else {
+        const TimeRun& run { m_series->m_runs[m_run] };
+        ns = run.start_ns + static_cast<std::int64_t>(m_index - run.first) * run.period_ns;
+    }
+    return { time_of(ns), m_series->value(m_index) };
+}
+
+TimeDouble SensorSeries::operator[](std::size_t index) const {
+    if (!m_split) return m_plain[index];
+    return { time_of(time_ns(index)), value(index) };
+}
+
+std::chrono::system_clock::time_point SensorSeries::time_point(std::size_t index) const {
+    return m_split ? time_of(time_ns(index)) : m_plain[index].time_point;
+}
+
+void SensorSeries::decode(std::size_t first, std::size_t last, TimeDouble* out) const {
+    if (!m_split) {
+        std::copy(m_plain.begin() + static_cast<std::ptrdiff_t>(first), m_plain.begin() + static_cast<std::ptrdiff_t>(last), out);
+        return;
+    }
+    for (std::size_t i = first; i < last; i++) out[i - first].value = value(i);
+    if (!m_implicit_times) {
+        for (std::size_t i = first; i < last; i++) out[i - first].time_point = time_of(m_times[i]);
+        return;
+    }
+    if (first == last) return;
+    // walk the runs and exceptions alongside instead of looking each reading up
+    auto run { std::prev(std::upper_bound(m_runs.begin(), m_runs.end(), first,
+                                          [](std::size_t wanted, const TimeRun& entry) { return wanted < entry.first; })) };
+    auto exception { std::lower_bound(m_time_exceptions.begin(), m_time_exceptions.end(), first,
+                                      [](const auto& entry, std::size_t wanted) { return entry.first < wanted; }) };
+    for (std::size_t i = first; i < last; i++) {
+        if (std::next(run) != m_runs.end() && std::next(run)->first == i) ++run;
+        std::int64_t ns { run->start_ns + static_cast<std::int64_t>(i - run->first) * run->period_ns };
+        if (exception != m_time_exceptions.end() && exception->first == i) ns = (exception++)->second;
+        out[i - first].time_point = time_of(ns);
+    }
+}
+
+/**
+ *  A reading on its run's cadence costs nothing. One off the cadence becomes an exception; when the
+ *  next one is off as well the cadence itself moved (a restart, drift), so the first of the two
+ *  starts a new run and the second gives its period
+ */
+void SensorSeries::append_time(std::size_t index, std::int64_t ns) {
+    if (!m_implicit_times) {
+        m_times.push_back(ns);
+        return;
+    }
+    if (m_runs.empty()) {
+        m_runs.push_back({ index, ns, 0 });
+        return;
+    }
+    TimeRun& run { m_runs.back() };
+    const auto position { static_cast<std::int64_t>(index - run.first) };
+    if (run.period_ns == 0) {
+        if (position == 1 && ns > run.start_ns) run.period_ns = ns - run.start_ns;
+        else m_runs.push_back({ index, ns, 0 });
+        return;
+    }
+    if (std::abs(ns - (run.start_ns + position * run.period_ns)) <= m_tolerance_ns) return;
+    if (m_time_exceptions.empty() || m_time_exceptions.back().first + 1 != index) {
+        m_time_exceptions.emplace_back(index, ns);
+        return;
+    }
+    const auto [previous_index, previous_ns] { m_time_exceptions.back() };
+    const std::int64_t period { ns - previous_ns };
+    if (period <= 0) {
+        m_runs.push_back({ index, ns, 0 });
+        return;
+    }
+    m_time_exceptions.pop_back();
+    // on the same cadence (drift) the period over the whole old run is more exact than one step
+    const std::int64_t average { (previous_ns - run.start_ns) / static_cast<std::int64_t>(previous_index - run.first) };
+    const bool same_cadence { std::abs(period - average) <= m_tolerance_ns };
+    m_runs.push_back({ previous_index, previous_ns, same_cadence ? average : period });
+}
+
+void SensorSeries::append_split(const TimeDouble& reading) {
+    const std::size_t index { m_size++ };
+    append_time(index, ns_of(reading.time_point));
+    if (!m_quantized) {
+        m_values.push_back(reading.value);
+        return;
+    }
+    std::int32_t stored { outlier_code() };
+    // outside the range (or NaN) the value is kept exactly
+    if (reading.value >= m_range.min && reading.value <= m_range.max) {
+        stored = static_cast<std::int32_t>(std::lround((reading.value - m_offset) / m_step));
+    } else {
+        m_outliers.emplace_back(index, reading.value);
+    }
+    if (m_narrow) m_narrow_codes.push_back(static_cast<std::int16_t>(stored));
+    else m_wide_codes.push_back(stored);
+}
+
+void SensorSeries::append(std::span<const TimeDouble> readings) {
+    if (!m_split) {
+        m_plain.insert(m_plain.end(), readings.begin(), readings.end());
+        return;
+    }
+    for (const TimeDouble& reading : readings) append_split(reading);
+}
+
+void SensorSeries::truncate(std::size_t size) {
+    if (!m_split) {
+        m_plain.resize(std::min(size, m_plain.size()));
+        return;
+    }
+    m_size = std::min(size, m_size);
+    if (m_quantized && m_narrow) m_narrow_codes.resize(m_size);
+    else if (m_quantized) m_wide_codes.resize(m_size);
+    else m_values.resize(m_size);
+    while (!m_outliers.empty() && m_outliers.back().first >= m_size) m_outliers.pop_back();
+    if (!m_implicit_times) {
+        m_times.resize(m_size);
+        return;
+    }
+    while (!m_runs.empty() && m_runs.back().first >= m_size) m_runs.pop_back();
+    while (!m_time_exceptions.empty() && m_time_exceptions.back().first >= m_size) m_time_exceptions.pop_back();
+    // a run left with one reading learns its period again from the next one
+    if (!m_runs.empty() && m_runs.back().first + 1 == m_size) m_runs.back().period_ns = 0;
+}
+
+void SensorSeries::reserve(std::size_t count) {
+    if (!m_split) {
+        m_plain.reserve(count);
+        return;
+    }
+    if (m_quantized && m_narrow) m_narrow_codes.reserve(count);
+    else if (m_quantized) m_wide_codes.reserve(count);
+    else m_values.reserve(count);
+    if (!m_implicit_times) m_times.reserve(count);
+}
+
+std::size_t SensorSeries::memory_bytes() const {
+    return m_plain.capacity() * sizeof(TimeDouble) + m_values.capacity() * sizeof(double)
+         + m_narrow_codes.capacity() * sizeof(std::int16_t) + m_wide_codes.capacity() * sizeof(std::int32_t)
+         + m_outliers.capacity() * sizeof(std::pair<std::size_t, double>)
+         + m_times.capacity() * sizeof(std::int64_t) + m_runs.capacity() * sizeof(TimeRun)
+         + m_time_exceptions.capacity() * sizeof(std::pair<std::size_t, std::int64_t>);
+}
+
+std::size_t SensorSeries::lower_bound(std::chrono::system_clock::time_point time_point, std::size_t first,
+                                      std::size_t last) const {
+    if (!m_split) {
+        const auto found { std::partition_point(m_plain.begin() + static_cast<std::ptrdiff_t>(first),
+                                                m_plain.begin() + static_cast<std::ptrdiff_t>(last),
+                                                [time_point](const TimeDouble& reading) { return reading.time_point < time_point; }) };
+        return static_cast<std::size_t>(found - m_plain.begin());
+    }
+    const std::int64_t wanted { ns_of(time_point) };
+    if (!m_implicit_times) {
+        const auto found { std::lower_bound(m_times.begin() + static_cast<std::ptrdiff_t>(first),
+                                            m_times.begin() + static_cast<std::ptrdiff_t>(last), wanted) };
+        return static_cast<std::size_t>(found - m_times.begin());
+    }
+    while (first < last) {
+        const std::size_t middle { first + (last - first) / 2 };
+        if (time_ns(middle) < wanted) first = middle + 1;
+        else last = middle;
+    }
+    return first;
+}
+
+BlockSummary SensorSeries::summarize(std::size_t first, std::size_t last) const {
+    auto time_at = [this](std::size_t index) { return time_point(index); };
+    if (m_split && !m_quantized) return summarize_codes(m_values.data(), time_at, first, last, 0.0, 1.0);
+    if (m_quantized) {
+        const auto outlier { std::lower_bound(m_outliers.begin(), m_outliers.end(), first,
+                                              [](const std::pair<std::size_t, double>& entry, std::size_t wanted) {
+                                                  return entry.first < wanted;
+                                              }) };
+        const bool has_outlier { outlier != m_outliers.end() && outlier->first < last };
+        if (!has_outlier && m_narrow) return summarize_codes(m_narrow_codes.data(), time_at, first, last, m_offset, m_step);
+        if (!has_outlier) return summarize_codes(m_wide_codes.data(), time_at, first, last, m_offset, m_step);
+    }
+    const TimeDouble front_reading { (*this)[first] };
+    BlockSummary block { front_reading.time_point, time_point(last - 1), front_reading, front_reading, 0.0, last - first };
+    for (std::size_t i = first; i < last; i++) {
+        const TimeDouble reading { (*this)[i] };
+        if (reading.value < block.min.value) block.min = reading;
+        if (reading.value > block.max.value) block.max = reading;
+        block.sum += reading.value;
+    }
+    return block;
+}
+
+std::size_t SensorSeries::restore_order(std::size_t appended_from) {
+    auto by_time = [](const TimeDouble& a, const TimeDouble& b) { return a.time_point < b.time_point; };
+    if (!m_split) {
+        const auto appended { m_plain.begin() + static_cast<std::ptrdiff_t>(appended_from) };
+        if (!std::is_sorted(appended, m_plain.end(), by_time)) std::stable_sort(appended, m_plain.end(), by_time);
+        if (appended == m_plain.begin() || appended == m_plain.end() || !by_time(*appended, *(appended - 1))) {
+            return appended_from;
+        }
+        const auto merge_from { std::upper_bound(m_plain.begin(), appended, *appended, by_time) };
+        std::inplace_merge(merge_from, appended, m_plain.end(), by_time);
+        return static_cast<std::size_t>(merge_from - m_plain.begin());
+    }
+    std::vector<TimeDouble> late(size() - appended_from);
+    decode(appended_from, size(), late.data());
+    const bool after_history { appended_from == 0 || late.empty()
+                               || time_ns(appended_from - 1) <= ns_of(late.front().time_point) };
+    if (after_history && std::is_sorted(late.begin(), late.end(), by_time)) return appended_from;
+    // late readings: merge the tail that changes and store it again
+    std::stable_sort(late.begin(), late.end(), by_time);
+    const std::size_t merge_from { lower_bound(late.front().time_point + std::chrono::nanoseconds { 1 }, 0, appended_from) };
+    std::vector<TimeDouble> tail(appended_from - merge_from);
+    decode(merge_from, appended_from, tail.data());
+    std::vector<TimeDouble> merged;
+    merged.reserve(tail.size() + late.size());
+    std::merge(tail.begin(), tail.end(), late.begin(), late.end(), std::back_inserter(merged), by_time);
+    truncate(merge_from);
+    append(merged);
+    return merge_from;
+}
+
+bool parse_sensor_numbers(const std::string& text, double (&numbers)[sensor_count]) {
+    double parsed[sensor_count];
+    std::copy(std::begin(numbers), std::end(numbers), std::begin(parsed));
+    std::istringstream input { text };
+    std::string item;
+    bool any{};
+    while (std::getline(input, item, ',')) {
+        // optional sensor= prefix, otherwise the number is for every sensor
+        std::string sensor;
+        if (const auto equals { item.find('=') }; equals != std::string::npos) {
+            sensor = item.substr(0, equals);
+            item = item.substr(equals + 1);
+        }
+        double number{};
+        std::size_t used{};
+        try {
+            number = std::stod(item, &used);
+        } catch (const std::exception&) {
+            return false;
+        }
+        if (used != item.size() || !(number >= 0)) return false;
+        bool matched{};
+        for (SensorId id : all_sensors) {
+            if (sensor.empty() || sensor == sensor_label(id)) {
+                parsed[static_cast<std::size_t>(id)] = number;
+                matched = true;
+            }
+        }
+        if (!matched) return false;
+        any = true;
+    }
+    if (!any) return false;
+    std::copy(std::begin(parsed), std::end(parsed), std::begin(numbers));
+    return true;
+}
@@ -0,0 +1,168 @@
+#ifndef WEATHER_SENSORS_SENSORSERIES_H
+#define WEATHER_SENSORS_SENSORSERIES_H
+#include "structs.h"
+#include <iterator>
+#include <span>
+#include <string>
+
+// summary of a run of readings, the time index keeps one per block
+struct BlockSummary {
+    std::chrono::system_clock::time_point first;    // time of the first and last reading, the history is in time order
+    std::chrono::system_clock::time_point last;
+    TimeDouble min;
+    TimeDouble max;
+    double sum;
+    std::size_t count;
+};
+
+// readings [first, next run) were taken at start_ns + n * period_ns, period 0 until the second reading
+struct TimeRun {
+    std::size_t first;
+    std::int64_t start_ns;
+    std::int64_t period_ns;
+};
+
+/**
+ *  Committed history of one sensor
+ *  By default an array of TimeDouble. Otherwise times and values are kept in separate arrays:
+ *  set_quantization() stores the values as 16 bit (32 bit for wide ranges) codes,
+ *  value = offset + code * step, values outside the sensor range are kept exactly as outliers
+ *  set_implicit_times() stores the times as runs of a start time and a period, a reading more
+ *  than the tolerance off its run is kept as an exception, two in a row start a new run
+ *  Readers go through operator[], decode() or the iterator; contiguous() gives the plain array
+ *  without copying when there is one. With implicit times operator[] is O(log runs), decode()
+ *  and the iterator walk the runs
+ */
+class SensorSeries {
+private:
+    std::vector<TimeDouble> m_plain;
+    // split storage, used when values are quantized or times are implicit
+    bool m_split{};
+    std::size_t m_size{};
+    // values
+    bool m_quantized{};
+    bool m_narrow{};                // codes fit m_narrow_codes
+    double m_offset{};
+    double m_step{};
+    SensorRange m_range{};
+    std::vector<double> m_values;   // values that are not quantized
+    std::vector<std::int16_t> m_narrow_codes;
+    std::vector<std::int32_t> m_wide_codes;
+    std::vector<std::pair<std::size_t, double>> m_outliers;    // index and value, in index order
+    // times
+    bool m_implicit_times{};
+    std::int64_t m_tolerance_ns{};
+    std::vector<std::int64_t> m_times;      // times that are not implicit
+    std::vector<TimeRun> m_runs;
+    std::vector<std::pair<std::size_t, std::int64_t>> m_time_exceptions;   // index and time, in index order
+
+    std::int32_t code(std::size_t index) const { return m_narrow ? m_narrow_codes[index] : m_wide_codes[index]; }
+    std::int32_t outlier_code() const;
+    double value(std::size_t index) const;
+    std::int64_t time_ns(std::size_t index) const;
+    void append_split(const TimeDouble& reading);
+    void append_time(std::size_t index, std::int64_t ns);
+    // converts the stored readings after change() switched the storage
+    template <typename Change>
+    void convert(Change change);
+public:
+    /**
+     *  Walks the time runs and exceptions along with the index, so implicit times cost the same
+     *  per reading as stored ones; operator[] has to search the runs for every reading
+     */
+    class const_iterator {
+    private:
+        const SensorSeries* m_series{};
+        std::size_t m_index{};
+        std::size_t m_run{};            // run holding m_index
+        std::size_t m_exception{};      // first time exception at or after m_index
+
+        TimeDouble split_reading() const;
+        void follow_times();
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = TimeDouble;
+        using difference_type = std::ptrdiff_t;
+        using reference = TimeDouble;
+        using pointer = void;
+        const_iterator() = default;
+        const_iterator(const SensorSeries* series, std::size_t index);
+        TimeDouble operator*() const { return m_series->m_split ? split_reading() : m_series->m_plain[m_index]; }
+        const_iterator& operator++() {
+            m_index++;
+            if (m_series->m_implicit_times) follow_times();
+            return *this;
+        }
+        const_iterator operator++(int) { const_iterator previous { *this }; ++*this; return previous; }
+        bool operator==(const const_iterator& other) const { return m_index == other.m_index; }
+    };
+
+    /**
+     *  Stores values as codes of step within range from now on, the readings already stored are converted
+     *  step 0 goes back to doubles, false if range / step does not fit 32 bit codes
+     */
+    bool set_quantization(double step, SensorRange range);
+    bool quantized() const { return m_quantized; }
+    double step() const { return m_step; }
+    /**
+     *  Stores times as periodic runs from now on, readings further than tolerance from their run
+     *  keep their own time, the readings already stored are converted; enabled false goes back to times
+     */
+    void set_implicit_times(bool enabled, std::chrono::nanoseconds tolerance = {});
+    bool implicit_times() const { return m_implicit_times; }
+    const std::vector<TimeRun>& time_runs() const { return m_runs; }
+    std::size_t time_exceptions() const { return m_time_exceptions.size(); }
+
+    std::size_t size() const { return m_split ? m_size : m_plain.size(); }
+    bool empty() const { return size() == 0; }
+    TimeDouble operator[](std::size_t index) const;
+    std::chrono::system_clock::time_point time_point(std::size_t index) const;
+    TimeDouble front() const { return (*this)[0]; }
+    TimeDouble back() const { return (*this)[size() - 1]; }
+    const_iterator begin() const { return { this, 0 }; }
+    const_iterator end() const { return { this, size() }; }
+    // the readings as one array, nullptr when they are quantized
+    const TimeDouble* contiguous() const { return m_split ? nullptr : m_plain.data(); }
+    // copies readings [first, last) to out
+    void decode(std::size_t first, std::size_t last, TimeDouble* out) const;
+
+    void append(std::span<const TimeDouble> readings);
+    void push_back(const TimeDouble& reading) { append({ &reading, 1 }); }
+    void pop_back() { truncate(size() - 1); }
+    void truncate(std::size_t size);
+    void clear() { truncate(0); }
+    void reserve(std::size_t count);
+    std::size_t memory_bytes() const;
+
+    // index of the first reading in [first, last) at or after time_point, last if there is none
+    std::size_t lower_bound(std::chrono::system_clock::time_point time_point, std::size_t first, std::size_t last) const;
+    // max, min, sum and count of readings [first, last), which must not be empty
+    BlockSummary summarize(std::size_t first, std::size_t last) const;
+    /**
+     *  Puts the readings back in time order after some were appended at appended_from
+     *  Returns the index of the first reading that moved, appended_from if they were in order
+     */
+    std::size_t restore_order(std::size_t appended_from);
+};
+
+// struct is used in SensorData class, like SensorReadings
+struct SensorHistory {
+    SensorSeries temperature;
+    SensorSeries humidity;
+    SensorSeries windspeed;
+
+    SensorSeries& operator[](SensorId id) {
+        return id == SensorId::temperature ? temperature : id == SensorId::humidity ? humidity : windspeed;
+    }
+    const SensorSeries& operator[](SensorId id) const {
+        return id == SensorId::temperature ? temperature : id == SensorId::humidity ? humidity : windspeed;
+    }
+};
+
+/**
+ *  A number for every sensor ("0.01") or per sensor ("temperature=0.01,windspeed=0.1"),
+ *  used for --quantize steps and --implicit-times tolerances, false if malformed or negative
+ */
+bool parse_sensor_numbers(const std::string& text, double (&numbers)[sensor_count]);
+
+#endif
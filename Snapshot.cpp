@@ -0,0 +1,280 @@
+#include "Snapshot.h"
+#include "SensorData.h"
+#include "Crc32.h"
+#include "TimeFormat.h"
+#include <cstring>
+#include <fstream>
+#include <cstddef>
+#include <climits>
+#include <cerrno>
+#include <type_traits>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+// the readings are written straight from memory, so TimeDouble must be (i64 ns, f64)
+static_assert(std::is_same_v<std::chrono::system_clock::duration, std::chrono::nanoseconds>);
+static_assert(sizeof(TimeDouble) == 16 && std::is_trivially_copyable_v<TimeDouble>);
+
+namespace {
+    constexpr char snapshot_magic[8] { 'W', 'S', 'S', 'N', 'A', 'P', '0', '1' };
+    // version 2 added the identity of the write-ahead log
+    constexpr std::uint32_t snapshot_version { 2 };
+    constexpr std::uint64_t data_alignment { 64 };
+
+    struct SnapshotSensor {
+        std::uint64_t count;
+        std::uint64_t data_offset;
+        std::int64_t max_ns;
+        double max_value;
+        std::int64_t min_ns;
+        double min_value;
+        double average;
+        std::uint64_t statistic_count;
+    };
+
+    struct SnapshotHeader {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t sensors;
+        std::uint64_t wal_offset;
+        std::uint64_t wal_device;
+        std::uint64_t wal_inode;
+        std::uint32_t wal_first_crc;
+        std::uint32_t wal_padding;
+        std::int64_t created_ns;
+        SnapshotSensor sensor[sensor_count];
+        std::uint32_t crc;          // over every byte before this field
+        std::uint32_t padding;
+    };
+
+    std::uint64_t align_up(std::uint64_t value) {
+        return (value + data_alignment - 1) / data_alignment * data_alignment;
+    }
+
+    bool write_all(int fd, iovec* parts, int count) {
+        while (count > 0) {
+            ssize_t written { ::writev(fd, parts, std::min(count, IOV_MAX)) };
+            if (written < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            // skip the parts that were written completely, adjust the first partial one
+            auto remaining { static_cast<std::size_t>(written) };
+            while (count > 0 && remaining >= parts->iov_len) {
+                remaining -= parts->iov_len;
+                parts++;
+                count--;
+            }
+            if (count > 0) {
+                parts->iov_base = static_cast<char*>(parts->iov_base) + remaining;
+                parts->iov_len -= remaining;
+            }
+        }
+        return true;
+    }
+
+    // write() on the file write_snapshot() writes itself
+    class FdOutput : public FileOutput {
+    private:
+        int m_fd;
+    public:
+        explicit FdOutput(int fd) : m_fd { fd } {}
+        bool write(const void* data, std::size_t size) override {
+            iovec part { const_cast<void*>(data), size };
+            return write_all(m_fd, &part, 1);
+        }
+    };
+
+    // header of data as it is now, O(1) per sensor, the readings follow at the data offsets
+    void fill_header(SnapshotHeader& header, const SensorData& data, const WalPosition& wal) {
+        header = {};
+        std::memcpy(header.magic, snapshot_magic, sizeof(snapshot_magic));
+        header.version = snapshot_version;
+        header.sensors = sensor_count;
+        header.wal_offset = wal.offset;
+        header.wal_device = wal.log.device;
+        header.wal_inode = wal.log.inode;
+        header.wal_first_crc = wal.log.first_crc;
+        header.created_ns = to_epoch_ns(std::chrono::system_clock::now());
+
+        std::uint64_t offset { sizeof(header) };
+        for (std::size_t i = 0; i < sensor_count; i++) {
+            const std::size_t count { data.committed_readings(all_sensors[i]).size() };
+            const Stats& stat { data.statistic(all_sensors[i]) };
+            header.sensor[i] = { count, align_up(offset),
+                                 to_epoch_ns(stat.max.time_point), stat.max.value,
+                                 to_epoch_ns(stat.min.time_point), stat.min.value,
+                                 stat.average, stat.count };
+            offset = header.sensor[i].data_offset + count * sizeof(TimeDouble);
+        }
+        header.crc = crc32(&header, offsetof(SnapshotHeader, crc));
+    }
+
+    /**
+     *  Writes the file described by header, the readings straight from the history of data
+     *  Quantized histories and implicit times are decoded a chunk at a time, the file always holds TimeDouble
+     */
+    bool write_parts(FileOutput& output, const SnapshotHeader& header, const SensorData& data) {
+        static const char zeros[data_alignment] {};
+        std::vector<TimeDouble> decoded;
+        if (!output.write(&header, sizeof(header))) return false;
+        std::uint64_t offset { sizeof(header) };
+        for (std::size_t i = 0; i < sensor_count; i++) {
+            const SnapshotSensor& sensor { header.sensor[i] };
+            const SensorSeries& readings { data.committed_readings(all_sensors[i]) };
+            if (!output.write(zeros, sensor.data_offset - offset)) return false;
+            if (const TimeDouble* plain { readings.contiguous() }) {
+                if (!output.write(plain, sensor.count * sizeof(TimeDouble))) return false;
+            }
+            else {
+                decoded.resize(std::min<std::size_t>(sensor.count, 65536));
+                for (std::size_t first = 0; first < sensor.count; first += decoded.size()) {
+                    const std::size_t count { std::min(decoded.size(), sensor.count - first) };
+                    readings.decode(first, first + count, decoded.data());
+                    if (!output.write(decoded.data(), count * sizeof(TimeDouble))) return false;
+                }
+            }
+            offset = sensor.data_offset + sensor.count * sizeof(TimeDouble);
+        }
+        return true;
+    }
+}
+
+bool write_snapshot(const std::string& path, const SensorData& data, const WalPosition& wal) {
+    SnapshotHeader header;
+    fill_header(header, data, wal);
+
+    const std::string temporary_path { path + ".tmp" };
+    int fd { ::open(temporary_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644) };
+    if (fd < 0) {
+        std::cerr << "Could not create snapshot " << temporary_path << ": " << std::strerror(errno) << "\n";
+        return false;
+    }
+    FdOutput output { fd };
+    bool ok { write_parts(output, header, data) && ::fdatasync(fd) == 0 };
+    ::close(fd);
+    if (!ok || std::rename(temporary_path.c_str(), path.c_str()) != 0) {
+        std::cerr << "Could not write snapshot " << path << ": " << std::strerror(errno) << "\n";
+        ::unlink(temporary_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+std::vector<std::uint8_t> encode_snapshot(const SensorData& data, const WalPosition& wal) {
+    SnapshotHeader header;
+    fill_header(header, data, wal);
+    const SnapshotSensor& last { header.sensor[sensor_count - 1] };
+    std::vector<std::uint8_t> bytes(last.data_offset + last.count * sizeof(TimeDouble));
+    std::memcpy(bytes.data(), &header, sizeof(header));
+    for (std::size_t i = 0; i < sensor_count; i++) {
+        const SensorSeries& readings { data.committed_readings(all_sensors[i]) };
+        auto* target { reinterpret_cast<TimeDouble*>(bytes.data() + header.sensor[i].data_offset) };
+        readings.decode(0, readings.size(), target);
+    }
+    return bytes;
+}
+
+QueuedSnapshot queue_snapshot(const std::string& path, const SensorData& data, const WalPosition& wal,
+                              AsyncWriter& writer) {
+    auto header { std::make_shared<SnapshotHeader>() };
+    fill_header(*header, data, wal);
+    // also ready when the request is dropped without writing, the promise is then broken
+    auto released { std::make_shared<std::promise<void>>() };
+    QueuedSnapshot queued;
+    queued.released = released->get_future().share();
+    queued.written = writer.write_file(path, [header, released, &data](FileOutput& output) {
+        const bool ok { write_parts(output, *header, data) };
+        released->set_value();
+        return ok;
+    }, true);
+    return queued;
+}
+
+void SnapshotFile::close() {
+    if (m_mapped) ::munmap(m_mapped, m_size);
+    m_mapped = nullptr;
+    m_size = 0;
+    for (auto& readings : m_readings) readings = {};
+}
+
+bool SnapshotFile::open(const std::string& path, bool populate) {
+    close();
+    m_error.clear();
+    int fd { ::open(path.c_str(), O_RDONLY | O_CLOEXEC) };
+    if (fd < 0) return false;
+
+    struct stat file_stat {};
+    ::fstat(fd, &file_stat);
+    const auto file_size { static_cast<std::uint64_t>(file_stat.st_size) };
+    if (file_size < sizeof(SnapshotHeader)) {
+        ::close(fd);
+        return false;
+    }
+    void* mapped { ::mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE | (populate ? MAP_POPULATE : 0), fd, 0) };
+    ::close(fd);
+    if (mapped == MAP_FAILED) {
+        m_error = "Could not map snapshot " + path + ": " + std::strerror(errno);
+        return false;
+    }
+    m_mapped = mapped;
+    m_size = file_size;
+
+    const auto* bytes { static_cast<const std::uint8_t*>(mapped) };
+    SnapshotHeader header;
+    std::memcpy(&header, bytes, sizeof(header));
+    bool valid { std::memcmp(header.magic, snapshot_magic, sizeof(snapshot_magic)) == 0 &&
+                 header.version == snapshot_version && header.sensors == sensor_count &&
+                 header.crc == crc32(&header, offsetof(SnapshotHeader, crc)) };
+    for (std::size_t i = 0; valid && i < sensor_count; i++) {
+        const SnapshotSensor& sensor { header.sensor[i] };
+        valid = sensor.data_offset % alignof(TimeDouble) == 0 &&
+                sensor.data_offset + sensor.count * sizeof(TimeDouble) <= file_size;
+    }
+    if (!valid) {
+        m_error = "Snapshot " + path + " is not valid and was ignored";
+        close();
+        return false;
+    }
+
+    for (std::size_t i = 0; i < sensor_count; i++) {
+        const SnapshotSensor& sensor { header.sensor[i] };
+        m_readings[i] = { reinterpret_cast<const TimeDouble*>(bytes + sensor.data_offset), sensor.count };
+        Stats& stat { m_statistics[i] };
+        stat.max = { from_epoch_ns(sensor.max_ns), sensor.max_value };
+        stat.min = { from_epoch_ns(sensor.min_ns), sensor.min_value };
+        stat.average = sensor.average;
+        stat.count = sensor.statistic_count;
+    }
+    m_wal = { { header.wal_device, header.wal_inode, header.wal_first_crc }, header.wal_offset };
+    return true;
+}
+
+bool is_snapshot(const std::string& path) {
+    char magic[sizeof(snapshot_magic)] {};
+    std::ifstream file(path, std::ios::binary);
+    return file.read(magic, sizeof(magic)) && std::memcmp(magic, snapshot_magic, sizeof(snapshot_magic)) == 0;
+}
+
+SnapshotInfo load_snapshot(const std::string& path, SensorData& data) {
+    SnapshotInfo info;
+    const auto start { std::chrono::steady_clock::now() };
+    SnapshotFile file;
+    if (!file.open(path, true)) {
+        if (!file.error().empty()) std::cerr << file.error() << "\n";
+        return info;
+    }
+    for (SensorId id : all_sensors) {
+        const std::span<const TimeDouble> readings { file.readings(id) };
+        data.restore_readings(id, readings.data(), readings.size(), file.statistic(id));
+        info.readings += readings.size();
+    }
+
+    info.loaded = true;
+    info.wal = file.wal();
+    info.duration = std::chrono::steady_clock::now() - start;
+    return info;
+}
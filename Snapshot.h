@@ -0,0 +1,88 @@
+#ifndef WEATHER_SENSORS_SNAPSHOT_H
+#define WEATHER_SENSORS_SNAPSHOT_H
+#include "structs.h"
+#include "AsyncWriter.h"
+#include "WriteAheadLog.h"
+#include <string>
+#include <span>
+
+class SensorData;
+
+/**
+ *  Where and how often the statistics thread writes snapshots
+ *  An empty path disables snapshots
+ */
+struct SnapshotOptions {
+    std::string path;
+    int every_passes { 12 };        // one snapshot per minute with the 5 s statistics pass
+};
+
+struct SnapshotInfo {
+    bool loaded{};
+    std::size_t readings{};
+    WalPosition wal;                // records of this log from the offset on are newer than the snapshot
+    std::chrono::nanoseconds duration{};
+};
+
+/**
+ *  Compact binary image of SensorData: a header with the Stats of every sensor
+ *  followed by the raw readings as (i64 epoch ns, f64 value) arrays
+ *  The header records the position and identity of the write-ahead log, none when it was off
+ *  The arrays have the memory layout of TimeDouble, so loading is an mmap and a copy
+ *  The file is written to path.tmp, fsynced and renamed, so a crash never leaves half a snapshot
+ *  Note: reads SensorData without the mutex, call from the statistics thread or after it stopped
+ */
+bool write_snapshot(const std::string& path, const SensorData& data, const WalPosition& wal);
+
+// the same file image in memory
+std::vector<std::uint8_t> encode_snapshot(const SensorData& data, const WalPosition& wal);
+
+// a snapshot handed to the file writer
+struct QueuedSnapshot {
+    std::future<bool> written;          // the file is on disk under its name
+    std::shared_future<void> released;  // the history of data is no longer read and may change again
+};
+
+/**
+ *  Takes the header on the calling thread and leaves the rest to writer: the readings are written
+ *  straight from the history of data on the writer thread, without a copy, then fsynced and renamed
+ *  Note: the statistics thread must not move readings into the history before released is ready
+ */
+QueuedSnapshot queue_snapshot(const std::string& path, const SensorData& data, const WalPosition& wal,
+                              AsyncWriter& writer);
+
+// loads a snapshot into data, returns loaded == false if there is no valid snapshot
+SnapshotInfo load_snapshot(const std::string& path, SensorData& data);
+
+// true if the file starts with the snapshot magic, whatever its name
+bool is_snapshot(const std::string& path);
+
+/**
+ *  Read-only mapping of a snapshot file, the readings are used in place without a copy
+ *  and stay valid while the object lives
+ */
+class SnapshotFile {
+private:
+    void* m_mapped{};
+    std::size_t m_size{};
+    WalPosition m_wal;
+    std::span<const TimeDouble> m_readings[sensor_count];
+    Stats m_statistics[sensor_count]{};
+    std::string m_error;
+    void close();
+public:
+    SnapshotFile() = default;
+    ~SnapshotFile() { close(); }
+    SnapshotFile(const SnapshotFile&) = delete;
+    SnapshotFile& operator=(const SnapshotFile&) = delete;
+    // false if there is no valid snapshot at path, populate faults the whole file in up front
+    bool open(const std::string& path, bool populate = false);
+    // why open() failed, empty if there is no file or it is too short to be a snapshot
+    const std::string& error() const { return m_error; }
+    std::span<const TimeDouble> readings(SensorId id) const { return m_readings[static_cast<std::size_t>(id)]; }
+    const Stats& statistic(SensorId id) const { return m_statistics[static_cast<std::size_t>(id)]; }
+    const WalPosition& wal() const { return m_wal; }
+    std::size_t size_bytes() const { return m_size; }
+};
+
+#endif
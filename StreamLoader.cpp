@@ -0,0 +1,207 @@
+#include "StreamLoader.h"
+#include <cstring>
+#include <cerrno>
+#include <cmath>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace {
+    nlohmann::detail::input_format_t input_format(SaveFormat format) {
+        using nlohmann::detail::input_format_t;
+        switch (format) {
+            case SaveFormat::json:    return input_format_t::json;
+            case SaveFormat::cbor:    return input_format_t::cbor;
+            case SaveFormat::msgpack: return input_format_t::msgpack;
+            case SaveFormat::ubjson:  return input_format_t::ubjson;
+            case SaveFormat::bjdata:  return input_format_t::bjdata;
+        }
+        return input_format_t::json;
+    }
+
+    /**
+     *  SAX handler for the save file: [ { "Timestamp Format": .., "Temperature": [[time, value], ..], .. } ]
+     *  Only the depth and the current key are tracked, a reading is complete at the end of its pair
+     */
+    class SaveFileHandler {
+    private:
+        enum class Section { none, timestamp_format, readings, other };
+
+        const ReadingsSink& m_sink;
+        const StreamLoadOptions& m_options;
+        StreamLoadResult& m_result;
+        int m_depth{};
+        int m_document_depth{};             // depth inside the document object, 0 until it starts
+        Section m_section { Section::none };
+        SensorId m_sensor { SensorId::temperature };
+        int m_field{};                      // values seen in the current pair
+        TimeDouble m_reading{};
+        std::vector<TimeDouble> m_chunk;
+        // "%c" strings have second resolution, neighbouring readings mostly repeat the last one
+        std::string m_local_text;
+        std::chrono::system_clock::time_point m_local_time;
+
+        bool in_pair() const { return m_section == Section::readings && m_depth == m_document_depth + 2; }
+
+        bool fail(std::string message) {
+            m_result.error = std::move(message);
+            return false;
+        }
+
+        bool flush() {
+            if (m_chunk.empty()) return true;
+            m_result.readings[static_cast<std::size_t>(m_sensor)] += m_chunk.size();
+            const bool more { m_sink(m_sensor, m_chunk) };
+            m_chunk.clear();
+            if (!more) m_result.stopped = true;
+            return more;
+        }
+
+        bool time_value(std::int64_t number) {
+            if (!in_pair()) return true;
+            if (m_field == 0) {
+                const bool ms { m_result.timestamps == TimestampFormat::epoch_ms };
+                m_reading.time_point = from_epoch_ns(ms ? number * 1'000'000 : number);
+            }
+            else if (m_field == 1) m_reading.value = static_cast<double>(number);
+            m_field++;
+            return true;
+        }
+    public:
+        SaveFileHandler(const ReadingsSink& sink, const StreamLoadOptions& options, StreamLoadResult& result)
+            : m_sink { sink }, m_options { options }, m_result { result } {
+            m_chunk.reserve(std::max<std::size_t>(m_options.chunk_readings, 1));
+        }
+
+        bool null() {
+            // NaN readings are written as null
+            if (in_pair() && m_field++ == 1) m_reading.value = std::nan("");
+            return true;
+        }
+        bool boolean(bool) { return true; }
+        bool number_integer(json::number_integer_t number) { return time_value(number); }
+        bool number_unsigned(json::number_unsigned_t number) { return time_value(static_cast<std::int64_t>(number)); }
+        bool number_float(json::number_float_t number, const json::string_t&) {
+            if (!in_pair()) return true;
+            if (m_field == 0) m_reading.time_point = from_epoch_ns(static_cast<std::int64_t>(number));
+            else if (m_field == 1) m_reading.value = number;
+            m_field++;
+            return true;
+        }
+        bool string(json::string_t& text) {
+            if (m_section == Section::timestamp_format && m_depth == m_document_depth) {
+                if (!parse_timestamp_format(text, m_result.timestamps)) return fail("unknown timestamp format " + text);
+                return true;
+            }
+            if (!in_pair()) return true;
+            if (m_field++ != 0) return true;
+            if (parse_rfc3339(text, m_reading.time_point)) return true;
+            if (text != m_local_text) {
+                if (!parse_local_string(text, m_local_time)) return fail("unreadable timestamp " + text);
+                m_local_text = text;
+            }
+            m_reading.time_point = m_local_time;
+            return true;
+        }
+        bool binary(json::binary_t&) { return true; }
+
+        bool start_object(std::size_t) {
+            m_depth++;
+            if (m_document_depth == 0 && m_depth <= 2) m_document_depth = m_depth;
+            return true;
+        }
+        bool key(json::string_t& name) {
+            if (m_depth != m_document_depth) return true;
+            m_section = Section::other;
+            if (name == "Timestamp Format") m_section = Section::timestamp_format;
+            for (SensorId id : all_sensors) {
+                if (name == sensor_name(id) && m_options.sensors[static_cast<std::size_t>(id)]) {
+                    m_section = Section::readings;
+                    m_sensor = id;
+                }
+            }
+            return true;
+        }
+        bool end_object() {
+            if (m_depth == m_document_depth) m_section = Section::none;
+            m_depth--;
+            return true;
+        }
+        bool start_array(std::size_t) {
+            m_depth++;
+            if (in_pair()) m_field = 0;
+            return true;
+        }
+        bool end_array() {
+            if (in_pair()) {
+                if (m_field < 2) return fail("reading with " + std::to_string(m_field) + " values");
+                m_chunk.push_back(m_reading);
+                if (m_chunk.size() >= m_options.chunk_readings && !flush()) return false;
+            }
+            else if (m_section == Section::readings && m_depth == m_document_depth + 1 && !flush()) return false;
+            m_depth--;
+            return true;
+        }
+        bool parse_error(std::size_t, const std::string&, const nlohmann::detail::exception& error) {
+            return fail(error.what());
+        }
+    };
+}
+
+StreamLoadResult stream_sensordata(std::span<const std::uint8_t> bytes, SaveFormat format, const ReadingsSink& sink,
+                                   const StreamLoadOptions& options) {
+    const auto start { std::chrono::steady_clock::now() };
+    StreamLoadResult result;
+    result.bytes = bytes.size();
+    SaveFileHandler handler { sink, options, result };
+    const bool parsed { json::sax_parse(bytes.data(), bytes.data() + bytes.size(), &handler, input_format(format)) };
+    result.ok = parsed || (result.stopped && result.error.empty());
+    if (!result.ok && result.error.empty()) result.error = "not a " + format_name(format) + " save file";
+    result.duration = std::chrono::steady_clock::now() - start;
+    return result;
+}
+
+StreamLoadResult stream_sensordata(const std::string& filename, SaveFormat format, const ReadingsSink& sink,
+                                   const StreamLoadOptions& options) {
+    StreamLoadResult result;
+    const int fd { ::open(filename.c_str(), O_RDONLY | O_CLOEXEC) };
+    struct stat file_stat {};
+    if (fd < 0 || ::fstat(fd, &file_stat) != 0) {
+        result.error = filename + ": " + std::strerror(errno);
+        if (fd >= 0) ::close(fd);
+        return result;
+    }
+    const std::size_t size { static_cast<std::size_t>(file_stat.st_size) };
+    if (size == 0) {
+        ::close(fd);
+        result.error = filename + ": empty file";
+        return result;
+    }
+    // the mapping is read once front to back, pages behind the parser can be dropped by the kernel
+    void* mapped { ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) };
+    ::close(fd);
+    if (mapped == MAP_FAILED) {
+        result.error = filename + ": " + std::strerror(errno);
+        return result;
+    }
+    ::madvise(mapped, size, MADV_SEQUENTIAL);
+    result = stream_sensordata({ static_cast<const std::uint8_t*>(mapped), size }, format, sink, options);
+    ::munmap(mapped, size);
+    return result;
+}
+
+StreamLoadResult stream_sensordata(const std::string& filename, const ReadingsSink& sink,
+                                   const StreamLoadOptions& options) {
+    return stream_sensordata(filename, format_from_filename(filename), sink, options);
+}
+
+StreamLoadResult stream_sensordata_into(const std::string& filename, SensorData& data,
+                                        const StreamLoadOptions& options) {
+    std::vector<TimeDouble> readings;
+    return stream_sensordata(filename, [&](SensorId id, std::span<const TimeDouble> chunk) {
+        readings.assign(chunk.begin(), chunk.end());
+        data.replay_readings(id, readings);
+        return true;
+    }, options);
+}
@@ -0,0 +1,48 @@
+#ifndef WEATHER_SENSORS_STREAMLOADER_H
+#define WEATHER_SENSORS_STREAMLOADER_H
+#include "structs.h"
+#include "TimeFormat.h"
+#include "SaveJson.h"
+#include "SensorData.h"
+#include <string>
+#include <span>
+#include <functional>
+
+struct StreamLoadOptions {
+    std::size_t chunk_readings { 4096 };                // readings handed to the sink at a time
+    bool sensors[sensor_count] { true, true, true };    // sections of the others are parsed but not converted
+};
+
+struct StreamLoadResult {
+    bool ok{};
+    bool stopped{};                     // the sink asked to stop, ok is still true
+    std::string error;                  // what was wrong with the file when ok is false
+    TimestampFormat timestamps { TimestampFormat::epoch_ns };
+    std::size_t readings[sensor_count]{};
+    std::uint64_t bytes{};
+    std::chrono::nanoseconds duration{};
+};
+
+// gets the readings of one sensor in file order, returns false to stop loading
+using ReadingsSink = std::function<bool(SensorId, std::span<const TimeDouble>)>;
+
+/**
+ *  Loads a file written by save_sensordata without building the document: the file is mapped and fed to
+ *  the SAX parser of nlohmann, readings are converted as they are parsed and handed to the sink in chunks
+ *  of chunk_readings, so memory does not grow with the file. Statistics are skipped, they follow from the
+ *  readings. Every timestamp format is read, files without "Timestamp Format" too
+ */
+StreamLoadResult stream_sensordata(std::span<const std::uint8_t> bytes, SaveFormat format, const ReadingsSink& sink,
+                                   const StreamLoadOptions& options = {});
+StreamLoadResult stream_sensordata(const std::string& filename, SaveFormat format, const ReadingsSink& sink,
+                                   const StreamLoadOptions& options = {});
+
+// same as above, format is taken from the file extension
+StreamLoadResult stream_sensordata(const std::string& filename, const ReadingsSink& sink,
+                                   const StreamLoadOptions& options = {});
+
+// streams a saved file into data like a write-ahead log replay, statistics included
+StreamLoadResult stream_sensordata_into(const std::string& filename, SensorData& data,
+                                        const StreamLoadOptions& options = {});
+
+#endif
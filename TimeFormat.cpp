@@ -0,0 +1,166 @@
+#include "TimeFormat.h"
+#include <ctime>
+#include <time.h>
+
+std::string timestamp_format_name(TimestampFormat format) {
+    switch (format) {
+        case TimestampFormat::epoch_ns:     return "ns";
+        case TimestampFormat::epoch_ms:     return "ms";
+        case TimestampFormat::rfc3339:      return "rfc3339";
+        case TimestampFormat::local_string: return "local";
+    }
+    return "ns";
+}
+
+bool parse_timestamp_format(const std::string& name, TimestampFormat& format) {
+    if (name == "ns")           format = TimestampFormat::epoch_ns;
+    else if (name == "ms")      format = TimestampFormat::epoch_ms;
+    else if (name == "rfc3339") format = TimestampFormat::rfc3339;
+    else if (name == "local")   format = TimestampFormat::local_string;
+    else return false;
+    return true;
+}
+
+std::int64_t to_epoch_ns(std::chrono::system_clock::time_point time_point) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(time_point.time_since_epoch()).count();
+}
+
+std::int64_t to_epoch_ms(std::chrono::system_clock::time_point time_point) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(time_point.time_since_epoch()).count();
+}
+
+std::chrono::system_clock::time_point from_epoch_ns(std::int64_t nanoseconds) {
+    return std::chrono::system_clock::time_point {
+        std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::nanoseconds { nanoseconds }) };
+}
+
+/**
+ *  Writes value as width digits, most significant first
+ */
+static void write_digits(char* out, std::uint64_t value, int width) {
+    for (int i = width - 1; i >= 0; i--) {
+        out[i] = static_cast<char>('0' + value % 10);
+        value /= 10;
+    }
+}
+
+// https://howardhinnant.github.io/date_algorithms.html#civil_from_days
+void format_rfc3339(std::chrono::system_clock::time_point time_point, char* buffer) {
+    std::int64_t ns { to_epoch_ns(time_point) };
+    std::int64_t seconds { ns / 1'000'000'000 };
+    std::int64_t fraction { ns % 1'000'000'000 };
+    if (fraction < 0) {
+        fraction += 1'000'000'000;
+        seconds--;
+    }
+    std::int64_t days { seconds / 86400 };
+    std::int64_t second_of_day { seconds % 86400 };
+    if (second_of_day < 0) {
+        second_of_day += 86400;
+        days--;
+    }
+    // civil from days
+    days += 719468;
+    const std::int64_t era { (days >= 0 ? days : days - 146096) / 146097 };
+    const std::int64_t day_of_era { days - era * 146097 };
+    const std::int64_t year_of_era { (day_of_era - day_of_era / 1460 + day_of_era / 36524 - day_of_era / 146096) / 365 };
+    const std::int64_t day_of_year { day_of_era - (365 * year_of_era + year_of_era / 4 - year_of_era / 100) };
+    const std::int64_t mp { (5 * day_of_year + 2) / 153 };
+    const std::int64_t day { day_of_year - (153 * mp + 2) / 5 + 1 };
+    const std::int64_t month { mp < 10 ? mp + 3 : mp - 9 };
+    const std::int64_t year { year_of_era + era * 400 + (month <= 2) };
+
+    // YYYY-MM-DDTHH:MM:SS.nnnnnnnnnZ
+    write_digits(buffer, static_cast<std::uint64_t>(year), 4);
+    buffer[4] = '-';
+    write_digits(buffer + 5, static_cast<std::uint64_t>(month), 2);
+    buffer[7] = '-';
+    write_digits(buffer + 8, static_cast<std::uint64_t>(day), 2);
+    buffer[10] = 'T';
+    write_digits(buffer + 11, static_cast<std::uint64_t>(second_of_day / 3600), 2);
+    buffer[13] = ':';
+    write_digits(buffer + 14, static_cast<std::uint64_t>(second_of_day / 60 % 60), 2);
+    buffer[16] = ':';
+    write_digits(buffer + 17, static_cast<std::uint64_t>(second_of_day % 60), 2);
+    buffer[19] = '.';
+    write_digits(buffer + 20, static_cast<std::uint64_t>(fraction), 9);
+    buffer[29] = 'Z';
+}
+
+std::string format_rfc3339(std::chrono::system_clock::time_point time_point) {
+    std::string text(rfc3339_length, ' ');
+    format_rfc3339(time_point, text.data());
+    return text;
+}
+
+std::string format_console_time(std::chrono::system_clock::time_point time_point) {
+    char buffer[rfc3339_length];
+    format_rfc3339(time_point, buffer);
+    buffer[10] = ' ';
+    return std::string(buffer, rfc3339_length - 1);
+}
+
+/**
+ *  Reads width digits, false if one of them is not a digit
+ */
+static bool read_digits(std::string_view text, std::size_t offset, int width, std::int64_t& value) {
+    value = 0;
+    for (int i = 0; i < width; i++) {
+        const char digit { text[offset + static_cast<std::size_t>(i)] };
+        if (digit < '0' || digit > '9') return false;
+        value = value * 10 + (digit - '0');
+    }
+    return true;
+}
+
+// https://howardhinnant.github.io/date_algorithms.html#days_from_civil
+bool parse_rfc3339(std::string_view text, std::chrono::system_clock::time_point& time_point) {
+    // YYYY-MM-DDTHH:MM:SS[.fraction]Z
+    if (text.size() < 20 || text[4] != '-' || text[7] != '-' || text[10] != 'T' || text[13] != ':'
+        || text[16] != ':' || text.back() != 'Z') return false;
+    std::int64_t year, month, day, hour, minute, second;
+    if (!read_digits(text, 0, 4, year) || !read_digits(text, 5, 2, month) || !read_digits(text, 8, 2, day)
+        || !read_digits(text, 11, 2, hour) || !read_digits(text, 14, 2, minute) || !read_digits(text, 17, 2, second)) {
+        return false;
+    }
+    if (month < 1 || month > 12 || day < 1 || day > 31 || hour > 23 || minute > 59 || second > 60) return false;
+    std::int64_t fraction {};
+    if (text.size() > 20) {
+        if (text[19] != '.' || text.size() > 30 || text.size() == 21) return false;
+        const int digits { static_cast<int>(text.size() - 21) };
+        if (!read_digits(text, 20, digits, fraction)) return false;
+        for (int i = digits; i < 9; i++) fraction *= 10;
+    }
+    // days from civil
+    year -= month <= 2;
+    const std::int64_t era { (year >= 0 ? year : year - 399) / 400 };
+    const std::int64_t year_of_era { year - era * 400 };
+    const std::int64_t day_of_year { (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1 };
+    const std::int64_t day_of_era { year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year };
+    const std::int64_t days { era * 146097 + day_of_era - 719468 };
+    const std::int64_t seconds { days * 86400 + hour * 3600 + minute * 60 + second };
+    time_point = from_epoch_ns(seconds * 1'000'000'000 + fraction);
+    return true;
+}
+
+std::string format_local_string(std::chrono::system_clock::time_point time_point) {
+    time_t time { std::chrono::system_clock::to_time_t(time_point) };
+    // localtime_r, the export threads format timestamps at the same time
+    std::tm local {};
+    char time_string[100];
+    if (::localtime_r(&time, &local) && std::strftime(time_string, sizeof(time_string), "%c", &local)){
+        return time_string;
+    }
+    else return "timepoint_to_string Conversion Error";
+}
+
+bool parse_local_string(const std::string& text, std::chrono::system_clock::time_point& time_point) {
+    std::tm time {};
+    const char* end { ::strptime(text.c_str(), "%c", &time) };
+    if (!end || *end != '\0') return false;
+    time.tm_isdst = -1;
+    const time_t seconds { std::mktime(&time) };
+    if (seconds == -1) return false;
+    time_point = std::chrono::system_clock::from_time_t(seconds);
+    return true;
+}
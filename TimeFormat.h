@@ -0,0 +1,52 @@
+#ifndef WEATHER_SENSORS_TIMEFORMAT_H
+#define WEATHER_SENSORS_TIMEFORMAT_H
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+/**
+ *  Encodings for timestamps in exported files
+ *  epoch_ns and epoch_ms are integers since 1970-01-01 UTC, lossless and cheap to parse
+ *  rfc3339 is UTC with nanosecond fraction, e.g. 2024-03-14T10:05:00.500000000Z
+ *  local_string is the original "%c" format (second resolution, locale dependent)
+ */
+enum class TimestampFormat {
+    epoch_ns,
+    epoch_ms,
+    rfc3339,
+    local_string
+};
+
+// short name used on the command line and in the save file, e.g. "ns"
+std::string timestamp_format_name(TimestampFormat format);
+
+// converts a name like "ns", "ms", "rfc3339" or "local" to a TimestampFormat, returns false if unknown
+bool parse_timestamp_format(const std::string& name, TimestampFormat& format);
+
+std::int64_t to_epoch_ns(std::chrono::system_clock::time_point time_point);
+std::int64_t to_epoch_ms(std::chrono::system_clock::time_point time_point);
+std::chrono::system_clock::time_point from_epoch_ns(std::int64_t nanoseconds);
+
+// length of the text written by format_rfc3339, without terminator
+constexpr std::size_t rfc3339_length { 30 };
+
+// writes exactly rfc3339_length characters to buffer, no locale, no allocation
+void format_rfc3339(std::chrono::system_clock::time_point time_point, char* buffer);
+std::string format_rfc3339(std::chrono::system_clock::time_point time_point);
+
+// reads text written by format_rfc3339 (any number of fraction digits), false if it is malformed
+bool parse_rfc3339(std::string_view text, std::chrono::system_clock::time_point& time_point);
+
+// "2024-03-14 10:05:00.500000000", the text C++20 chrono prints for a system_clock time_point,
+// used for console output so it does not depend on the library having operator<< for time_point
+std::string format_console_time(std::chrono::system_clock::time_point time_point);
+
+// the "%c" string in local time, as used by the first version of the save file
+std::string format_local_string(std::chrono::system_clock::time_point time_point);
+
+// reads format_local_string text back in the same locale and time zone, false if it is malformed
+bool parse_local_string(const std::string& text, std::chrono::system_clock::time_point& time_point);
+
+#endif
@@ -0,0 +1,43 @@
+#include "TimeIndex.h"
+
+namespace {
+    // adds the summary of a run of readings to stat the way calculate_statistics does
+    void add_summary(Stats& stat, double& sum, const BlockSummary& block) {
+        if (stat.count == 0 || block.max.value > stat.max.value) stat.max = block.max;
+        if (stat.count == 0 || block.min.value < stat.min.value) stat.min = block.min;
+        sum += block.sum;
+        stat.count += block.count;
+    }
+}
+
+void TimeIndex::update(const SensorSeries& readings, std::size_t from) {
+    const std::size_t first_block { std::min(from / block_size, m_blocks.size()) };
+    m_blocks.resize(first_block);
+    for (std::size_t begin = first_block * block_size; begin < readings.size(); begin += block_size) {
+        const std::size_t end { std::min(begin + block_size, readings.size()) };
+        m_blocks.push_back(readings.summarize(begin, end));
+    }
+}
+
+std::size_t TimeIndex::lower_bound(const SensorSeries& readings, std::chrono::system_clock::time_point time_point) const {
+    // first block that ends at or after time_point, the reading is in it
+    const auto block { std::partition_point(m_blocks.begin(), m_blocks.end(),
+                                            [time_point](const BlockSummary& summary) { return summary.last < time_point; }) };
+    if (block == m_blocks.end()) return readings.size();
+    const std::size_t begin { static_cast<std::size_t>(block - m_blocks.begin()) * block_size };
+    const std::size_t end { std::min(begin + block_size, readings.size()) };
+    return readings.lower_bound(time_point, begin, end);
+}
+
+Stats TimeIndex::aggregate(const SensorSeries& readings, std::size_t first, std::size_t last) const {
+    Stats stat {};
+    double sum{};
+    // partial block at the start, whole blocks from their summaries, partial block at the end
+    const std::size_t head_end { std::min(last, (first + block_size - 1) / block_size * block_size) };
+    if (head_end > first) add_summary(stat, sum, readings.summarize(first, head_end));
+    std::size_t position { std::max(first, head_end) };
+    for (; position + block_size <= last; position += block_size) add_summary(stat, sum, m_blocks[position / block_size]);
+    if (last > position) add_summary(stat, sum, readings.summarize(position, last));
+    if (stat.count > 0) stat.average = sum / static_cast<double>(stat.count);
+    return stat;
+}
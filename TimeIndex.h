@@ -0,0 +1,75 @@
+#ifndef WEATHER_SENSORS_TIMEINDEX_H
+#define WEATHER_SENSORS_TIMEINDEX_H
+#include "SensorSeries.h"
+
+/**
+ *  Sparse index over a time ordered history: one summary per block of block_size readings
+ *  A time lookup is a binary search over the block summaries and then inside one block,
+ *  aggregates use the summaries of whole blocks and only scan the partial blocks at the edges
+ */
+class TimeIndex {
+private:
+    std::vector<BlockSummary> m_blocks;
+public:
+    static constexpr std::size_t block_size { 1024 };
+
+    void clear() { m_blocks.clear(); }
+    // recomputes the summaries of every block from the one holding readings[from] to the end
+    void update(const SensorSeries& readings, std::size_t from);
+    // index of the first reading at or after time_point, readings.size() if there is none
+    std::size_t lower_bound(const SensorSeries& readings, std::chrono::system_clock::time_point time_point) const;
+    // max, min, average and count of readings[first, last), count 0 if the range is empty
+    Stats aggregate(const SensorSeries& readings, std::size_t first, std::size_t last) const;
+    const std::vector<BlockSummary>& blocks() const { return m_blocks; }
+};
+
+/**
+ *  Readings of one sensor in a time range, a view into the history that copies nothing
+ *  Iterating gives the range in chunks, one per index block it touches; a quantized history
+ *  is decoded one chunk at a time into a buffer of the iterator
+ *  Valid until the next change of the history (the next statistics pass)
+ */
+class ReadingRange {
+private:
+    const SensorSeries* m_series{};
+    std::size_t m_first{};      // index of the first reading in the history, chunks follow the block borders
+    std::size_t m_last{};
+public:
+    class ChunkIterator {
+    private:
+        const SensorSeries* m_series{};
+        std::size_t m_position{};
+        std::size_t m_last{};
+        mutable std::vector<TimeDouble> m_buffer;
+        std::size_t chunk_end() const {
+            return std::min(m_last, (m_position / TimeIndex::block_size + 1) * TimeIndex::block_size);
+        }
+    public:
+        ChunkIterator(const SensorSeries* series, std::size_t position, std::size_t last)
+            : m_series { series }, m_position { position }, m_last { last } {}
+        std::span<const TimeDouble> operator*() const {
+            const std::size_t end { chunk_end() };
+            if (const TimeDouble* plain { m_series->contiguous() }) return { plain + m_position, end - m_position };
+            m_buffer.resize(end - m_position);
+            m_series->decode(m_position, end, m_buffer.data());
+            return m_buffer;
+        }
+        ChunkIterator& operator++() {
+            m_position = chunk_end();
+            return *this;
+        }
+        bool operator!=(const ChunkIterator& other) const { return m_position != other.m_position; }
+    };
+
+    ReadingRange() = default;
+    ReadingRange(const SensorSeries& series, std::size_t first, std::size_t last)
+        : m_series { &series }, m_first { first }, m_last { last } {}
+    std::size_t offset() const { return m_first; }
+    std::size_t size() const { return m_last - m_first; }
+    bool empty() const { return m_last == m_first; }
+    TimeDouble operator[](std::size_t index) const { return (*m_series)[m_first + index]; }
+    ChunkIterator begin() const { return { m_series, m_first, m_last }; }
+    ChunkIterator end() const { return { m_series, m_last, m_last }; }
+};
+
+#endif
@@ -0,0 +1,128 @@
+#include "Trace.h"
+#include "nlohmann/json.hpp"
+#include <fstream>
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+namespace {
+    constexpr std::size_t events_per_thread { 1 << 16 };
+
+    struct TraceEvent {
+        const char* name;
+        std::int64_t start_ns;
+        std::int64_t end_ns;
+    };
+
+    /**
+     *  Written only by its thread, read by write_chrome_trace()
+     *  count is published with release so the reader sees complete events
+     */
+    struct ThreadBuffer {
+        std::vector<TraceEvent> events { events_per_thread };
+        std::atomic<std::uint64_t> count {};
+        long thread_id { static_cast<long>(::syscall(SYS_gettid)) };
+        std::string name;
+        bool exited{};
+    };
+
+    // rings of threads that have exited are kept for the dump, the oldest beyond this are dropped
+    constexpr std::size_t max_exited_buffers { 32 };
+
+    const auto trace_epoch { std::chrono::steady_clock::now() };
+    std::mutex registry_mutex;
+    std::vector<std::shared_ptr<ThreadBuffer>> registry;
+
+    /**
+     *  The name of a thread costs nothing until the thread records its first event while tracing is on,
+     *  only then is the ring allocated and registered
+     */
+    struct ThreadTrace {
+        std::string name;
+        std::shared_ptr<ThreadBuffer> buffer;
+
+        ~ThreadTrace() {
+            if (!buffer) return;
+            std::lock_guard<std::mutex> guard(registry_mutex);
+            buffer->exited = true;
+            const auto exited { std::count_if(registry.begin(), registry.end(),
+                                              [](const auto& entry) { return entry->exited; }) };
+            if (static_cast<std::size_t>(exited) > max_exited_buffers) {
+                registry.erase(std::find_if(registry.begin(), registry.end(),
+                                            [](const auto& entry) { return entry->exited; }));
+            }
+        }
+    };
+    thread_local ThreadTrace this_thread_trace;
+
+    ThreadBuffer& this_thread_buffer() {
+        if (!this_thread_trace.buffer) {
+            auto created { std::make_shared<ThreadBuffer>() };
+            std::lock_guard<std::mutex> guard(registry_mutex);
+            created->name = this_thread_trace.name;
+            registry.push_back(created);
+            this_thread_trace.buffer = std::move(created);
+        }
+        return *this_thread_trace.buffer;
+    }
+}
+
+namespace trace_detail {
+    std::atomic_bool enabled { false };
+
+    std::int64_t now_ns() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - trace_epoch).count();
+    }
+
+    void record(const char* name, std::int64_t start_ns, std::int64_t end_ns) {
+        ThreadBuffer& buffer { this_thread_buffer() };
+        const std::uint64_t index { buffer.count.load(std::memory_order_relaxed) };
+        buffer.events[index % events_per_thread] = { name, start_ns, end_ns };
+        buffer.count.store(index + 1, std::memory_order_release);
+    }
+}
+
+void trace_enable(bool on) {
+    trace_detail::enabled.store(on, std::memory_order_relaxed);
+}
+
+bool trace_enabled() {
+    return trace_detail::enabled.load(std::memory_order_relaxed);
+}
+
+void trace_set_thread_name(const std::string& name) {
+    this_thread_trace.name = name;
+    if (!this_thread_trace.buffer) return;
+    std::lock_guard<std::mutex> guard(registry_mutex);
+    this_thread_trace.buffer->name = name;
+}
+
+bool write_chrome_trace(const std::string& path) {
+    using json = nlohmann::json;
+    json events = json::array();
+    const long process_id { static_cast<long>(::getpid()) };
+    std::lock_guard<std::mutex> guard(registry_mutex);
+    for (const auto& buffer : registry) {
+        if (!buffer->name.empty()) {
+            events.push_back({ { "name", "thread_name" }, { "ph", "M" }, { "pid", process_id },
+                               { "tid", buffer->thread_id }, { "args", { { "name", buffer->name } } } });
+        }
+        // the ring holds the newest events_per_thread events
+        const std::uint64_t count { buffer->count.load(std::memory_order_acquire) };
+        const std::uint64_t first { count > events_per_thread ? count - events_per_thread : 0 };
+        for (std::uint64_t i = first; i < count; i++) {
+            const TraceEvent& event { buffer->events[i % events_per_thread] };
+            // complete events, timestamps in microseconds
+            events.push_back({ { "name", event.name }, { "ph", "X" }, { "pid", process_id },
+                               { "tid", buffer->thread_id },
+                               { "ts", static_cast<double>(event.start_ns) / 1000.0 },
+                               { "dur", static_cast<double>(event.end_ns - event.start_ns) / 1000.0 } });
+        }
+    }
+    std::ofstream out(path);
+    out << json { { "traceEvents", std::move(events) }, { "displayTimeUnit", "ms" } }.dump() << "\n";
+    return out.good();
+}
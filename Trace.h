@@ -0,0 +1,50 @@
+#ifndef WEATHER_SENSORS_TRACE_H
+#define WEATHER_SENSORS_TRACE_H
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+/**
+ *  Scoped thread activity events, dumped as Chrome trace-event json
+ *  (open in chrome://tracing or https://ui.perfetto.dev)
+ *  Each thread records into its own fixed size ring buffer, allocated on the first event of the
+ *  thread, so recording is a clock read and a store with no allocation and no lock
+ *  Threads that never record while tracing is on have no ring, naming one only stores the name;
+ *  the rings of exited threads are kept for the dump, up to a limit
+ *  When tracing is off a TraceScope costs one relaxed atomic load
+ *  Event names must be string literals (only the pointer is stored)
+ */
+
+namespace trace_detail {
+    extern std::atomic_bool enabled;
+    std::int64_t now_ns();
+    void record(const char* name, std::int64_t start_ns, std::int64_t end_ns);
+}
+
+// turns recording on or off, the buffers keep their events
+void trace_enable(bool on);
+bool trace_enabled();
+
+// name shown for the calling thread in the trace viewer
+void trace_set_thread_name(const std::string& name);
+
+// writes every recorded event as Chrome trace-event json, returns false if the file could not be written
+bool write_chrome_trace(const std::string& path);
+
+class TraceScope {
+private:
+    const char* m_name;
+    std::int64_t m_start;
+public:
+    explicit TraceScope(const char* name)
+        : m_name { trace_detail::enabled.load(std::memory_order_relaxed) ? name : nullptr },
+          m_start { m_name ? trace_detail::now_ns() : 0 } {}
+    ~TraceScope() {
+        if (m_name) trace_detail::record(m_name, m_start, trace_detail::now_ns());
+    }
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+};
+
+#endif
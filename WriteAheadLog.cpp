@@ -0,0 +1,265 @@
+#include "WriteAheadLog.h"
+#include "Crc32.h"
+#include "TimeFormat.h"
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace {
+    constexpr std::size_t record_header_size { 8 };       // length + crc
+    constexpr std::size_t payload_header_size { 8 };      // sensor id + padding + count
+    constexpr std::size_t reading_size { 16 };            // epoch ns + value
+
+    template <typename T>
+    void put(std::vector<std::uint8_t>& buffer, T value) {
+        const auto* bytes { reinterpret_cast<const std::uint8_t*>(&value) };
+        buffer.insert(buffer.end(), bytes, bytes + sizeof(T));
+    }
+
+    template <typename T>
+    T get(const std::uint8_t* data) {
+        T value;
+        std::memcpy(&value, data, sizeof(T));
+        return value;
+    }
+}
+
+WriteAheadLog::~WriteAheadLog() {
+    close();
+}
+
+bool WriteAheadLog::open(const std::string& path, WalOptions options) {
+    close();
+    int fd { ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644) };
+    if (fd < 0) {
+        std::cerr << "Could not open write-ahead log " << path << ": " << std::strerror(errno) << "\n";
+        return false;
+    }
+    std::lock_guard<std::mutex> guard(m_mutex);
+    m_fd = fd;
+    m_path = path;
+    m_options = options;
+    m_size = static_cast<std::uint64_t>(::lseek(m_fd, 0, SEEK_END));
+    m_unsynced_bytes = 0;
+    m_last_sync = std::chrono::steady_clock::now();
+    return true;
+}
+
+WalPosition WriteAheadLog::position() {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    return position_locked();
+}
+
+WalPosition WriteAheadLog::position_locked() {
+    WalPosition position;
+    struct stat file_stat {};
+    if (m_fd < 0 || ::fstat(m_fd, &file_stat) != 0) return position;
+    position.log.device = static_cast<std::uint64_t>(file_stat.st_dev);
+    position.log.inode = static_cast<std::uint64_t>(file_stat.st_ino);
+    if (m_size >= record_header_size) {
+        std::uint8_t header[record_header_size];
+        if (::pread(m_fd, header, sizeof(header), 0) == static_cast<ssize_t>(sizeof(header))) {
+            position.log.first_crc = get<std::uint32_t>(header + 4);
+        }
+    }
+    position.offset = m_size;
+    return position;
+}
+
+/**
+ *  The new segment is created next to the log first, so a failure at any step leaves a usable log
+ *  at path; the directory is synced so the renames survive a crash
+ */
+WalPosition WriteAheadLog::rotate() {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    if (m_fd < 0) return position_locked();
+    sync_locked();
+    struct stat file_stat {};
+    const std::string previous { previous_path() };
+    // the records in the previous segment are still needed until a snapshot covering them is on disk
+    if (::stat(previous.c_str(), &file_stat) == 0) return position_locked();
+
+    const std::string next { m_path + ".next" };
+    int fd { ::open(next.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644) };
+    if (fd < 0 || std::rename(m_path.c_str(), previous.c_str()) != 0) {
+        std::cerr << "Could not rotate write-ahead log " << m_path << ": " << std::strerror(errno) << "\n";
+        if (fd >= 0) {
+            ::close(fd);
+            ::unlink(next.c_str());
+        }
+        return position_locked();
+    }
+    if (std::rename(next.c_str(), m_path.c_str()) != 0) {
+        std::cerr << "Could not rotate write-ahead log " << m_path << ": " << std::strerror(errno) << "\n";
+        std::rename(previous.c_str(), m_path.c_str());
+        ::close(fd);
+        ::unlink(next.c_str());
+        return position_locked();
+    }
+    const std::string directory { m_path.find('/') == std::string::npos ? "." : m_path.substr(0, m_path.rfind('/') + 1) };
+    const int directory_fd { ::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC) };
+    if (directory_fd >= 0) {
+        ::fsync(directory_fd);
+        ::close(directory_fd);
+    }
+    ::close(m_fd);
+    m_fd = fd;
+    m_size = 0;
+    m_unsynced_bytes = 0;
+    return position_locked();
+}
+
+void WriteAheadLog::drop_previous() {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    if (!m_path.empty() && ::unlink(previous_path().c_str()) != 0 && errno != ENOENT) {
+        std::cerr << "Could not remove " << previous_path() << ": " << std::strerror(errno) << "\n";
+    }
+}
+
+void WriteAheadLog::close() {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    if (m_fd < 0) return;
+    sync_locked();
+    ::close(m_fd);
+    m_fd = -1;
+}
+
+WalReplayResult WriteAheadLog::replay(const std::function<void(SensorId, const std::vector<TimeDouble>&)>& callback,
+                                      std::uint64_t offset) {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    WalReplayResult result;
+    if (m_fd < 0) return result;
+    const auto start { std::chrono::steady_clock::now() };
+
+    struct stat file_stat {};
+    ::fstat(m_fd, &file_stat);
+    const std::uint64_t file_size { static_cast<std::uint64_t>(file_stat.st_size) };
+    std::uint64_t position { std::min(offset, file_size) };
+
+    if (file_size > position) {
+        // map only the tail from offset on, rounded down to a page
+        const std::uint64_t page_size { static_cast<std::uint64_t>(::sysconf(_SC_PAGESIZE)) };
+        const std::uint64_t map_start { position / page_size * page_size };
+        const std::uint64_t map_length { file_size - map_start };
+        void* mapped { ::mmap(nullptr, map_length, PROT_READ, MAP_PRIVATE, m_fd, static_cast<off_t>(map_start)) };
+        if (mapped == MAP_FAILED) {
+            std::cerr << "Could not map write-ahead log " << m_path << ": " << std::strerror(errno) << "\n";
+            result.valid_bytes = position;
+            return result;
+        }
+        ::madvise(mapped, map_length, MADV_SEQUENTIAL);
+        // data is indexed with file offsets
+        const auto* data { static_cast<const std::uint8_t*>(mapped) - map_start };
+        std::vector<TimeDouble> readings;
+
+        while (position + record_header_size <= file_size) {
+            const std::uint32_t length { get<std::uint32_t>(data + position) };
+            const std::uint32_t checksum { get<std::uint32_t>(data + position + 4) };
+            const std::uint8_t* payload { data + position + record_header_size };
+            if (length < payload_header_size || position + record_header_size + length > file_size) break;
+            if (crc32(payload, length) != checksum) break;
+            const std::uint8_t sensor { payload[0] };
+            const std::uint32_t count { get<std::uint32_t>(payload + 4) };
+            if (sensor >= sensor_count || length != payload_header_size + std::uint64_t{count} * reading_size) break;
+
+            readings.clear();
+            readings.reserve(count);
+            const std::uint8_t* reading { payload + payload_header_size };
+            for (std::uint32_t i = 0; i < count; i++, reading += reading_size) {
+                readings.push_back({ from_epoch_ns(get<std::int64_t>(reading)), get<double>(reading + 8) });
+            }
+            callback(static_cast<SensorId>(sensor), readings);
+            result.records++;
+            result.readings += count;
+            position += record_header_size + length;
+        }
+        ::munmap(mapped, map_length);
+    }
+
+    // drop a torn write at the end so new records follow the last good one
+    result.valid_bytes = position;
+    result.damaged_tail = position < file_size;
+    if (result.damaged_tail && ::ftruncate(m_fd, static_cast<off_t>(position)) != 0) {
+        std::cerr << "Could not truncate write-ahead log " << m_path << ": " << std::strerror(errno) << "\n";
+    }
+    m_size = position;
+    ::lseek(m_fd, static_cast<off_t>(m_size), SEEK_SET);
+    result.duration = std::chrono::steady_clock::now() - start;
+    return result;
+}
+
+bool WriteAheadLog::append(const SensorReadings& batch) {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    if (m_fd < 0) return true;
+
+    m_buffer.clear();
+    for (SensorId id : all_sensors) {
+        const std::vector<TimeDouble>& readings { batch[id] };
+        if (readings.empty()) continue;
+        const std::size_t record_start { m_buffer.size() };
+        const std::uint32_t length { static_cast<std::uint32_t>(payload_header_size + readings.size() * reading_size) };
+        put<std::uint32_t>(m_buffer, length);
+        put<std::uint32_t>(m_buffer, 0);    // crc, filled in below
+        put<std::uint8_t>(m_buffer, static_cast<std::uint8_t>(id));
+        put<std::uint8_t>(m_buffer, 0);
+        put<std::uint16_t>(m_buffer, 0);
+        put<std::uint32_t>(m_buffer, static_cast<std::uint32_t>(readings.size()));
+        for (const auto& reading : readings) {
+            put<std::int64_t>(m_buffer, to_epoch_ns(reading.time_point));
+            put<double>(m_buffer, reading.value);
+        }
+        const std::uint32_t checksum { crc32(m_buffer.data() + record_start + record_header_size, length) };
+        std::memcpy(m_buffer.data() + record_start + 4, &checksum, sizeof(checksum));
+    }
+    if (m_buffer.empty()) return true;
+
+    std::size_t written { 0 };
+    while (written < m_buffer.size()) {
+        ssize_t result { ::write(m_fd, m_buffer.data() + written, m_buffer.size() - written) };
+        if (result < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "Write-ahead log write failed: " << std::strerror(errno) << "\n";
+            // a torn record ends replay, every good record after it would be truncated with it
+            if (::ftruncate(m_fd, static_cast<off_t>(m_size)) != 0 ||
+                ::lseek(m_fd, static_cast<off_t>(m_size), SEEK_SET) < 0) {
+                std::cerr << "Could not remove the partial record from " << m_path << ": " << std::strerror(errno) << "\n";
+            }
+            return false;
+        }
+        written += static_cast<std::size_t>(result);
+    }
+    m_size += written;
+    m_unsynced_bytes += written;
+
+    // group commit: one fsync covers every batch written since the last one
+    if (m_unsynced_bytes >= m_options.sync_bytes ||
+        std::chrono::steady_clock::now() - m_last_sync >= m_options.sync_interval) {
+        sync_locked();
+    }
+    return true;
+}
+
+void WriteAheadLog::sync_if_due() {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    if (m_fd >= 0 && m_unsynced_bytes > 0 &&
+        std::chrono::steady_clock::now() - m_last_sync >= m_options.sync_interval) {
+        sync_locked();
+    }
+}
+
+void WriteAheadLog::sync() {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    sync_locked();
+}
+
+void WriteAheadLog::sync_locked() {
+    if (m_fd < 0 || m_unsynced_bytes == 0) return;
+    if (::fdatasync(m_fd) != 0) {
+        std::cerr << "Write-ahead log fsync failed: " << std::strerror(errno) << "\n";
+    }
+    m_unsynced_bytes = 0;
+    m_last_sync = std::chrono::steady_clock::now();
+}
@@ -0,0 +1,105 @@
+#ifndef WEATHER_SENSORS_WRITEAHEADLOG_H
+#define WEATHER_SENSORS_WRITEAHEADLOG_H
+#include "structs.h"
+#include <string>
+#include <functional>
+
+/**
+ *  Group commit settings for the write-ahead log
+ *  fsync runs when sync_interval has passed since the last fsync
+ *  or when sync_bytes have been written without an fsync, whichever comes first
+ */
+struct WalOptions {
+    std::chrono::milliseconds sync_interval { 1000 };
+    std::size_t sync_bytes { 256 * 1024 };
+};
+
+/**
+ *  Which log file a position refers to: a log that was deleted and created again, or no log at all,
+ *  does not match the identity a snapshot recorded
+ */
+struct WalIdentity {
+    std::uint64_t device{};
+    std::uint64_t inode{};
+    std::uint32_t first_crc{};          // checksum of the first record, 0 while the log is empty
+
+    bool is_log() const { return inode != 0; }
+    // true if log is the file this identity was taken from, the first record may have been written since
+    bool matches(const WalIdentity& log) const {
+        return is_log() && device == log.device && inode == log.inode && (first_crc == 0 || first_crc == log.first_crc);
+    }
+};
+
+// end of the log at some point, what a snapshot covers; a default position means no log was open
+struct WalPosition {
+    WalIdentity log;
+    std::uint64_t offset{};
+};
+
+struct WalReplayResult {
+    std::size_t records{};
+    std::size_t readings{};
+    std::uint64_t valid_bytes{};        // bytes of complete records, the file is truncated to this
+    bool damaged_tail{};                // true if a torn or corrupt record was found at the end
+    std::chrono::nanoseconds duration{};
+};
+
+/**
+ *  Append-only log of reading batches
+ *  Each record is: u32 payload length, u32 crc32 of payload, payload
+ *  Payload is: u8 sensor id, 3 bytes padding, u32 count, count x (i64 epoch ns, f64 value)
+ *  append() writes all sensors of a batch with one write(), fsync is group committed (see WalOptions)
+ *  replay() must be called after open() and before the first append()
+ *  rotate() starts a new empty segment at path and keeps the old one as path.prev until drop_previous(),
+ *  so a snapshot can cover the whole old segment and the log does not grow without bound
+ */
+class WriteAheadLog {
+private:
+    int m_fd { -1 };
+    std::string m_path;
+    WalOptions m_options;
+    std::uint64_t m_size{};
+    std::size_t m_unsynced_bytes{};
+    std::chrono::steady_clock::time_point m_last_sync;
+    std::vector<std::uint8_t> m_buffer;
+    std::mutex m_mutex;
+
+    void sync_locked();
+    WalPosition position_locked();
+public:
+    WriteAheadLog() = default;
+    WriteAheadLog(const WriteAheadLog&) = delete;
+    WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+    ~WriteAheadLog();
+
+    // opens or creates the log file, returns false and prints the reason on failure
+    bool open(const std::string& path, WalOptions options = {});
+    void close();
+    bool is_open() const { return m_fd >= 0; }
+    const std::string& path() const { return m_path; }
+    // bytes in the log, the offset where the next record starts
+    std::uint64_t size() const { return m_size; }
+    // identity and size of the open log, a default WalPosition when it is not open
+    WalPosition position();
+    // where rotate() moves the log
+    std::string previous_path() const { return m_path + ".prev"; }
+    // moves the log to previous_path() and continues in a new file, returns the position in the new one;
+    // while an earlier previous segment is still there nothing is moved and the current position is returned
+    WalPosition rotate();
+    // removes the previous segment once a snapshot covering it is on disk
+    void drop_previous();
+
+    // reads every record from offset on and passes it to callback, then truncates a damaged tail
+    WalReplayResult replay(const std::function<void(SensorId, const std::vector<TimeDouble>&)>& callback,
+                           std::uint64_t offset = 0);
+
+    // appends one record per sensor with readings, no-op when the log is not open
+    // false if the write failed, the log then ends with the last complete record and the batch is not in it
+    bool append(const SensorReadings& batch);
+    // fsyncs if the interval has passed and there are unsynced bytes
+    void sync_if_due();
+    // fsyncs now if there are unsynced bytes
+    void sync();
+};
+
+#endif
@@ -0,0 +1,1004 @@
+/**
+ *  Microbenchmarks for the ingest, statistics and export hot paths
+ *  Usage: weather_bench [--filter <text>] [--max-readings <n>] [--out <file>]
+ *  --filter runs only benchmarks whose name contains the text
+ *  --max-readings caps the data sizes (default 100M, the largest size)
+ *  Results are printed and written as json to --out (default weather_bench.json)
+ */
+#include "structs.h"
+#include "SensorData.h"
+#include "SaveJson.h"
+#include "DataGenerator.h"
+#include "Trace.h"
+#include "MetricsServer.h"
+#include "IngestServer.h"
+#include "StreamLoader.h"
+#include <functional>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using Clock = std::chrono::steady_clock;
+
+struct BenchOptions {
+    std::string filter;
+    std::size_t max_readings { 100'000'000 };
+    std::string out { "weather_bench.json" };
+};
+
+/**
+ *  Collects results, one json object per measurement
+ */
+class BenchReport {
+private:
+    json m_results = json::array();
+public:
+    void add(const std::string& name, json params, json metrics) {
+        std::cout << std::left << std::setw(24) << name << " " << params.dump() << " " << metrics.dump() << "\n";
+        m_results.push_back({ { "name", name }, { "params", std::move(params) }, { "metrics", std::move(metrics) } });
+    }
+    json document() const {
+        return { { "unit_time", "ns" },
+                 { "hardware_concurrency", std::thread::hardware_concurrency() },
+                 { "results", m_results } };
+    }
+};
+
+static double elapsed_ns(Clock::time_point start) {
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+}
+
+// sizes 1K, 10K, ... up to limit
+static std::vector<std::size_t> decade_sizes(std::size_t from, std::size_t to, std::size_t limit) {
+    std::vector<std::size_t> sizes;
+    for (std::size_t size = from; size <= to && size <= limit; size *= 10) sizes.push_back(size);
+    return sizes;
+}
+
+// stores count readings for every sensor through the public setters
+static void fill_new_readings(SensorData& data, std::size_t count) {
+    DataGenerator temperature ( -15, 30, -0.2, 0.2 );
+    DataGenerator humidity ( 55.0, 100.0, -0.1, 0.1 );
+    DataGenerator windspeed ( 0.0, 25.0, -0.5, 0.5 );
+    temperature.get_initial_value();
+    humidity.get_initial_value();
+    windspeed.get_initial_value();
+    for (std::size_t i = 0; i < count; i++) {
+        data.store_temperature_reading(temperature.get_new_value());
+        data.store_humidity_reading(humidity.get_new_value());
+        data.store_windspeed_reading(windspeed.get_new_value());
+    }
+}
+
+// readings in history with statistics, as after a long run
+static std::unique_ptr<SensorData> make_history(std::size_t count) {
+    auto data { std::make_unique<SensorData>() };
+    fill_new_readings(*data, count);
+    bool first_temperature { true }, first_humidity { true }, first_windspeed { true };
+    data->calculate_temperature_statistic(first_temperature);
+    data->calculate_humidity_statistic(first_humidity);
+    data->calculate_windspeed_statistic(first_windspeed);
+    data->move_temperature_data();
+    data->move_humidity_data();
+    data->move_windspeed_data();
+    return data;
+}
+
+/**
+ *  store_new_reading with 1..64 producers on the shared sensor_mutex
+ */
+static void bench_store_new_reading(const BenchOptions& options, BenchReport& report) {
+    const std::size_t total { std::min<std::size_t>(2'000'000, options.max_readings) };
+    for (int producers : { 1, 2, 4, 8, 16, 32, 64 }) {
+        SensorData data;
+        const std::size_t per_producer { total / static_cast<std::size_t>(producers) };
+        std::vector<std::thread> threads;
+        std::atomic_bool go { false };
+        for (int p = 0; p < producers; p++) {
+            threads.emplace_back([&data, &go, per_producer, p] {
+                while (!go) std::this_thread::yield();
+                for (std::size_t i = 0; i < per_producer; i++) {
+                    switch (p % 3) {
+                        case 0: data.store_temperature_reading(static_cast<double>(i)); break;
+                        case 1: data.store_humidity_reading(static_cast<double>(i)); break;
+                        default: data.store_windspeed_reading(static_cast<double>(i)); break;
+                    }
+                }
+            });
+        }
+        const auto start { Clock::now() };
+        go = true;
+        for (auto& thread : threads) thread.join();
+        const double ns { elapsed_ns(start) };
+        const double readings { static_cast<double>(per_producer * static_cast<std::size_t>(producers)) };
+        report.add("store_new_reading", { { "producers", producers }, { "readings", readings } },
+                   { { "total_ns", ns }, { "ns_per_reading", ns / readings },
+                     { "readings_per_second", readings / ns * 1e9 } });
+    }
+}
+
+/**
+ *  store_readings() with spans of 1..4096 values against one store_*_reading() per value (batch 0),
+ *  with 1 and 4 producers, each writing its own sensor's readings
+ */
+static void bench_store_readings(const BenchOptions& options, BenchReport& report) {
+    const std::size_t total { std::min<std::size_t>(4'000'000, options.max_readings) };
+    for (int producers : { 1, 4 }) {
+        for (std::size_t batch : { std::size_t { 0 }, std::size_t { 1 }, std::size_t { 16 },
+                                   std::size_t { 256 }, std::size_t { 4096 } }) {
+            SensorData data;
+            const std::size_t per_producer { total / static_cast<std::size_t>(producers) };
+            std::vector<std::thread> threads;
+            std::atomic_bool go { false };
+            for (int p = 0; p < producers; p++) {
+                threads.emplace_back([&data, &go, per_producer, batch, p] {
+                    const SensorId id { all_sensors[static_cast<std::size_t>(p) % sensor_count] };
+                    std::vector<double> values(std::max<std::size_t>(batch, 1));
+                    for (std::size_t i = 0; i < values.size(); i++) values[i] = static_cast<double>(i % 100);
+                    while (!go) std::this_thread::yield();
+                    if (batch == 0) {
+                        for (std::size_t i = 0; i < per_producer; i++) {
+                            switch (id) {
+                                case SensorId::temperature: data.store_temperature_reading(values[0]); break;
+                                case SensorId::humidity: data.store_humidity_reading(values[0]); break;
+                                default: data.store_windspeed_reading(values[0]); break;
+                            }
+                        }
+                        return;
+                    }
+                    for (std::size_t i = 0; i < per_producer; i += batch) {
+                        data.store_readings(id, std::span<const double> { values.data(), std::min(batch, per_producer - i) });
+                    }
+                });
+            }
+            const auto start { Clock::now() };
+            go = true;
+            for (auto& thread : threads) thread.join();
+            const double ns { elapsed_ns(start) };
+            const double readings { static_cast<double>(per_producer * static_cast<std::size_t>(producers)) };
+            report.add("store_readings", { { "producers", producers }, { "batch", batch } },
+                       { { "ns_per_reading", ns / readings }, { "readings_per_second", readings / ns * 1e9 } });
+        }
+    }
+}
+
+/**
+ *  calculate_statistics over the new readings of one sensor
+ */
+static void bench_calculate_statistics(const BenchOptions& options, BenchReport& report) {
+    for (std::size_t size : decade_sizes(1'000, 100'000'000, options.max_readings)) {
+        SensorData data;
+        for (std::size_t i = 0; i < size; i++) data.store_temperature_reading(static_cast<double>(i % 4096) * 0.01);
+        const std::size_t repetitions { std::max<std::size_t>(1, 10'000'000 / size) };
+        bool first { true };
+        const auto start { Clock::now() };
+        for (std::size_t r = 0; r < repetitions; r++) data.calculate_temperature_statistic(first);
+        const double ns { elapsed_ns(start) / static_cast<double>(repetitions) };
+        report.add("calculate_statistics", { { "readings", size } },
+                   { { "ns_per_pass", ns }, { "ns_per_reading", ns / static_cast<double>(size) },
+                     { "readings_per_second", static_cast<double>(size) / ns * 1e9 } });
+    }
+}
+
+/**
+ *  move_sensor_data of one batch into a history of the same size
+ */
+static void bench_move_sensor_data(const BenchOptions& options, BenchReport& report) {
+    for (std::size_t size : decade_sizes(1'000, 10'000'000, options.max_readings)) {
+        SensorData data;
+        for (std::size_t i = 0; i < size; i++) data.store_temperature_reading(static_cast<double>(i));
+        data.move_temperature_data();
+        for (std::size_t i = 0; i < size; i++) data.store_temperature_reading(static_cast<double>(i));
+        const auto start { Clock::now() };
+        data.move_temperature_data();
+        const double ns { elapsed_ns(start) };
+        report.add("move_sensor_data", { { "readings", size }, { "history", size } },
+                   { { "ns_per_move", ns }, { "ns_per_reading", ns / static_cast<double>(size) } });
+    }
+}
+
+/**
+ *  construct_json_object for every timestamp encoding
+ */
+static void bench_construct_json_object(const BenchOptions& options, BenchReport& report) {
+    for (std::size_t size : decade_sizes(1'000, 1'000'000, options.max_readings)) {
+        std::unique_ptr<SensorData> data { make_history(size) };
+        for (TimestampFormat format : { TimestampFormat::epoch_ns, TimestampFormat::epoch_ms,
+                                        TimestampFormat::rfc3339, TimestampFormat::local_string }) {
+            const auto start { Clock::now() };
+            json document { data->construct_json_object(format) };
+            const double ns { elapsed_ns(start) };
+            const double readings { static_cast<double>(size * sensor_count) };
+            report.add("construct_json_object",
+                       { { "readings_per_sensor", size }, { "timestamps", timestamp_format_name(format) } },
+                       { { "total_ns", ns }, { "ns_per_reading", ns / readings } });
+        }
+    }
+}
+
+/**
+ *  Building, encoding (cbor) and freeing the export document on the heap and in a ScratchArena,
+ *  with the heap allocations each takes per reading
+ */
+static void bench_export_scratch(const BenchOptions& options, BenchReport& report) {
+    for (std::size_t size : decade_sizes(10'000, 1'000'000, options.max_readings)) {
+        std::unique_ptr<SensorData> data { make_history(size) };
+        const double readings { static_cast<double>(size * sensor_count) };
+        for (TimestampFormat format : { TimestampFormat::epoch_ns, TimestampFormat::rfc3339 }) {
+            for (bool arena : { false, true }) {
+                const HeapCounters before { heap_counters() };
+                const auto start { Clock::now() };
+                std::size_t bytes{};
+                std::uint64_t scratch{};
+                if (arena) {
+                    ScratchArena scratch_arena;
+                    scratch_json document = scratch_json::array();
+                    document.push_back(data->construct_scratch_json(format));
+                    bytes = encode_json(document, SaveFormat::cbor).size();
+                    scratch = scratch_arena.bytes();
+                } else {
+                    json document = json::array();
+                    document.push_back(data->construct_json_object(format));
+                    bytes = encode_json(document, SaveFormat::cbor).size();
+                }
+                const double ns { elapsed_ns(start) };
+                const HeapCounters after { heap_counters() };
+                report.add("export_scratch", { { "readings_per_sensor", size }, { "timestamps", timestamp_format_name(format) },
+                                               { "arena", arena } },
+                           { { "ns_per_reading", ns / readings },
+                             { "heap_allocations_per_reading", static_cast<double>(after.allocations - before.allocations) / readings },
+                             { "scratch_bytes", scratch }, { "bytes", bytes } });
+            }
+        }
+    }
+}
+
+/**
+ *  Encoding the saved document on one thread against encode_sensordata(), which builds and encodes
+ *  every sensor's readings on a thread of its own; the joined parts must be the serial file byte for byte
+ */
+static void bench_parallel_export(const BenchOptions& options, BenchReport& report) {
+    for (std::size_t size : decade_sizes(100'000, 1'000'000, options.max_readings)) {
+        std::unique_ptr<SensorData> data { make_history(size) };
+        const double readings { static_cast<double>(size * sensor_count) };
+        for (SaveFormat format : { SaveFormat::json, SaveFormat::cbor, SaveFormat::msgpack,
+                                   SaveFormat::ubjson, SaveFormat::bjdata }) {
+            for (TimestampFormat timestamps : { TimestampFormat::epoch_ns, TimestampFormat::epoch_ms,
+                                                TimestampFormat::rfc3339, TimestampFormat::local_string }) {
+                auto start { Clock::now() };
+                std::vector<std::uint8_t> serial;
+                {
+                    ScratchArena arena;
+                    scratch_json document = scratch_json::array();
+                    document.push_back(data->construct_scratch_json(timestamps));
+                    serial = encode_json(document, format);
+                }
+                const double serial_ns { elapsed_ns(start) };
+                start = Clock::now();
+                const std::vector<std::vector<std::uint8_t>> parts { encode_sensordata(*data, format, timestamps) };
+                const double parallel_ns { elapsed_ns(start) };
+                std::vector<std::uint8_t> joined;
+                joined.reserve(serial.size());
+                for (const auto& part : parts) joined.insert(joined.end(), part.begin(), part.end());
+                report.add("parallel_export", { { "readings_per_sensor", size }, { "format", format_name(format) },
+                                                { "timestamps", timestamp_format_name(timestamps) } },
+                           { { "serial_ns_per_reading", serial_ns / readings },
+                             { "parallel_ns_per_reading", parallel_ns / readings },
+                             { "speedup", serial_ns / parallel_ns }, { "identical", joined == serial } });
+            }
+        }
+    }
+}
+
+/**
+ *  File size, encode and decode time for every SaveFormat, and a complete save_sensordata
+ */
+static void bench_save_formats(const BenchOptions& options, BenchReport& report) {
+    const std::filesystem::path directory { std::filesystem::temp_directory_path() / "weather_bench" };
+    std::filesystem::create_directories(directory);
+    for (std::size_t size : decade_sizes(1'000, 1'000'000, options.max_readings)) {
+        std::unique_ptr<SensorData> data { make_history(size) };
+        const json document { data->construct_json_object() };
+        for (SaveFormat format : { SaveFormat::json, SaveFormat::cbor, SaveFormat::msgpack,
+                                   SaveFormat::ubjson, SaveFormat::bjdata }) {
+            auto start { Clock::now() };
+            std::vector<std::uint8_t> bytes { encode_json(document, format) };
+            const double encode_ns { elapsed_ns(start) };
+            start = Clock::now();
+            json decoded { decode_json(bytes, format) };
+            const double decode_ns { elapsed_ns(start) };
+
+            start = Clock::now();
+            std::string filename { save_sensordata((directory / "bench").string(), *data, format) };
+            const double save_ns { elapsed_ns(start) };
+            std::filesystem::remove(filename);
+
+            report.add("save_sensordata", { { "readings_per_sensor", size }, { "format", format_name(format) } },
+                       { { "bytes", bytes.size() }, { "encode_ns", encode_ns }, { "decode_ns", decode_ns },
+                         { "save_ns", save_ns } });
+        }
+    }
+    std::filesystem::remove_all(directory);
+}
+
+/**
+ *  Reading a saved file back as a document with load_sensordata() against streaming it with
+ *  stream_sensordata(), time and heap bytes per reading
+ */
+static void bench_stream_load(const BenchOptions& options, BenchReport& report) {
+    const std::filesystem::path directory { std::filesystem::temp_directory_path() / "weather_bench" };
+    std::filesystem::create_directories(directory);
+    for (std::size_t size : decade_sizes(10'000, 1'000'000, options.max_readings)) {
+        std::unique_ptr<SensorData> data { make_history(size) };
+        const double readings { static_cast<double>(size * sensor_count) };
+        for (SaveFormat format : { SaveFormat::json, SaveFormat::cbor }) {
+            const std::string filename { save_sensordata((directory / "bench").string(), *data, format) };
+            HeapCounters before { heap_counters() };
+            auto start { Clock::now() };
+            std::size_t dom_readings{};
+            {
+                const json document = load_sensordata(filename, format);
+                for (SensorId id : all_sensors) dom_readings += document[0][sensor_name(id)].size();
+            }
+            const double dom_ns { elapsed_ns(start) };
+            const std::uint64_t dom_bytes { heap_counters().bytes - before.bytes };
+
+            before = heap_counters();
+            start = Clock::now();
+            double checksum{};
+            const StreamLoadResult result { stream_sensordata(filename, format, [&](SensorId, std::span<const TimeDouble> chunk) {
+                for (const TimeDouble& reading : chunk) checksum += reading.value;
+                return true;
+            }) };
+            const double stream_ns { elapsed_ns(start) };
+            const std::uint64_t stream_bytes { heap_counters().bytes - before.bytes };
+            std::filesystem::remove(filename);
+
+            std::size_t streamed{};
+            for (std::size_t count : result.readings) streamed += count;
+            report.add("stream_load", { { "readings_per_sensor", size }, { "format", format_name(format) } },
+                       { { "dom_ns_per_reading", dom_ns / readings }, { "stream_ns_per_reading", stream_ns / readings },
+                         { "stream_mb_per_second", static_cast<double>(result.bytes) / stream_ns * 1e3 },
+                         { "dom_heap_bytes_per_reading", static_cast<double>(dom_bytes) / readings },
+                         { "stream_heap_bytes", stream_bytes },
+                         { "same_readings", result.ok && streamed == dom_readings }, { "checksum", std::fmod(checksum, 1000.0) } });
+        }
+    }
+    std::filesystem::remove_all(directory);
+}
+
+/**
+ *  Cost of a TraceScope with tracing off and on
+ */
+static void bench_trace_scope(const BenchOptions&, BenchReport& report) {
+    constexpr std::size_t scopes { 10'000'000 };
+    for (bool enabled : { false, true }) {
+        trace_enable(enabled);
+        const auto start { Clock::now() };
+        for (std::size_t i = 0; i < scopes; i++) {
+            TraceScope trace("bench");
+        }
+        const double ns { elapsed_ns(start) };
+        report.add("trace_scope", { { "enabled", enabled } }, { { "ns_per_scope", ns / scopes } });
+    }
+    trace_enable(false);
+}
+
+/**
+ *  render_openmetrics() on a filled history, and GET /metrics over a Unix socket
+ *  with 1 to 16 keep-alive clients that each send a request and read the whole response
+ */
+static void bench_openmetrics(const BenchOptions&, BenchReport& report) {
+    std::unique_ptr<SensorData> data { make_history(1'000) };
+    constexpr std::size_t renders { 10'000 };
+    std::size_t body_bytes{};
+    auto start { Clock::now() };
+    for (std::size_t i = 0; i < renders; i++) body_bytes = render_openmetrics(*data).size();
+    report.add("openmetrics_render", { { "renders", renders } },
+               { { "ns_per_render", elapsed_ns(start) / renders }, { "bytes", body_bytes } });
+
+    const std::string socket_path { (std::filesystem::temp_directory_path() / "weather_bench_metrics.sock").string() };
+    MetricsServer server;
+    if (!server.start({ "unix:" + socket_path })) return;
+    server.publish(render_openmetrics(*data));
+
+    constexpr std::size_t scrapes_per_client { 20'000 };
+    for (unsigned clients : { 1u, 4u, 16u }) {
+        std::atomic<std::size_t> failed{};
+        std::vector<std::thread> threads;
+        start = Clock::now();
+        for (unsigned c = 0; c < clients; c++) {
+            threads.emplace_back([&] {
+                const int fd { ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0) };
+                sockaddr_un address {};
+                address.sun_family = AF_UNIX;
+                std::snprintf(address.sun_path, sizeof(address.sun_path), "%s", socket_path.c_str());
+                if (::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
+                    failed += scrapes_per_client;
+                    ::close(fd);
+                    return;
+                }
+                const std::string request { "GET /metrics HTTP/1.1\r\nHost: localhost\r\n\r\n" };
+                std::string response;
+                char buffer[16384];
+                for (std::size_t i = 0; i < scrapes_per_client; i++) {
+                    if (::send(fd, request.data(), request.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(request.size())) {
+                        failed++;
+                        break;
+                    }
+                    // headers, then Content-Length bytes of body
+                    response.clear();
+                    std::size_t expected { std::string::npos };
+                    while (response.size() < expected) {
+                        const ssize_t received { ::recv(fd, buffer, sizeof(buffer), 0) };
+                        if (received <= 0) break;
+                        response.append(buffer, static_cast<std::size_t>(received));
+                        const std::size_t header_end { response.find("\r\n\r\n") };
+                        const std::size_t length { response.find("Content-Length: ") };
+                        if (expected == std::string::npos && header_end != std::string::npos && length != std::string::npos) {
+                            expected = header_end + 4 + std::stoull(response.substr(length + 16));
+                        }
+                    }
+                    if (response.rfind("HTTP/1.1 200", 0) != 0 || response.size() != expected) failed++;
+                }
+                ::close(fd);
+            });
+        }
+        for (std::thread& thread : threads) thread.join();
+        const double ns { elapsed_ns(start) };
+        const double scrapes { static_cast<double>(clients * scrapes_per_client) };
+        report.add("openmetrics_scrape", { { "clients", clients }, { "scrapes", clients * scrapes_per_client } },
+                   { { "scrapes_per_second", scrapes / (ns / 1e9) }, { "ns_per_scrape", ns / scrapes },
+                     { "failed", failed.load() } });
+    }
+    server.stop();
+}
+
+/**
+ *  Readings per second through the ingest server: client threads stream frames of 1024 readings
+ *  over a Unix socket, timed until the server has stored every reading
+ */
+static void bench_ingest(const BenchOptions& options, BenchReport& report) {
+    const std::string socket_path { (std::filesystem::temp_directory_path() / "weather_bench_ingest.sock").string() };
+    constexpr std::uint32_t batch { 1024 };
+    std::vector<std::uint8_t> frame;
+    append_ingest_header(frame, batch);
+    for (std::uint32_t i = 0; i < batch; i++) append_ingest_record(frame, static_cast<std::uint8_t>(i % 3), 0, 20.0 + i % 7);
+
+    for (unsigned clients : { 1u, 4u, 8u }) {
+        const std::size_t frames_per_client { std::max<std::size_t>(1, std::min<std::size_t>(options.max_readings, 20'000'000)
+                                                                          / clients / batch) };
+        const std::size_t total { frames_per_client * batch * clients };
+        auto data { std::make_unique<SensorData>() };
+        IngestServer server;
+        if (!server.start({ socket_path, -1 }, *data)) return;
+
+        std::vector<std::thread> threads;
+        const auto start { Clock::now() };
+        for (unsigned c = 0; c < clients; c++) {
+            threads.emplace_back([&] {
+                const int fd { ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0) };
+                sockaddr_un address {};
+                address.sun_family = AF_UNIX;
+                std::snprintf(address.sun_path, sizeof(address.sun_path), "%s", socket_path.c_str());
+                if (::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0) {
+                    for (std::size_t i = 0; i < frames_per_client; i++) {
+                        const std::uint8_t* bytes { frame.data() };
+                        std::size_t left { frame.size() };
+                        while (left > 0) {
+                            const ssize_t sent { ::send(fd, bytes, left, MSG_NOSIGNAL) };
+                            if (sent <= 0) break;
+                            bytes += sent;
+                            left -= static_cast<std::size_t>(sent);
+                        }
+                    }
+                }
+                ::close(fd);
+            });
+        }
+        for (std::thread& thread : threads) thread.join();
+        // the server may still be decoding what the clients sent last
+        while (server.readings() < total && elapsed_ns(start) < 60e9) std::this_thread::sleep_for(100us);
+        const double ns { elapsed_ns(start) };
+        report.add("ingest", { { "clients", clients }, { "readings", total }, { "batch", batch } },
+                   { { "readings_per_second", static_cast<double>(server.readings()) / (ns / 1e9) },
+                     { "received", server.readings() } });
+        server.stop();
+    }
+}
+
+/**
+ *  store_batch() with 0 to 16 subscribers, and with one subscriber that stalls in its callback
+ *  (drop_oldest), to show that fan-out does not slow ingest
+ */
+static void bench_publish(const BenchOptions& options, BenchReport& report) {
+    constexpr std::size_t batch_size { 1024 };
+    const std::size_t batches { std::max<std::size_t>(1, std::min<std::size_t>(options.max_readings, 10'000'000) / batch_size) };
+    SensorReadings batch;
+    for (std::size_t i = 0; i < batch_size; i++) {
+        batch[all_sensors[i % sensor_count]].push_back({ std::chrono::system_clock::now(), 20.0 + i % 7 });
+    }
+
+    struct Case { unsigned subscribers; bool stalled; };
+    for (const Case& test : { Case { 0, false }, Case { 1, false }, Case { 4, false }, Case { 16, false }, Case { 1, true } }) {
+        auto data { std::make_unique<SensorData>() };
+        std::atomic<std::uint64_t> received{};
+        std::vector<Subscription> subscriptions;
+        for (unsigned s = 0; s < test.subscribers; s++) {
+            subscriptions.push_back(data->subscribe([&received, stalled = test.stalled](const SensorReadings& readings) {
+                if (stalled) std::this_thread::sleep_for(10ms);
+                received.fetch_add(readings.temperature.size() + readings.humidity.size() + readings.windspeed.size(),
+                                   std::memory_order_relaxed);
+            }));
+        }
+        const auto start { Clock::now() };
+        for (std::size_t i = 0; i < batches; i++) data->store_batch(batch);
+        const double ns { elapsed_ns(start) };
+        std::uint64_t dropped{};
+        for (Subscription& subscription : subscriptions) {
+            dropped += subscription.dropped();
+            subscription.unsubscribe();
+        }
+        report.add("publish", { { "subscribers", test.subscribers }, { "stalled", test.stalled },
+                                { "readings", batches * batch_size } },
+                   { { "readings_per_second", static_cast<double>(batches * batch_size) / (ns / 1e9) },
+                     { "ns_per_batch", ns / static_cast<double>(batches) },
+                     { "delivered", received.load() }, { "dropped", dropped } });
+    }
+}
+
+/**
+ *  Seqlock write and read of one latest value slot, reads with and without a writer storing to
+ *  the same slot at full speed; every value equals its timestamp so a torn read would show up
+ */
+static void bench_latest_values(const BenchOptions&, BenchReport& report) {
+    LatestValueWriter writer;
+    const std::string name { "/weather_bench_" + std::to_string(::getpid()) };
+    if (!writer.create(name)) return;
+    LatestValueSlot& slot { writer.table()->slots[0] };
+
+    constexpr std::size_t writes { 10'000'000 };
+    auto start { Clock::now() };
+    for (std::size_t i = 1; i <= writes; i++) write_latest_value(slot, static_cast<std::int64_t>(i), static_cast<double>(i));
+    report.add("latest_values_write", { { "writes", writes } }, { { "ns_per_write", elapsed_ns(start) / writes } });
+
+    LatestValueReader reader;
+    if (!reader.open(name)) return;
+    for (bool concurrent_writer : { false, true }) {
+        std::atomic<bool> stop{};
+        std::thread writing;
+        if (concurrent_writer) {
+            writing = std::thread([&] {
+                for (std::int64_t i = writes + 1; !stop.load(std::memory_order_relaxed); i++) {
+                    write_latest_value(slot, i, static_cast<double>(i));
+                }
+            });
+        }
+        constexpr std::size_t reads { 10'000'000 };
+        std::size_t torn{};
+        std::size_t failed{};
+        LatestValue latest{};
+        start = Clock::now();
+        for (std::size_t i = 0; i < reads; i++) {
+            // a read that gives up leaves latest as it was, it is not compared
+            if (!reader.read(SensorId::temperature, latest)) failed++;
+            else if (latest.value != static_cast<double>(latest.time_point.time_since_epoch().count())) torn++;
+        }
+        const double ns { elapsed_ns(start) };
+        stop = true;
+        if (writing.joinable()) writing.join();
+        report.add("latest_values_read", { { "reads", reads }, { "concurrent_writer", concurrent_writer } },
+                   { { "ns_per_read", ns / reads }, { "torn", torn }, { "failed", failed } });
+    }
+}
+
+/**
+ *  range() and range_statistics() against a linear scan over the same random time ranges,
+ *  the results are compared and differences counted as mismatches
+ */
+static void bench_range_query(const BenchOptions& options, BenchReport& report) {
+    for (std::size_t size : decade_sizes(10'000, 10'000'000, options.max_readings)) {
+        std::unique_ptr<SensorData> data { make_history(size) };
+        const SensorSeries& readings { data->committed_readings(SensorId::temperature) };
+        const auto begin_ns { to_epoch_ns(readings.front().time_point) };
+        const auto span_ns { to_epoch_ns(readings.back().time_point) - begin_ns };
+        std::mt19937_64 random { 42 };
+        constexpr std::size_t queries { 200 };
+        std::vector<std::pair<std::chrono::system_clock::time_point, std::chrono::system_clock::time_point>> ranges;
+        for (std::size_t i = 0; i < queries; i++) {
+            std::int64_t a { begin_ns + static_cast<std::int64_t>(random() % static_cast<std::uint64_t>(span_ns + 1)) };
+            std::int64_t b { begin_ns + static_cast<std::int64_t>(random() % static_cast<std::uint64_t>(span_ns + 1)) };
+            ranges.emplace_back(from_epoch_ns(std::min(a, b)), from_epoch_ns(std::max(a, b)));
+        }
+
+        std::vector<Stats> indexed;
+        auto start { Clock::now() };
+        std::size_t range_readings{};
+        for (const auto& [from, to] : ranges) range_readings += data->range(SensorId::temperature, from, to).size();
+        const double range_ns { elapsed_ns(start) };
+        start = Clock::now();
+        for (const auto& [from, to] : ranges) indexed.push_back(data->range_statistics(SensorId::temperature, from, to));
+        const double aggregate_ns { elapsed_ns(start) };
+
+        std::size_t mismatches{};
+        start = Clock::now();
+        for (std::size_t q = 0; q < queries; q++) {
+            const auto& [from, to] { ranges[q] };
+            Stats scanned {};
+            double sum{};
+            for (const TimeDouble& reading : readings) {
+                if (reading.time_point < from || reading.time_point >= to) continue;
+                if (scanned.count == 0 || reading.value > scanned.max.value) scanned.max = reading;
+                if (scanned.count == 0 || reading.value < scanned.min.value) scanned.min = reading;
+                sum += reading.value;
+                scanned.count++;
+            }
+            if (scanned.count > 0) scanned.average = sum / static_cast<double>(scanned.count);
+            const Stats& stat { indexed[q] };
+            if (stat.count != scanned.count || (stat.count > 0 && (stat.max.value != scanned.max.value
+                || stat.min.value != scanned.min.value || std::abs(stat.average - scanned.average) > 1e-9))) {
+                mismatches++;
+            }
+        }
+        const double scan_ns { elapsed_ns(start) };
+        report.add("range_query", { { "readings", size }, { "queries", queries } },
+                   { { "range_ns", range_ns / queries }, { "range_statistics_ns", aggregate_ns / queries },
+                     { "linear_scan_ns", scan_ns / queries }, { "mean_range_readings", range_readings / queries },
+                     { "mismatches", mismatches } });
+    }
+}
+
+/**
+ *  Rollup tier update cost per reading, and a whole history chart of 300 points
+ *  from the rollup tiers against 300 range_statistics calls on the raw readings
+ *  Readings are 100 ms apart so the history spans up to 11 days
+ */
+static void bench_rollup(const BenchOptions& options, BenchReport& report) {
+    for (std::size_t size : decade_sizes(10'000, 10'000'000, options.max_readings)) {
+        DataGenerator temperature ( -15, 30, -0.2, 0.2 );
+        temperature.get_initial_value();
+        const auto begin { std::chrono::system_clock::now() - std::chrono::milliseconds { 100 } * size };
+        std::vector<TimeDouble> readings;
+        readings.reserve(size);
+        for (std::size_t i = 0; i < size; i++) {
+            readings.push_back({ begin + std::chrono::milliseconds { 100 } * i, temperature.get_new_value() });
+        }
+
+        RollupSeries series;
+        auto start { Clock::now() };
+        series.add(readings);
+        const double add_ns { elapsed_ns(start) };
+
+        auto data { std::make_unique<SensorData>() };
+        data->replay_readings(SensorId::temperature, readings);
+        const auto from { readings.front().time_point };
+        const auto to { readings.back().time_point + std::chrono::milliseconds { 1 } };
+        constexpr std::size_t points { 300 };
+        constexpr int repeats { 20 };
+        std::size_t buckets{};
+        start = Clock::now();
+        for (int r = 0; r < repeats; r++) buckets = data->rollup(SensorId::temperature, from, to, points).size();
+        const double rollup_ns { elapsed_ns(start) };
+
+        start = Clock::now();
+        std::size_t counted{};
+        for (int r = 0; r < repeats; r++) {
+            counted = 0;
+            const auto step { (to - from) / static_cast<std::int64_t>(points) + std::chrono::nanoseconds { 1 } };
+            for (auto point = from; point < to; point += step) {
+                counted += data->range_statistics(SensorId::temperature, point, std::min(point + step, to)).count;
+            }
+        }
+        const double statistics_ns { elapsed_ns(start) };
+        report.add("rollup", { { "readings", size }, { "points", points } },
+                   { { "add_per_reading_ns", add_ns / static_cast<double>(size) },
+                     { "rollup_query_ns", rollup_ns / repeats }, { "range_statistics_query_ns", statistics_ns / repeats },
+                     { "rollup_buckets", buckets }, { "range_statistics_readings", counted } });
+    }
+}
+
+/**
+ *  Deadband and swinging door filters over a DataGenerator signal sampled every 500 ms
+ *  Reports the compression ratio, filter cost per reading and the largest error when the signal
+ *  is read back from the kept readings (steps for deadband, straight lines for swinging door)
+ */
+static void bench_compression(const BenchOptions& options, BenchReport& report) {
+    const std::size_t size { std::min<std::size_t>(1'000'000, options.max_readings) };
+    DataGenerator temperature ( -15, 30, -0.2, 0.2 );
+    temperature.get_initial_value();
+    const auto begin { std::chrono::system_clock::now() };
+    std::vector<TimeDouble> readings;
+    readings.reserve(size);
+    for (std::size_t i = 0; i < size; i++) {
+        readings.push_back({ begin + std::chrono::milliseconds { 500 } * i, temperature.get_new_value() });
+    }
+    for (CompressionMode mode : { CompressionMode::deadband, CompressionMode::swinging_door }) {
+        for (double deviation : { 0.01, 0.1, 0.5 }) {
+            CompressionFilter filter { { mode, deviation } };
+            std::vector<TimeDouble> kept;
+            const auto start { Clock::now() };
+            filter.filter(readings, kept);
+            const double filter_ns { elapsed_ns(start) };
+            if (filter.pending()) kept.push_back(*filter.pending());
+
+            double max_error{};
+            std::size_t segment{};
+            for (const TimeDouble& reading : readings) {
+                while (segment + 1 < kept.size() && kept[segment + 1].time_point <= reading.time_point) segment++;
+                const TimeDouble& left { kept[segment] };
+                double rebuilt { left.value };
+                if (mode == CompressionMode::swinging_door && segment + 1 < kept.size()) {
+                    const TimeDouble& right { kept[segment + 1] };
+                    const double fraction { static_cast<double>((reading.time_point - left.time_point).count())
+                                            / static_cast<double>((right.time_point - left.time_point).count()) };
+                    rebuilt = left.value + (right.value - left.value) * fraction;
+                }
+                max_error = std::max(max_error, std::abs(reading.value - rebuilt));
+            }
+            report.add("compression", { { "mode", compression_mode_name(mode) }, { "deviation", deviation },
+                                        { "readings", size } },
+                       { { "ratio", static_cast<double>(size) / static_cast<double>(kept.size()) },
+                         { "filter_ns_per_reading", filter_ns / static_cast<double>(size) },
+                         { "max_error", max_error }, { "within_deviation", max_error <= deviation + 1e-9 } });
+        }
+    }
+}
+
+/**
+ *  History memory and a full scan (what the time index does per block) with double values
+ *  against 16 bit codes of 0.01 within the sensor range
+ */
+static void bench_quantized(const BenchOptions& options, BenchReport& report) {
+    for (std::size_t size : decade_sizes(100'000, 10'000'000, options.max_readings)) {
+        std::unique_ptr<SensorData> data { make_history(size) };
+        const SensorSeries& readings { data->committed_readings(SensorId::temperature) };
+        std::vector<TimeDouble> original(readings.size());
+        readings.decode(0, readings.size(), original.data());
+        for (double step : { 0.0, 0.01 }) {
+            data->set_quantization(SensorId::temperature, step);
+            constexpr int repeats { 5 };
+            double sum{};
+            const auto start { Clock::now() };
+            for (int r = 0; r < repeats; r++) {
+                for (std::size_t begin = 0; begin < readings.size(); begin += TimeIndex::block_size) {
+                    sum += readings.summarize(begin, std::min(begin + TimeIndex::block_size, readings.size())).sum;
+                }
+            }
+            const double scan_ns { elapsed_ns(start) / repeats };
+            double max_error{};
+            std::size_t index{};
+            for (const TimeDouble& reading : readings) max_error = std::max(max_error, std::abs(reading.value - original[index++].value));
+            report.add("quantized", { { "readings", size }, { "step", step } },
+                       { { "bytes_per_reading", static_cast<double>(readings.memory_bytes()) / static_cast<double>(size) },
+                         { "scan_ns_per_reading", scan_ns / static_cast<double>(size) },
+                         { "max_error", max_error }, { "checksum", sum } });
+        }
+    }
+}
+
+/**
+ *  500 ms readings with up to 0.2 ms of jitter, a slow drift and a pause every 100000 readings,
+ *  stored with explicit times and as periodic runs (1 ms tolerance), with and without quantized values
+ *  Reports memory, runs and exceptions, random time lookups, decoding and the largest time error
+ */
+static void bench_implicit_times(const BenchOptions& options, BenchReport& report) {
+    for (std::size_t size : decade_sizes(100'000, 10'000'000, options.max_readings)) {
+        DataGenerator temperature ( -15, 30, -0.2, 0.2 );
+        temperature.get_initial_value();
+        std::mt19937_64 random { 42 };
+        std::uniform_int_distribution<std::int64_t> jitter { 0, 200'000 };
+        std::vector<TimeDouble> readings;
+        readings.reserve(size);
+        std::int64_t ns { to_epoch_ns(std::chrono::system_clock::now()) };
+        for (std::size_t i = 0; i < size; i++) {
+            ns += 500'000'000 + 3'000 + (i % 100'000 == 99'999 ? 60'000'000'000 : 0);
+            readings.push_back({ from_epoch_ns(ns + jitter(random)), temperature.get_new_value() });
+        }
+        for (bool implicit : { false, true }) {
+            for (double step : { 0.0, 0.01 }) {
+                SensorSeries series;
+                series.set_quantization(step, sensor_range(SensorId::temperature));
+                series.set_implicit_times(implicit, std::chrono::milliseconds { 1 });
+                series.reserve(size);
+                auto start { Clock::now() };
+                series.append(readings);
+                const double append_ns { elapsed_ns(start) };
+
+                constexpr std::size_t lookups { 1'000'000 };
+                std::int64_t checksum{};
+                start = Clock::now();
+                for (std::size_t i = 0; i < lookups; i++) {
+                    checksum += to_epoch_ns(series.time_point(static_cast<std::size_t>(random() % size)));
+                }
+                const double lookup_ns { elapsed_ns(start) };
+
+                std::vector<TimeDouble> decoded(size);
+                start = Clock::now();
+                series.decode(0, size, decoded.data());
+                const double decode_ns { elapsed_ns(start) };
+                std::int64_t max_time_error{};
+                for (std::size_t i = 0; i < size; i++) {
+                    max_time_error = std::max(max_time_error,
+                                              std::abs(to_epoch_ns(decoded[i].time_point) - to_epoch_ns(readings[i].time_point)));
+                }
+                report.add("implicit_times", { { "readings", size }, { "implicit", implicit }, { "step", step } },
+                           { { "bytes_per_reading", static_cast<double>(series.memory_bytes()) / static_cast<double>(size) },
+                             { "runs", series.time_runs().size() }, { "exceptions", series.time_exceptions() },
+                             { "append_ns_per_reading", append_ns / static_cast<double>(size) },
+                             { "time_lookup_ns", lookup_ns / lookups },
+                             { "decode_ns_per_reading", decode_ns / static_cast<double>(size) },
+                             { "max_time_error_ns", max_time_error }, { "checksum", checksum % 1000 } });
+            }
+        }
+    }
+}
+
+/**
+ *  Cost of one timestamp from each clock source, inside a ClockBatch for batch, and store_new_reading
+ *  from one producer with it. Also reports the largest difference to system_clock and how many
+ *  distinct times 1M calls return (the resolution)
+ */
+static void bench_clock(const BenchOptions&, BenchReport& report) {
+    constexpr std::size_t calls { 10'000'000 };
+    for (ClockSource source : { ClockSource::system, ClockSource::coarse, ClockSource::tsc, ClockSource::batch }) {
+        SensorData data;
+        if (!data.clock().set_source(source)) continue;
+        const ReadingClock& clock { data.clock() };
+        ClockBatch batch { clock };
+        std::int64_t checksum{};
+        auto start { Clock::now() };
+        for (std::size_t i = 0; i < calls; i++) checksum += clock.now().time_since_epoch().count();
+        const double now_ns { elapsed_ns(start) / calls };
+
+        std::int64_t max_offset{};
+        std::size_t distinct{};
+        std::chrono::system_clock::time_point previous{};
+        for (std::size_t i = 0; i < 1'000'000; i++) {
+            const auto time { clock.now() };
+            if (i % 1000 == 0) {
+                max_offset = std::max(max_offset, std::abs(to_epoch_ns(time) - to_epoch_ns(std::chrono::system_clock::now())));
+            }
+            if (time != previous) distinct++;
+            previous = time;
+        }
+
+        constexpr std::size_t stores { 1'000'000 };
+        start = Clock::now();
+        for (std::size_t i = 0; i < stores; i++) data.store_temperature_reading(static_cast<double>(i % 100));
+        const double store_ns { elapsed_ns(start) / stores };
+        report.add("clock", { { "source", clock_source_name(source) } },
+                   { { "now_ns", now_ns }, { "store_ns_per_reading", store_ns },
+                     { "max_offset_ns", max_offset }, { "distinct_per_1m", distinct }, { "checksum", checksum % 1000 } });
+    }
+}
+
+// the per-sensor counters as they were before they got their own cache lines
+struct PackedSensorCounters {
+    std::atomic<std::uint64_t> readings_total{};
+    std::atomic<double> readings_per_second{};
+    std::atomic<std::uint64_t> backlog{};
+};
+
+/**
+ *  1-3 producers, each counting readings of its own sensor the way store_new_reading does, with and
+ *  without a thread reading the counters, into the packed layout and into Metrics, where every
+ *  sensor and the reader-side fields have their own cache lines
+ *  Only shows a difference with one core per thread, see hardware_concurrency in the report
+ */
+static void bench_false_sharing(const BenchOptions&, BenchReport& report) {
+    constexpr std::size_t per_producer { 20'000'000 };
+    for (bool aligned : { false, true }) {
+        for (bool reader : { false, true }) {
+            for (int producers : { 1, 2, 3 }) {
+                PackedSensorCounters packed[sensor_count];
+                Metrics metrics;
+                std::atomic_bool go { false };
+                std::atomic_bool done { false };
+                std::vector<std::thread> threads;
+                for (int p = 0; p < producers; p++) {
+                    threads.emplace_back([&, p] {
+                        const SensorId id { all_sensors[static_cast<std::size_t>(p)] };
+                        while (!go) std::this_thread::yield();
+                        for (std::size_t i = 0; i < per_producer; i++) {
+                            if (aligned) metrics.record_reading(id, i);
+                            else {
+                                packed[p].readings_total.fetch_add(1, std::memory_order_relaxed);
+                                packed[p].backlog.store(i, std::memory_order_relaxed);
+                            }
+                        }
+                    });
+                }
+                std::thread scraper;
+                std::uint64_t reads{};
+                if (reader) {
+                    scraper = std::thread([&] {
+                        while (!go) std::this_thread::yield();
+                        double sum{};
+                        while (!done.load(std::memory_order_relaxed)) {
+                            // the same loads in both layouts, one readings_per_second per sensor
+                            for (std::size_t s = 0; s < sensor_count; s++) {
+                                sum += aligned ? metrics.readings_per_second(all_sensors[s])
+                                               : packed[s].readings_per_second.load(std::memory_order_relaxed);
+                            }
+                            reads++;
+                        }
+                        if (sum < 0) std::cout << sum;
+                    });
+                }
+                const auto start { Clock::now() };
+                go = true;
+                for (auto& thread : threads) thread.join();
+                const double ns { elapsed_ns(start) };
+                done = true;
+                if (scraper.joinable()) scraper.join();
+                report.add("false_sharing", { { "layout", aligned ? "aligned" : "packed" }, { "reader", reader },
+                                              { "producers", producers } },
+                           { { "ns_per_reading", ns / static_cast<double>(per_producer) },
+                             { "readings_per_second", static_cast<double>(per_producer) * producers / ns * 1e9 },
+                             { "reader_passes", reads } });
+            }
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    BenchOptions options;
+    bool usage {};
+    try {
+        for (int i = 1; i < argc && !usage; i++) {
+            std::string arg { argv[i] };
+            if (arg == "--filter" && i + 1 < argc) options.filter = argv[++i];
+            else if (arg == "--max-readings" && i + 1 < argc) options.max_readings = std::stoull(argv[++i]);
+            else if (arg == "--out" && i + 1 < argc) options.out = argv[++i];
+            else usage = true;
+        }
+    } catch (const std::logic_error&) {
+        usage = true;
+    }
+    if (usage) {
+        std::cerr << "Usage: weather_bench [--filter <text>] [--max-readings <n>] [--out <file>]\n";
+        return 1;
+    }
+
+    const std::vector<std::pair<std::string, std::function<void(const BenchOptions&, BenchReport&)>>> benchmarks {
+        { "store_new_reading", bench_store_new_reading },
+        { "store_readings", bench_store_readings },
+        { "calculate_statistics", bench_calculate_statistics },
+        { "move_sensor_data", bench_move_sensor_data },
+        { "construct_json_object", bench_construct_json_object },
+        { "save_sensordata", bench_save_formats },
+        { "export_scratch", bench_export_scratch },
+        { "parallel_export", bench_parallel_export },
+        { "stream_load", bench_stream_load },
+        { "trace_scope", bench_trace_scope },
+        { "openmetrics", bench_openmetrics },
+        { "ingest", bench_ingest },
+        { "publish", bench_publish },
+        { "latest_values", bench_latest_values },
+        { "range_query", bench_range_query },
+        { "rollup", bench_rollup },
+        { "compression", bench_compression },
+        { "quantized", bench_quantized },
+        { "implicit_times", bench_implicit_times },
+        { "clock", bench_clock },
+        { "false_sharing", bench_false_sharing },
+    };
+
+    BenchReport report;
+    for (const auto& [name, run] : benchmarks) {
+        if (name.find(options.filter) == std::string::npos) continue;
+        run(options, report);
+    }
+
+    // only prints when built with WEATHER_SENSORS_LOCK_STATS
+    print_lock_statistics(std::cout);
+
+    std::ofstream out(options.out);
+    out << std::setw(2) << report.document() << std::endl;
+    std::cout << "Results written to " << options.out << "\n";
+    return 0;
+}
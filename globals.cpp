@@ -1,11 +1,25 @@
 #include "globals.h"
 
-std::mutex sensor_mutex;
+SensorMutex sensor_mutex;       // std::mutex unless built with WEATHER_SENSORS_LOCK_STATS
 std::atomic_bool system_running { true };  
 
 /** 
  *  Global object to store data
+ *  and the log that every committed batch is appended to
+ *  and where the statistics thread writes snapshots
+ *  file_writer does the disk I/O of snapshots and exports in the background
+ *  metrics_server serves what the statistics thread last published in OpenMetrics format
+ *  ingest_server receives readings from external collectors
+ *  feed_server streams every stored reading to local subscribers
+ *  latest_values owns the shared memory table with the newest reading of each sensor
  */
 namespace sensor_data {
     SensorData sensor;
+    WriteAheadLog wal;
+    SnapshotOptions snapshot_options;
+    AsyncWriter file_writer;
+    MetricsServer metrics_server;
+    IngestServer ingest_server;
+    FeedServer feed_server;
+    LatestValueWriter latest_values;
 }
@@ -1,6 +1,13 @@
 #ifndef WEATHER_SENSORS_GLOBALS_H
 #define WEATHER_SENSORS_GLOBALS_H
 #include "SensorData.h"
+#include "WriteAheadLog.h"
+#include "Snapshot.h"
+#include "AsyncWriter.h"
+#include "MetricsServer.h"
+#include "IngestServer.h"
+#include "FeedServer.h"
+#include "LatestValues.h"
 
 
 #endif
\ No newline at end of file
@@ -5,6 +5,8 @@
 #include "threads.h"
 #include "SaveJson.h"
 #include <iostream>
+#include <filesystem>
+#include <stdexcept>
 
 /**
  *  Global variables declared as extern to be available also in this file
@@ -13,10 +15,235 @@ extern std::atomic_bool system_running;
 
 namespace sensor_data {
     extern SensorData sensor;
+    extern WriteAheadLog wal;
+    extern SnapshotOptions snapshot_options;
+    extern AsyncWriter file_writer;
+    extern MetricsServer metrics_server;
+    extern IngestServer ingest_server;
+    extern FeedServer feed_server;
+    extern LatestValueWriter latest_values;
 }
 
-int main() 
+int main(int argc, char* argv[])
 {
+    const auto startup_begin { std::chrono::steady_clock::now() };
+    // optional output format: --format json|cbor|msgpack|ubjson|bjdata
+    // optional timestamp encoding: --timestamps ns|ms|rfc3339|local
+    SaveFormat save_format { SaveFormat::json };
+    TimestampFormat timestamp_format { TimestampFormat::epoch_ns };
+    // write-ahead log: --wal <path>|off, --wal-sync-ms <ms>, --wal-sync-bytes <bytes>
+    std::string wal_path { "SensorData.wal" };
+    WalOptions wal_options;
+    // snapshots: --snapshot <path>|off, --snapshot-every <statistics passes>
+    SnapshotOptions& snapshot_options { sensor_data::snapshot_options };
+    snapshot_options.path = "SensorData.snapshot";
+    // self metrics written at exit: --metrics <file.json>
+    std::string metrics_path;
+    // thread activity trace: --trace <file.json>
+    std::string trace_path;
+    // OpenMetrics endpoint: --http <port|127.0.0.1:port|unix:path>
+    MetricsServerOptions http_options;
+    // readings from external collectors: --ingest-unix <path>, --ingest-udp <port>
+    IngestServerOptions ingest_options;
+    // live feed of readings: --feed-unix <path>, --feed-queue <readings>, --feed-policy drop-oldest|disconnect
+    FeedServerOptions feed_options;
+    // shared memory table of the newest readings: --shm <name>, e.g. /weather_sensors
+    std::string shm_name;
+    // rollup tiers: --rollups <resolution:buckets,...>, e.g. 1s:3600,1m:10080,1h:8760
+    std::vector<RollupTierOptions> rollup_tiers { default_rollup_tiers };
+    // history compression: --compress <mode:deviation> or <sensor=mode:deviation,...>, e.g. swinging-door:0.05
+    CompressionOptions compression[sensor_count];
+    // quantized history values: --quantize <step> or <sensor=step,...>, e.g. 0.01
+    double quantization_steps[sensor_count] {};
+    // periodic history times: --implicit-times <tolerance ms> or <sensor=ms,...>, e.g. 2
+    double time_tolerances_ms[sensor_count] { -1, -1, -1 };
+    // reading timestamps: --clock system|coarse|tsc|batch
+    ClockSource clock_source { ClockSource::system };
+    // background file writer: --writer io_uring|pwrite
+    AsyncWriterOptions writer_options;
+    int i { 1 };
+    try {
+        for (; i < argc; i++) {
+            std::string arg { argv[i] };
+            if (arg == "--format" && i + 1 < argc) {
+                if (!parse_save_format(argv[++i], save_format)) {
+                    std::cerr << "Unknown format " << argv[i] << ", use json, cbor, msgpack, ubjson or bjdata\n";
+                    return 1;
+                }
+            } else if (arg == "--timestamps" && i + 1 < argc) {
+                if (!parse_timestamp_format(argv[++i], timestamp_format)) {
+                    std::cerr << "Unknown timestamp format " << argv[i] << ", use ns, ms, rfc3339 or local\n";
+                    return 1;
+                }
+            } else if (arg == "--wal" && i + 1 < argc) {
+                wal_path = argv[++i];
+            } else if (arg == "--wal-sync-ms" && i + 1 < argc) {
+                wal_options.sync_interval = std::chrono::milliseconds { std::stoll(argv[++i]) };
+            } else if (arg == "--wal-sync-bytes" && i + 1 < argc) {
+                wal_options.sync_bytes = std::stoull(argv[++i]);
+            } else if (arg == "--snapshot" && i + 1 < argc) {
+                snapshot_options.path = argv[++i];
+                if (snapshot_options.path == "off") snapshot_options.path.clear();
+            } else if (arg == "--snapshot-every" && i + 1 < argc) {
+                snapshot_options.every_passes = std::stoi(argv[++i]);
+            } else if (arg == "--metrics" && i + 1 < argc) {
+                metrics_path = argv[++i];
+            } else if (arg == "--trace" && i + 1 < argc) {
+                trace_path = argv[++i];
+            } else if (arg == "--http" && i + 1 < argc) {
+                http_options.address = argv[++i];
+            } else if (arg == "--ingest-unix" && i + 1 < argc) {
+                ingest_options.unix_path = argv[++i];
+            } else if (arg == "--ingest-udp" && i + 1 < argc) {
+                ingest_options.udp_port = std::stoi(argv[++i]);
+            } else if (arg == "--feed-unix" && i + 1 < argc) {
+                feed_options.unix_path = argv[++i];
+            } else if (arg == "--feed-queue" && i + 1 < argc) {
+                feed_options.subscriber.queue_readings = std::stoull(argv[++i]);
+            } else if (arg == "--feed-policy" && i + 1 < argc) {
+                if (!parse_subscriber_policy(argv[++i], feed_options.subscriber.policy)) {
+                    std::cerr << "Unknown feed policy " << argv[i] << ", use drop-oldest or disconnect\n";
+                    return 1;
+                }
+            } else if (arg == "--shm" && i + 1 < argc) {
+                shm_name = argv[++i];
+            } else if (arg == "--rollups" && i + 1 < argc) {
+                if (!parse_rollup_tiers(argv[++i], rollup_tiers)) {
+                    std::cerr << "Invalid rollup tiers " << argv[i] << ", use e.g. 1s:3600,1m:10080,1h:8760\n";
+                    return 1;
+                }
+            } else if (arg == "--compress" && i + 1 < argc) {
+                if (!parse_compression(argv[++i], compression)) {
+                    std::cerr << "Invalid compression " << argv[i]
+                              << ", use e.g. swinging-door:0.05 or temperature=deadband:0.1,humidity=off\n";
+                    return 1;
+                }
+            } else if (arg == "--quantize" && i + 1 < argc) {
+                if (!parse_sensor_numbers(argv[++i], quantization_steps)) {
+                    std::cerr << "Invalid quantization " << argv[i]
+                              << ", use e.g. 0.01 or temperature=0.01,humidity=0.1\n";
+                    return 1;
+                }
+            } else if (arg == "--implicit-times" && i + 1 < argc) {
+                if (!parse_sensor_numbers(argv[++i], time_tolerances_ms)) {
+                    std::cerr << "Invalid time tolerance " << argv[i]
+                              << ", use milliseconds, e.g. 2 or temperature=2\n";
+                    return 1;
+                }
+            } else if (arg == "--clock" && i + 1 < argc) {
+                if (!parse_clock_source(argv[++i], clock_source)) {
+                    std::cerr << "Unknown clock " << argv[i] << ", use system, coarse, tsc or batch\n";
+                    return 1;
+                }
+            } else if (arg == "--writer" && i + 1 < argc) {
+                const std::string writer { argv[++i] };
+                if (writer != "io_uring" && writer != "pwrite") {
+                    std::cerr << "Unknown writer " << writer << ", use io_uring or pwrite\n";
+                    return 1;
+                }
+                writer_options.use_io_uring = writer == "io_uring";
+            }
+        }
+    } catch (const std::logic_error&) {
+        // std::stoi and friends throw invalid_argument or out_of_range
+        std::cerr << "Invalid number " << argv[i] << " for " << argv[i - 1] << "\n";
+        return 1;
+    }
+
+    trace_set_thread_name("main");
+    if (!sensor_data::sensor.clock().set_source(clock_source)) {
+        std::cerr << "Clock " << clock_source_name(clock_source) << " is not available on this machine\n";
+        return 1;
+    }
+    sensor_data::sensor.set_rollup_tiers(rollup_tiers);
+    for (SensorId id : all_sensors) {
+        sensor_data::sensor.set_compression(id, compression[static_cast<std::size_t>(id)]);
+        if (!sensor_data::sensor.set_quantization(id, quantization_steps[static_cast<std::size_t>(id)])) {
+            std::cerr << "Quantization step for " << sensor_name(id) << " is too small for its range\n";
+            return 1;
+        }
+        const double tolerance_ms { time_tolerances_ms[static_cast<std::size_t>(id)] };
+        if (tolerance_ms >= 0) {
+            sensor_data::sensor.set_implicit_times(id, true, std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::duration<double, std::milli> { tolerance_ms }));
+        }
+    }
+    trace_enable(!trace_path.empty());
+    sensor_data::file_writer.start(writer_options);
+
+    // rebuild the readings of earlier runs before any thread starts:
+    // load the latest snapshot, then replay only the log records written after it
+    SnapshotInfo snapshot;
+    if (!snapshot_options.path.empty()) {
+        snapshot = load_snapshot(snapshot_options.path, sensor_data::sensor);
+        if (snapshot.loaded) {
+            std::cout << "Restored " << snapshot.readings << " readings from " << snapshot_options.path << " in "
+                      << std::chrono::duration<double, std::milli>(snapshot.duration).count() << " ms\n";
+        }
+    }
+    if (wal_path != "off" && sensor_data::wal.open(wal_path, wal_options)) {
+        auto replay_log = [](WriteAheadLog& log, std::uint64_t offset) {
+            if (log.size() < offset) {
+                std::cout << log.path() << " is shorter than when the snapshot was taken, nothing to replay\n";
+                return;
+            }
+            WalReplayResult replayed { log.replay([](SensorId id, const std::vector<TimeDouble>& readings) {
+                sensor_data::sensor.replay_readings(id, readings);
+            }, offset) };
+            std::cout << "Replayed " << replayed.readings << " readings (" << replayed.records << " records) from "
+                      << log.path() << " in "
+                      << std::chrono::duration<double, std::milli>(replayed.duration).count() << " ms\n";
+            if (replayed.damaged_tail) {
+                std::cout << "Damaged records at the end of " << log.path() << " were discarded\n";
+            }
+        };
+        // a segment rotated away is still there when the snapshot taken with it did not reach the disk
+        WriteAheadLog previous;
+        if (std::filesystem::exists(sensor_data::wal.previous_path())) {
+            previous.open(sensor_data::wal.previous_path(), wal_options);
+        }
+        if (previous.is_open() && (!snapshot.loaded || snapshot.wal.log.matches(previous.position().log))) {
+            replay_log(previous, snapshot.wal.offset);
+            replay_log(sensor_data::wal, 0);
+        } else if (!snapshot.loaded || snapshot.wal.log.matches(sensor_data::wal.position().log)) {
+            // a previous segment left next to a newer snapshot is already covered by it
+            if (previous.is_open()) sensor_data::wal.drop_previous();
+            replay_log(sensor_data::wal, snapshot.wal.offset);
+        } else {
+            // a snapshot taken without this log (--wal off, or a log deleted since) may already hold its records
+            std::cout << wal_path << " is not the log the snapshot was taken with, it is not replayed\n";
+        }
+    }
+
+    if (!http_options.address.empty()) {
+        if (!sensor_data::metrics_server.start(http_options)) return 1;
+        sensor_data::metrics_server.publish(render_openmetrics(sensor_data::sensor));
+        std::cout << "Serving OpenMetrics on " << http_options.address << " at /metrics\n";
+    }
+
+    if (!ingest_options.unix_path.empty() || ingest_options.udp_port >= 0) {
+        if (!sensor_data::ingest_server.start(ingest_options, sensor_data::sensor)) return 1;
+        if (!ingest_options.unix_path.empty()) std::cout << "Ingesting readings on " << ingest_options.unix_path << "\n";
+        if (ingest_options.udp_port >= 0) {
+            std::cout << "Ingesting readings on UDP 127.0.0.1:" << sensor_data::ingest_server.udp_port() << "\n";
+        }
+    }
+
+    if (!feed_options.unix_path.empty()) {
+        if (!sensor_data::feed_server.start(feed_options, sensor_data::sensor)) return 1;
+        std::cout << "Streaming readings on " << feed_options.unix_path << "\n";
+    }
+
+    if (!shm_name.empty()) {
+        if (!sensor_data::latest_values.create(shm_name)) return 1;
+        sensor_data::sensor.attach_latest_values(sensor_data::latest_values.table());
+        std::cout << "Publishing the latest readings in shared memory " << shm_name << "\n";
+    }
+
+    std::cout << "Startup took "
+              << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startup_begin).count()
+              << " ms\n";
+
     std::thread temperature(sensor_temperature);
     std::thread relative_humidity(sensor_humidity);
     std::thread windspeed(sensor_windspeed);
@@ -25,16 +252,47 @@ int main()
     std::thread user_prompt(quit_prompt);
 
     user_prompt.join();
+    // no new external readings once quitting has started
+    if (sensor_data::ingest_server.running()) {
+        sensor_data::ingest_server.stop();
+        std::cout << "Ingested " << sensor_data::ingest_server.readings() << " readings in "
+                  << sensor_data::ingest_server.frames() << " frames, "
+                  << sensor_data::ingest_server.rejected() << " frames rejected\n";
+    }
     temperature.join();
     relative_humidity.join();
     windspeed.join();
     system_running = false;
     statistics.join();
     print_data.join();
+    sensor_data::metrics_server.stop();
+    sensor_data::feed_server.stop();
+    sensor_data::sensor.attach_latest_values(nullptr);
+    sensor_data::latest_values.close();
 
     std::cout << "STOPPING SENSOR MONITORING\n";
-    std::string filename = save_sensordata_to_json("SensorData", sensor_data::sensor);
+    print_lock_statistics(std::cout);
+    std::string filename = save_sensordata("SensorData", sensor_data::sensor, save_format, timestamp_format);
     std::cout << "Data saved to " << filename << "\n";
+    // final snapshot so the next start does not have to replay this run
+    if (!snapshot_options.path.empty() &&
+        queue_snapshot(snapshot_options.path, sensor_data::sensor, sensor_data::wal.rotate(),
+                       sensor_data::file_writer).written.get()) {
+        sensor_data::wal.drop_previous();
+    }
+    sensor_data::wal.close();
+    sensor_data::file_writer.stop();
+
+    const MetricsSnapshot metrics { sensor_data::sensor.metrics().snapshot() };
+    print_metrics(metrics, std::cout);
+    if (!metrics_path.empty()) {
+        std::ofstream metrics_file(metrics_path);
+        metrics_file << metrics_to_json(metrics).dump(3) << "\n";
+    }
+    if (!trace_path.empty()) {
+        trace_enable(false);
+        if (write_chrome_trace(trace_path)) std::cout << "Trace written to " << trace_path << "\n";
+    }
 
 
     return 0;
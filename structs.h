@@ -10,10 +10,45 @@
 #include <chrono>
 #include <vector>
 #include <algorithm>
+#include <cstdint>
+#include "LockStats.h"
 using namespace std::literals::chrono_literals;
 
+// per-sensor state written by different threads is kept on separate lines of this size
+constexpr std::size_t cache_line_size { 64 };
 
 
+
+// identifies a sensor in files and in the per sensor accessors below
+enum class SensorId : std::uint8_t {
+    temperature,
+    humidity,
+    windspeed
+};
+constexpr std::size_t sensor_count { 3 };
+constexpr SensorId all_sensors[sensor_count] { SensorId::temperature, SensorId::humidity, SensorId::windspeed };
+
+// name used in the save file and in console output
+inline const char* sensor_name(SensorId id) {
+    return id == SensorId::temperature ? "Temperature" : id == SensorId::humidity ? "Humidity" : "Wind Speed";
+}
+
+// lower case name without spaces, used as metric label and in command line options
+inline const char* sensor_label(SensorId id) {
+    return id == SensorId::temperature ? "temperature" : id == SensorId::humidity ? "humidity" : "windspeed";
+}
+
+// hard range of a sensor's values, the bounds its DataGenerator keeps to
+struct SensorRange {
+    double min;
+    double max;
+};
+
+inline SensorRange sensor_range(SensorId id) {
+    return id == SensorId::temperature ? SensorRange { -15.0, 30.0 }
+         : id == SensorId::humidity ? SensorRange { 55.0, 100.0 } : SensorRange { 0.0, 25.0 };
+}
+
 struct TimeDouble {
     std::chrono::system_clock::time_point time_point;
     double value;
@@ -24,12 +59,20 @@ struct SensorReadings {
     std::vector<TimeDouble> temperature;
     std::vector<TimeDouble> humidity;
     std::vector<TimeDouble> windspeed;
+
+    std::vector<TimeDouble>& operator[](SensorId id) {
+        return id == SensorId::temperature ? temperature : id == SensorId::humidity ? humidity : windspeed;
+    }
+    const std::vector<TimeDouble>& operator[](SensorId id) const {
+        return id == SensorId::temperature ? temperature : id == SensorId::humidity ? humidity : windspeed;
+    }
 };
 
 struct Stats {
     TimeDouble max;
     TimeDouble min;
     double average;
+    std::size_t count;      // number of readings behind average, kept so the average can be continued
 };
 
 // struct is used in SensorData class
@@ -37,6 +80,13 @@ struct SensorStatistics {
     Stats temperature;
     Stats humidity;
     Stats windspeed;
+
+    Stats& operator[](SensorId id) {
+        return id == SensorId::temperature ? temperature : id == SensorId::humidity ? humidity : windspeed;
+    }
+    const Stats& operator[](SensorId id) const {
+        return id == SensorId::temperature ? temperature : id == SensorId::humidity ? humidity : windspeed;
+    }
 };
 
 
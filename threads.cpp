@@ -3,20 +3,29 @@
 /**
  *  Global variables declared as extern to be available also in this unit (file)
  */
-extern std::mutex sensor_mutex;
+extern SensorMutex sensor_mutex;
 extern std::atomic_bool system_running;
 
 namespace sensor_data {
     extern SensorData sensor;
+    extern WriteAheadLog wal;
+    extern SnapshotOptions snapshot_options;
+    extern AsyncWriter file_writer;
+    extern MetricsServer metrics_server;
 }
 
 void sensor_temperature()
 {
-    DataGenerator temperature_generator ( -15, 30, -0.2, 0.2 );
+    trace_set_thread_name("sensor_temperature");
+    const SensorRange range { sensor_range(SensorId::temperature) };
+    DataGenerator temperature_generator ( range.min, range.max, -0.2, 0.2 );
     double temperature { temperature_generator.get_initial_value() };
 
     while (system_running) {
-        temperature = temperature_generator.get_new_value();
+        {
+            TraceScope trace("sample");
+            temperature = temperature_generator.get_new_value();
+        }
         sensor_data::sensor.store_temperature_reading(temperature);
         std::this_thread::sleep_for(500ms);
     }
@@ -25,11 +34,16 @@ void sensor_temperature()
 
 void sensor_humidity()
 {
-    DataGenerator humidity_generator ( 55.0, 100.0, -0.1, 0.1 );
+    trace_set_thread_name("sensor_humidity");
+    const SensorRange range { sensor_range(SensorId::humidity) };
+    DataGenerator humidity_generator ( range.min, range.max, -0.1, 0.1 );
     double humidity { humidity_generator.get_initial_value() };
 
     while (system_running) {
-        humidity = humidity_generator.get_new_value();
+        {
+            TraceScope trace("sample");
+            humidity = humidity_generator.get_new_value();
+        }
         sensor_data::sensor.store_humidity_reading(humidity);
         std::this_thread::sleep_for(500ms);
     }
@@ -37,11 +51,16 @@ void sensor_humidity()
 
 void sensor_windspeed()
 {
-    DataGenerator windspeed_generator ( 0.0, 25.0, -0.5, 0.5 );
+    trace_set_thread_name("sensor_windspeed");
+    const SensorRange range { sensor_range(SensorId::windspeed) };
+    DataGenerator windspeed_generator ( range.min, range.max, -0.5, 0.5 );
     double windspeed { windspeed_generator.get_initial_value() };
 
    while (system_running) {
-        windspeed = windspeed_generator.get_new_value();
+        {
+            TraceScope trace("sample");
+            windspeed = windspeed_generator.get_new_value();
+        }
         sensor_data::sensor.store_windspeed_reading(windspeed);
         std::this_thread::sleep_for(500ms);
     }    
@@ -49,40 +68,104 @@ void sensor_windspeed()
 
 
 void sensor_statistics() {
+    trace_set_thread_name("sensor_statistics");
+
+    // readings replayed from the write-ahead log already have statistics
+    static bool first_temperature { !sensor_data::sensor.has_readings(SensorId::temperature) };
+    static bool first_humidity { !sensor_data::sensor.has_readings(SensorId::humidity) };
+    static bool first_windspeed { !sensor_data::sensor.has_readings(SensorId::windspeed) };
+    SensorReadings batch;
+    SensorReadings unlogged;    // committed readings whose log write failed, retried before the next batch
+    bool has_unlogged {};
+    int passes { 0 };
+    QueuedSnapshot pending_snapshot;
 
-    static bool first_temperature { true };
-    static bool first_humidity { true };
-    static bool first_windspeed { true };
-    
     while (system_running) {
         // sleep for 5000ms (== 5s)
         for (int i = 0 ; i < 50 && system_running ; i++){
             std::this_thread::sleep_for(100ms);
+            sensor_data::wal.sync_if_due();
+        }
+        // the writer reads the history of the last snapshot in place, normally long done after a pass
+        if (pending_snapshot.released.valid()) {
+            TraceScope trace("snapshot release");
+            pending_snapshot.released.wait();
         }
         {
-            std::lock_guard<std::mutex> guard(sensor_mutex);
-            sensor_data::sensor.calculate_temperature_statistic(first_temperature);
-            sensor_data::sensor.calculate_humidity_statistic(first_humidity);
-            sensor_data::sensor.calculate_windspeed_statistic(first_windspeed);
-
+            MetricScope pass(sensor_data::sensor.metrics(), MetricTimer::statistics_pass);
+            SensorLock guard(sensor_mutex, LockSite::sensor_statistics);
+            sensor_data::sensor.metrics().update_rates();
+            sensor_data::sensor.clock().recalibrate();
+            {
+                TraceScope trace("stats pass");
+                sensor_data::sensor.calculate_temperature_statistic(first_temperature);
+                sensor_data::sensor.calculate_humidity_statistic(first_humidity);
+                sensor_data::sensor.calculate_windspeed_statistic(first_windspeed);
+            }
+            TraceScope trace("move");
+            sensor_data::sensor.copy_new_readings(batch);
             sensor_data::sensor.move_temperature_data();
             sensor_data::sensor.move_humidity_data();
             sensor_data::sensor.move_windspeed_data();
         }
+        // log write and fsync happen outside the lock so the sensors are never blocked by disk
+        {
+            TraceScope trace("wal append");
+            bool logged { !has_unlogged || sensor_data::wal.append(unlogged) };
+            if (logged) {
+                for (SensorId id : all_sensors) unlogged[id].clear();
+                logged = sensor_data::wal.append(batch);
+            }
+            if (!logged) {
+                for (SensorId id : all_sensors) unlogged[id].insert(unlogged[id].end(), batch[id].begin(), batch[id].end());
+            }
+            has_unlogged = !logged;
+        }
+        sensor_data::sensor.publish_stored_readings();
+        // rendered here where history and statistics can be read without the lock, scrapes only copy the text
+        if (sensor_data::metrics_server.running()) {
+            TraceScope trace("render metrics");
+            sensor_data::metrics_server.publish(render_openmetrics(sensor_data::sensor));
+        }
+
+        // once a snapshot is on disk the log segment it covers is no longer needed
+        if (pending_snapshot.written.valid() &&
+            pending_snapshot.written.wait_for(std::chrono::seconds(0)) == std::future_status::ready &&
+            pending_snapshot.written.get()) {
+            sensor_data::wal.drop_previous();
+        }
+
+        // snapshot covers everything in the log so far, the log continues in a new segment
+        passes++;
+        const SnapshotOptions& snapshot { sensor_data::snapshot_options };
+        // not while the log is behind the history, the retried records would be replayed on top of the snapshot
+        if (!snapshot.path.empty() && snapshot.every_passes > 0 && passes % snapshot.every_passes == 0 && !has_unlogged) {
+            // the file write runs on file_writer, skip this one if the last snapshot is still being written
+            if (!pending_snapshot.written.valid()) {
+                TraceScope trace("snapshot");
+                pending_snapshot = queue_snapshot(snapshot.path, sensor_data::sensor, sensor_data::wal.rotate(),
+                                                  sensor_data::file_writer);
+            }
+        }
     }
 }
 
 
 void print_sensor_data() {
+    trace_set_thread_name("print_sensor_data");
     {
-        std::lock_guard<std::mutex> guard(sensor_mutex);
-        std::cout << "STARTING SENSOR MONITORING - press q to QUIT\n";
+        SensorLock guard(sensor_mutex, LockSite::other);
+        std::cout << "STARTING SENSOR MONITORING - press q to QUIT, m for metrics\n";
     }    
     std::this_thread::sleep_for(100ms);
     int seconds{1};
     while (system_running) {
-        if (seconds % 2 == 0) sensor_data::sensor.print_latest_readings();
-        if (seconds % 10 == 0) sensor_data::sensor.print_statistics();
+        if (seconds % 2 == 0 || seconds % 10 == 0) {
+            MetricScope frame(sensor_data::sensor.metrics(), MetricTimer::display_frame);
+            if (seconds % 2 == 0) sensor_data::sensor.print_latest_readings();
+            if (seconds % 10 == 0) sensor_data::sensor.print_statistics();
+        }
+        if (seconds % 60 == 0) print_lock_statistics(std::cout);
         for (int i = 0 ; i < 10 && system_running ; i++){
             std::this_thread::sleep_for(100ms);
         }
@@ -96,6 +179,8 @@ void quit_prompt(){
     std::string input;
     while (std::cin >> input){                
         if (input.at(0) == 'q') break;
+        // the counters are relaxed atomics, a snapshot needs no lock
+        if (input.at(0) == 'm') print_metrics(sensor_data::sensor.metrics().snapshot(), std::cout);
     }    
     system_running = false;
 }
\ No newline at end of file
@@ -0,0 +1,51 @@
+/**
+ *  Prints the newest reading of every sensor from the shared memory table of weather_sensors
+ *  Usage: weather_latest [--name <shm name>] [--watch <ms>]
+ *  --name is the name given to weather_sensors --shm (default /weather_sensors)
+ *  --watch prints again every <ms> milliseconds, only sensors with a new value
+ *  Also serves as the example for the reader library (LatestValues.h)
+ */
+#include "LatestValues.h"
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+int main(int argc, char* argv[]) {
+    std::string name { "/weather_sensors" };
+    int watch_ms{};
+    bool usage {};
+    try {
+        for (int i = 1; i < argc && !usage; i++) {
+            std::string arg { argv[i] };
+            if (arg == "--name" && i + 1 < argc) name = argv[++i];
+            else if (arg == "--watch" && i + 1 < argc) watch_ms = std::stoi(argv[++i]);
+            else usage = true;
+        }
+    } catch (const std::logic_error&) {
+        usage = true;
+    }
+    if (usage) {
+        std::cerr << "Usage: weather_latest [--name <shm name>] [--watch <ms>]\n";
+        return 1;
+    }
+
+    LatestValueReader reader;
+    if (!reader.open(name)) {
+        std::cerr << "No latest value table " << name << ", start weather_sensors with --shm " << name << "\n";
+        return 1;
+    }
+    std::uint64_t seen[sensor_count] {};
+    do {
+        for (SensorId id : all_sensors) {
+            LatestValue latest;
+            if (!reader.read(id, latest) || latest.sequence == seen[static_cast<std::size_t>(id)]) continue;
+            seen[static_cast<std::size_t>(id)] = latest.sequence;
+            const auto age { std::chrono::duration<double, std::milli>(std::chrono::system_clock::now() - latest.time_point) };
+            std::cout << std::left << std::setw(12) << sensor_name(id) << " " << latest.value << " at "
+                      << latest.time_point.time_since_epoch().count() << " ns (" << age.count() << " ms ago)\n";
+        }
+        if (watch_ms > 0) std::this_thread::sleep_for(std::chrono::milliseconds { watch_ms });
+    } while (watch_ms > 0);
+    return 0;
+}
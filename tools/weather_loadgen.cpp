@@ -0,0 +1,161 @@
+/**
+ *  Load generator for the ingest server of weather_sensors
+ *  Usage: weather_loadgen (--unix <path> | --udp <port>) [--clients <n>] [--readings <n>]
+ *                         [--batch <n>] [--client-timestamps]
+ *  --clients forks that many client processes, each with its own connection (default 4)
+ *  --readings is the number of readings sent by every client (default 10M)
+ *  --batch is the number of readings per frame (default 1024, capped to fit a datagram for UDP)
+ *  --client-timestamps stamps every frame with the time it was sent,
+ *  otherwise the timestamps are 0 and the server uses the time of arrival
+ */
+#include "IngestProtocol.h"
+#include "DataGenerator.h"
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+
+struct LoadOptions {
+    std::string unix_path;
+    int udp_port { -1 };
+    unsigned clients { 4 };
+    std::size_t readings { 10'000'000 };
+    std::uint32_t batch { 1024 };
+    bool client_timestamps{};
+};
+
+static int connect_to_server(const LoadOptions& options) {
+    if (!options.unix_path.empty()) {
+        sockaddr_un address {};
+        address.sun_family = AF_UNIX;
+        std::strncpy(address.sun_path, options.unix_path.c_str(), sizeof(address.sun_path) - 1);
+        const int fd { ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0) };
+        if (fd >= 0 && ::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0) return fd;
+        if (fd >= 0) ::close(fd);
+        return -1;
+    }
+    sockaddr_in address {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(static_cast<std::uint16_t>(options.udp_port));
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    const int fd { ::socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0) };
+    // connected UDP socket so send() can be used
+    if (fd >= 0 && ::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0) return fd;
+    if (fd >= 0) ::close(fd);
+    return -1;
+}
+
+static bool send_all(int fd, const std::uint8_t* bytes, std::size_t size) {
+    while (size > 0) {
+        const ssize_t sent { ::send(fd, bytes, size, MSG_NOSIGNAL) };
+        if (sent < 0 && errno == EINTR) continue;
+        // a full UDP socket buffer on the loopback reports ENOBUFS, wait for the server to catch up
+        if (sent < 0 && errno == ENOBUFS) { ::usleep(50); continue; }
+        if (sent <= 0) return false;
+        bytes += sent;
+        size -= static_cast<std::size_t>(sent);
+    }
+    return true;
+}
+
+// one client process, returns the exit status
+static int run_client(const LoadOptions& options, unsigned client) {
+    const int fd { connect_to_server(options) };
+    if (fd < 0) {
+        std::cerr << "client " << client << ": could not connect: " << std::strerror(errno) << "\n";
+        return 1;
+    }
+    // one frame encoded up front, the values cycle through the three sensors
+    DataGenerator generators[3] { { -15, 30, -0.2, 0.2 }, { 55.0, 100.0, -0.1, 0.1 }, { 0.0, 25.0, -0.5, 0.5 } };
+    for (DataGenerator& generator : generators) generator.get_initial_value();
+    std::vector<std::uint8_t> frame;
+    append_ingest_header(frame, options.batch);
+    for (std::uint32_t i = 0; i < options.batch; i++) {
+        append_ingest_record(frame, static_cast<std::uint8_t>(i % 3), 0, generators[i % 3].get_new_value());
+    }
+
+    const auto start { std::chrono::steady_clock::now() };
+    std::size_t sent{};
+    while (sent < options.readings) {
+        const std::uint32_t count { static_cast<std::uint32_t>(std::min<std::size_t>(options.batch, options.readings - sent)) };
+        if (count != options.batch) {
+            frame.resize(ingest_header_size + count * ingest_record_size);
+            std::memcpy(frame.data() + 4, &count, 4);
+        }
+        if (options.client_timestamps) {
+            const std::int64_t now { std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count() };
+            for (std::uint32_t i = 0; i < count; i++) {
+                std::memcpy(frame.data() + ingest_header_size + i * ingest_record_size + 1, &now, 8);
+            }
+        }
+        if (!send_all(fd, frame.data(), frame.size())) {
+            std::cerr << "client " << client << ": send failed: " << std::strerror(errno) << "\n";
+            ::close(fd);
+            return 1;
+        }
+        sent += count;
+    }
+    ::close(fd);
+    const double seconds { std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() };
+    std::cout << "client " << client << ": " << sent << " readings in " << seconds << " s, "
+              << static_cast<double>(sent) / seconds << " readings/s\n";
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    LoadOptions options;
+    bool usage {};
+    try {
+        for (int i = 1; i < argc && !usage; i++) {
+            std::string arg { argv[i] };
+            if (arg == "--unix" && i + 1 < argc) options.unix_path = argv[++i];
+            else if (arg == "--udp" && i + 1 < argc) options.udp_port = std::stoi(argv[++i]);
+            else if (arg == "--clients" && i + 1 < argc) options.clients = static_cast<unsigned>(std::stoul(argv[++i]));
+            else if (arg == "--readings" && i + 1 < argc) options.readings = std::stoull(argv[++i]);
+            else if (arg == "--batch" && i + 1 < argc) options.batch = static_cast<std::uint32_t>(std::stoul(argv[++i]));
+            else if (arg == "--client-timestamps") options.client_timestamps = true;
+            else usage = true;
+        }
+    } catch (const std::logic_error&) {
+        usage = true;
+    }
+    if (usage || options.unix_path.empty() == (options.udp_port < 0) || options.batch == 0) {
+        std::cerr << "Usage: weather_loadgen (--unix <path> | --udp <port>) [--clients <n>] [--readings <n>]\n"
+                     "                       [--batch <n>] [--client-timestamps]\n";
+        return 1;
+    }
+    options.batch = std::min(options.batch, options.udp_port >= 0 ? ingest_max_datagram_records : ingest_max_records);
+
+    const auto start { std::chrono::steady_clock::now() };
+    std::vector<pid_t> children;
+    for (unsigned client = 0; client < options.clients; client++) {
+        const pid_t pid { ::fork() };
+        if (pid == 0) {
+            const int status { run_client(options, client) };
+            std::cout.flush();
+            ::_exit(status);
+        }
+        if (pid > 0) children.push_back(pid);
+    }
+    int failed{};
+    for (pid_t pid : children) {
+        int status{};
+        ::waitpid(pid, &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) failed++;
+    }
+    const double seconds { std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() };
+    const std::size_t total { options.readings * (children.size() - static_cast<std::size_t>(failed)) };
+    std::cout << "sent " << total << " readings from " << children.size() << " clients in " << seconds << " s, "
+              << static_cast<double>(total) / seconds << " readings/s\n";
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,398 @@
+/**
+ *  Answers questions about saved readings offline, e.g. the max wind speed on 14 Mar
+ *  Usage: weather_query [--from <time>] [--to <time>] [--bucket <n>s|m|h|d] [--sensors <list>]
+ *                       [--percentiles <p,...>|none] [--bins <n>] [--threads <n>] [--json] <file>...
+ *  Files are snapshots (the binary image written by --snapshot, scanned in place at memory speed)
+ *  or files written by save_sensordata in any format, streamed through the SAX loader
+ *  --from and --to limit the readings to [from, to): 2024-03-14, 2024-03-14T10:00:00Z or epoch ns
+ *  --bucket splits the range into buckets aligned to the epoch, one bucket for everything without it
+ *  --sensors takes temperature, humidity and windspeed separated by commas (default all)
+ *  --percentiles defaults to 50,90,99; they come from a histogram of --bins bins (default 1024)
+ *  over each sensor's range, so they are exact to half a bin, values outside the range fall in the end bins
+ *  --threads defaults to the number of CPUs; each snapshot is split in slices, each other file is one task
+ *  Min, max and average are exact, they are computed with SensorData::calculate_statistics()
+ */
+#include "SensorData.h"
+#include "StreamLoader.h"
+#include "Snapshot.h"
+#include <iostream>
+#include <stdexcept>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <limits>
+#include <algorithm>
+
+struct QueryOptions {
+    std::vector<std::string> files;
+    std::int64_t from_ns { std::numeric_limits<std::int64_t>::min() };
+    std::int64_t to_ns { std::numeric_limits<std::int64_t>::max() };
+    std::int64_t bucket_ns{};           // 0: a single bucket
+    bool sensors[sensor_count] { true, true, true };
+    std::vector<double> percentiles { 50, 90, 99 };
+    std::size_t bins { 1024 };
+    unsigned threads { std::max(1u, std::thread::hardware_concurrency()) };
+    bool json_output{};
+};
+
+struct BucketResult {
+    Stats stat{};
+    std::vector<std::uint32_t> histogram;   // empty when no percentiles are asked for
+};
+
+// bucket number to its result, in time order
+using SensorBuckets = std::map<std::int64_t, BucketResult>;
+
+// what one worker thread found, merged when all are done
+struct PartialResult {
+    SensorBuckets sensors[sensor_count];
+    std::size_t readings{};
+};
+
+// a part of the work: a slice of a snapshot's readings of one sensor, or a whole saved file
+struct QueryTask {
+    std::size_t file{};
+    const SnapshotFile* snapshot{};
+    SensorId sensor { SensorId::temperature };
+    std::size_t first{};
+    std::size_t last{};
+};
+
+constexpr std::size_t snapshot_slice_readings { 1 << 20 };
+
+/**
+ *  Adds readings to the buckets of one worker. A run of readings in the same bucket goes to
+ *  calculate_statistics() in one call, so readings in time order cost one map lookup per bucket
+ */
+class BucketAggregator {
+private:
+    const QueryOptions& m_options;
+    PartialResult& m_result;
+
+    std::int64_t bucket_number(std::int64_t ns) const {
+        if (m_options.bucket_ns == 0) return 0;
+        return ns / m_options.bucket_ns - (ns % m_options.bucket_ns < 0);
+    }
+public:
+    BucketAggregator(const QueryOptions& options, PartialResult& result) : m_options { options }, m_result { result } {}
+
+    void add(SensorId id, std::span<const TimeDouble> readings) {
+        SensorBuckets& buckets { m_result.sensors[static_cast<std::size_t>(id)] };
+        const SensorRange range { sensor_range(id) };
+        const double bins_per_unit { static_cast<double>(m_options.bins) / (range.max - range.min) };
+        std::size_t i {};
+        while (i < readings.size()) {
+            const std::int64_t ns { to_epoch_ns(readings[i].time_point) };
+            if (ns < m_options.from_ns || ns >= m_options.to_ns) {
+                i++;
+                continue;
+            }
+            // the bucket clipped to the queried range, the run ends at the first reading outside it
+            const std::int64_t number { bucket_number(ns) };
+            std::int64_t begin { m_options.from_ns };
+            std::int64_t end { m_options.to_ns };
+            if (m_options.bucket_ns != 0) {
+                begin = std::max(begin, number * m_options.bucket_ns);
+                end = std::min(end, (number + 1) * m_options.bucket_ns);
+            }
+            std::size_t run_end { i + 1 };
+            while (run_end < readings.size()) {
+                const std::int64_t next { to_epoch_ns(readings[run_end].time_point) };
+                if (next < begin || next >= end) break;
+                run_end++;
+            }
+            const std::span<const TimeDouble> run { readings.subspan(i, run_end - i) };
+            BucketResult& bucket { buckets[number] };
+            bool first_reading { bucket.stat.count == 0 };
+            SensorData::calculate_statistics(bucket.stat, first_reading, run);
+            if (!m_options.percentiles.empty()) {
+                if (bucket.histogram.empty()) bucket.histogram.resize(m_options.bins);
+                for (const TimeDouble& reading : run) {
+                    // NaN fails the comparison and lands in the first bin
+                    const double position { (reading.value - range.min) * bins_per_unit };
+                    const std::size_t bin { position > 0 ? std::min(static_cast<std::size_t>(position), m_options.bins - 1) : 0 };
+                    bucket.histogram[bin]++;
+                }
+            }
+            m_result.readings += run.size();
+            i = run_end;
+        }
+    }
+};
+
+// combines the statistics of two disjoint sets of readings, ties go to the earlier reading
+static void merge_statistics(Stats& into, const Stats& other) {
+    if (other.count == 0) return;
+    if (into.count == 0) {
+        into = other;
+        return;
+    }
+    if (other.max.value > into.max.value || (other.max.value == into.max.value && other.max.time_point < into.max.time_point)) {
+        into.max = other.max;
+    }
+    if (other.min.value < into.min.value || (other.min.value == into.min.value && other.min.time_point < into.min.time_point)) {
+        into.min = other.min;
+    }
+    const std::size_t count { into.count + other.count };
+    into.average = (into.average * static_cast<double>(into.count) + other.average * static_cast<double>(other.count))
+                   / static_cast<double>(count);
+    into.count = count;
+}
+
+static void merge_buckets(SensorBuckets& into, SensorBuckets& other) {
+    for (auto& [number, bucket] : other) {
+        BucketResult& target { into[number] };
+        merge_statistics(target.stat, bucket.stat);
+        if (target.histogram.empty()) target.histogram = std::move(bucket.histogram);
+        else for (std::size_t i = 0; i < bucket.histogram.size(); i++) target.histogram[i] += bucket.histogram[i];
+    }
+}
+
+// value below which percentile % of the bucket's readings fall, interpolated inside its bin
+static double percentile_value(const BucketResult& bucket, SensorId id, double percentile, std::size_t bins) {
+    if (percentile <= 0) return bucket.stat.min.value;
+    if (percentile >= 100) return bucket.stat.max.value;
+    const SensorRange range { sensor_range(id) };
+    const double bin_width { (range.max - range.min) / static_cast<double>(bins) };
+    const double rank { percentile / 100.0 * static_cast<double>(bucket.stat.count) };
+    std::uint64_t below{};
+    for (std::size_t bin = 0; bin < bucket.histogram.size(); bin++) {
+        const std::uint32_t in_bin { bucket.histogram[bin] };
+        if (in_bin > 0 && static_cast<double>(below + in_bin) >= rank) {
+            const double value { range.min + bin_width * (static_cast<double>(bin) + (rank - static_cast<double>(below)) / in_bin) };
+            return std::clamp(value, bucket.stat.min.value, bucket.stat.max.value);
+        }
+        below += in_bin;
+    }
+    return bucket.stat.max.value;
+}
+
+// 2024-03-14 (midnight UTC), 2024-03-14T10:00:00Z with an optional fraction, or epoch nanoseconds
+static bool parse_query_time(const std::string& text, std::int64_t& ns) {
+    std::chrono::system_clock::time_point time_point;
+    if (parse_rfc3339(text.size() == 10 ? text + "T00:00:00Z" : text, time_point)) {
+        ns = to_epoch_ns(time_point);
+        return true;
+    }
+    std::size_t used{};
+    try {
+        ns = std::stoll(text, &used);
+    } catch (const std::exception&) {
+        return false;
+    }
+    return used == text.size();
+}
+
+// 15m, 1h, 1d; s, m, h or d like the rollup tiers
+static bool parse_bucket(const std::string& text, std::int64_t& ns) {
+    long long amount{};
+    char unit{};
+    std::istringstream input { text };
+    if (!(input >> amount >> unit) || amount <= 0 || input.peek() != EOF) return false;
+    const long long seconds_per_unit { unit == 's' ? 1 : unit == 'm' ? 60 : unit == 'h' ? 3600 : unit == 'd' ? 86400 : 0 };
+    if (seconds_per_unit == 0) return false;
+    ns = amount * seconds_per_unit * 1'000'000'000;
+    return true;
+}
+
+static bool parse_sensors(const std::string& text, bool (&sensors)[sensor_count]) {
+    std::fill(std::begin(sensors), std::end(sensors), false);
+    std::istringstream input { text };
+    std::string name;
+    while (std::getline(input, name, ',')) {
+        const auto found { std::find_if(std::begin(all_sensors), std::end(all_sensors),
+                                        [&name](SensorId id) { return name == sensor_label(id); }) };
+        if (found == std::end(all_sensors)) return false;
+        sensors[static_cast<std::size_t>(*found)] = true;
+    }
+    return std::find(std::begin(sensors), std::end(sensors), true) != std::end(sensors);
+}
+
+static bool parse_percentiles(const std::string& text, std::vector<double>& percentiles) {
+    percentiles.clear();
+    if (text == "none") return true;
+    std::istringstream input { text };
+    std::string item;
+    while (std::getline(input, item, ',')) {
+        try {
+            percentiles.push_back(std::stod(item));
+        } catch (const std::exception&) {
+            return false;
+        }
+        if (percentiles.back() < 0 || percentiles.back() > 100) return false;
+    }
+    return !percentiles.empty();
+}
+
+static std::string format_bucket_start(const QueryOptions& options, std::int64_t number) {
+    if (options.bucket_ns == 0) return "all";
+    return format_rfc3339(from_epoch_ns(number * options.bucket_ns));
+}
+
+static std::string format_percentile(double percentile) {
+    std::ostringstream text;
+    text << "p" << percentile;
+    return text.str();
+}
+
+static void print_text(const QueryOptions& options, const PartialResult& result) {
+    std::cout << std::fixed << std::setprecision(2);
+    for (SensorId id : all_sensors) {
+        if (!options.sensors[static_cast<std::size_t>(id)]) continue;
+        std::cout << sensor_name(id) << "\n" << std::left << std::setw(32) << "bucket" << std::right
+                  << std::setw(10) << "count" << std::setw(10) << "min" << "  " << std::setw(30) << std::left << "min at"
+                  << std::right << std::setw(10) << "max" << "  " << std::setw(30) << std::left << "max at"
+                  << std::right << std::setw(10) << "average";
+        for (double percentile : options.percentiles) std::cout << std::setw(10) << format_percentile(percentile);
+        std::cout << "\n";
+        for (const auto& [number, bucket] : result.sensors[static_cast<std::size_t>(id)]) {
+            std::cout << std::left << std::setw(32) << format_bucket_start(options, number) << std::right
+                      << std::setw(10) << bucket.stat.count << std::setw(10) << bucket.stat.min.value << "  "
+                      << std::setw(30) << std::left << format_rfc3339(bucket.stat.min.time_point) << std::right
+                      << std::setw(10) << bucket.stat.max.value << "  "
+                      << std::setw(30) << std::left << format_rfc3339(bucket.stat.max.time_point) << std::right
+                      << std::setw(10) << bucket.stat.average;
+            for (double percentile : options.percentiles) {
+                std::cout << std::setw(10) << percentile_value(bucket, id, percentile, options.bins);
+            }
+            std::cout << "\n";
+        }
+        std::cout << "\n";
+    }
+}
+
+static void print_json(const QueryOptions& options, const PartialResult& result) {
+    json document = json::object();
+    for (SensorId id : all_sensors) {
+        if (!options.sensors[static_cast<std::size_t>(id)]) continue;
+        json buckets = json::array();
+        for (const auto& [number, bucket] : result.sensors[static_cast<std::size_t>(id)]) {
+            json entry = { { "Bucket", format_bucket_start(options, number) }, { "Count", bucket.stat.count },
+                           { "Min", { bucket.stat.min.value, format_rfc3339(bucket.stat.min.time_point) } },
+                           { "Max", { bucket.stat.max.value, format_rfc3339(bucket.stat.max.time_point) } },
+                           { "Average", bucket.stat.average } };
+            json percentiles = json::object();
+            for (double percentile : options.percentiles) {
+                percentiles[format_percentile(percentile)] = percentile_value(bucket, id, percentile, options.bins);
+            }
+            if (!options.percentiles.empty()) entry["Percentiles"] = std::move(percentiles);
+            buckets.push_back(std::move(entry));
+        }
+        document[sensor_name(id)] = std::move(buckets);
+    }
+    std::cout << std::setw(3) << document << "\n";
+}
+
+int main(int argc, char* argv[]) {
+    QueryOptions options;
+    bool usage {};
+    try {
+        for (int i = 1; i < argc; i++) {
+            std::string arg { argv[i] };
+            if (arg == "--from" && i + 1 < argc) usage |= !parse_query_time(argv[++i], options.from_ns);
+            else if (arg == "--to" && i + 1 < argc) usage |= !parse_query_time(argv[++i], options.to_ns);
+            else if (arg == "--bucket" && i + 1 < argc) usage |= !parse_bucket(argv[++i], options.bucket_ns);
+            else if (arg == "--sensors" && i + 1 < argc) usage |= !parse_sensors(argv[++i], options.sensors);
+            else if (arg == "--percentiles" && i + 1 < argc) usage |= !parse_percentiles(argv[++i], options.percentiles);
+            else if (arg == "--bins" && i + 1 < argc) options.bins = std::stoull(argv[++i]);
+            else if (arg == "--threads" && i + 1 < argc) options.threads = static_cast<unsigned>(std::stoul(argv[++i]));
+            else if (arg == "--json") options.json_output = true;
+            else if (arg.starts_with("--")) usage = true;
+            else options.files.push_back(arg);
+        }
+    } catch (const std::logic_error&) {
+        usage = true;
+    }
+    if (usage || options.files.empty() || options.bins == 0 || options.threads == 0 || options.from_ns >= options.to_ns) {
+        std::cerr << "Usage: weather_query [--from <time>] [--to <time>] [--bucket <n>s|m|h|d] [--sensors <list>]\n"
+                     "                     [--percentiles <p,...>|none] [--bins <n>] [--threads <n>] [--json] <file>...\n";
+        return 1;
+    }
+
+    const auto start { std::chrono::steady_clock::now() };
+    // snapshots are mapped up front and cut into slices of the queried range, other files are one task each
+    std::vector<std::unique_ptr<SnapshotFile>> snapshots;
+    std::vector<QueryTask> tasks;
+    std::uint64_t bytes{};
+    bool failed {};
+    for (std::size_t file = 0; file < options.files.size(); file++) {
+        const std::string& filename { options.files[file] };
+        if (!is_snapshot(filename)) {
+            tasks.push_back({ file });
+            continue;
+        }
+        auto snapshot { std::make_unique<SnapshotFile>() };
+        if (!snapshot->open(filename)) {
+            std::cerr << (snapshot->error().empty() ? filename + ": no snapshot" : snapshot->error()) << "\n";
+            failed = true;
+            continue;
+        }
+        for (SensorId id : all_sensors) {
+            if (!options.sensors[static_cast<std::size_t>(id)]) continue;
+            // the history in a snapshot is in time order
+            const std::span<const TimeDouble> readings { snapshot->readings(id) };
+            auto first_at = [&readings](std::int64_t ns) {
+                return static_cast<std::size_t>(std::partition_point(readings.begin(), readings.end(),
+                    [ns](const TimeDouble& reading) { return to_epoch_ns(reading.time_point) < ns; }) - readings.begin());
+            };
+            const std::size_t first { first_at(options.from_ns) };
+            const std::size_t last { std::max(first, first_at(options.to_ns)) };
+            for (std::size_t slice = first; slice < last; slice += snapshot_slice_readings) {
+                tasks.push_back({ file, snapshot.get(), id, slice, std::min(last, slice + snapshot_slice_readings) });
+            }
+            bytes += (last - first) * sizeof(TimeDouble);
+        }
+        snapshots.push_back(std::move(snapshot));
+    }
+
+    std::vector<PartialResult> partials(std::min<std::size_t>(options.threads, std::max<std::size_t>(tasks.size(), 1)));
+    std::atomic<std::size_t> next_task{};
+    std::atomic<std::uint64_t> streamed_bytes{};
+    std::atomic<bool> stream_failed{};
+    std::vector<std::thread> workers;
+    for (PartialResult& partial : partials) {
+        workers.emplace_back([&] {
+            BucketAggregator aggregator { options, partial };
+            StreamLoadOptions load_options;
+            std::copy(std::begin(options.sensors), std::end(options.sensors), load_options.sensors);
+            for (std::size_t index = next_task++; index < tasks.size(); index = next_task++) {
+                const QueryTask& task { tasks[index] };
+                if (task.snapshot) {
+                    aggregator.add(task.sensor, task.snapshot->readings(task.sensor).subspan(task.first, task.last - task.first));
+                    continue;
+                }
+                const StreamLoadResult loaded { stream_sensordata(options.files[task.file],
+                    [&aggregator](SensorId id, std::span<const TimeDouble> chunk) {
+                        aggregator.add(id, chunk);
+                        return true;
+                    }, load_options) };
+                streamed_bytes += loaded.bytes;
+                if (!loaded.ok) {
+                    std::cerr << options.files[task.file] << ": " << loaded.error << "\n";
+                    stream_failed = true;
+                }
+            }
+        });
+    }
+    for (std::thread& worker : workers) worker.join();
+
+    PartialResult& result { partials.front() };
+    for (std::size_t i = 1; i < partials.size(); i++) {
+        for (std::size_t sensor = 0; sensor < sensor_count; sensor++) merge_buckets(result.sensors[sensor], partials[i].sensors[sensor]);
+        result.readings += partials[i].readings;
+    }
+    const double seconds { std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() };
+
+    if (options.json_output) print_json(options, result);
+    else print_text(options, result);
+    bytes += streamed_bytes;
+    std::cerr << "scanned " << options.files.size() << " files, " << bytes / 1'000'000 << " MB, " << result.readings
+              << " readings in range in " << seconds << " s, " << static_cast<double>(bytes) / seconds / 1e9 << " GB/s on "
+              << workers.size() << " threads\n";
+    return failed || stream_failed ? 1 : 0;
+}
@@ -0,0 +1,199 @@
+/**
+ *  Replays a file written by save_sensordata through the ingest server of weather_sensors
+ *  Usage: weather_replay <file> (--unix <path> | --udp <port>) [--speed <x>] [--batch <n>] [--arrival-times]
+ *  The file is streamed, any save format and timestamp format, one thread and connection per sensor
+ *  --speed 1 sends the readings with their original spacing, 10 ten times faster,
+ *  0 (the default) as fast as the server takes them
+ *  --batch is the largest number of readings per frame (default 1024, capped to fit a datagram for UDP),
+ *  a paced replay sends a frame whenever it has to wait for the next reading
+ *  --arrival-times sends timestamps of 0 so the server uses the time of arrival,
+ *  otherwise every reading keeps the timestamp from the file
+ */
+#include "IngestProtocol.h"
+#include "StreamLoader.h"
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <latch>
+#include <mutex>
+#include <limits>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+
+struct ReplayOptions {
+    std::string filename;
+    std::string unix_path;
+    int udp_port { -1 };
+    double speed{};
+    std::uint32_t batch { 1024 };
+    bool arrival_times{};
+};
+
+// one sensor's replay, the threads of all sensors start pacing together from the earliest reading
+struct ReplayClock {
+    std::latch first_readings { sensor_count };
+    std::atomic<std::int64_t> first_ns { std::numeric_limits<std::int64_t>::max() };
+    std::once_flag start_once;
+    std::chrono::steady_clock::time_point start;
+
+    // called once per sensor, with its first reading or when it has none
+    void arrive(std::int64_t ns) {
+        std::int64_t current { first_ns.load() };
+        while (ns < current && !first_ns.compare_exchange_weak(current, ns)) {}
+        first_readings.arrive_and_wait();
+        std::call_once(start_once, [this] { start = std::chrono::steady_clock::now(); });
+    }
+};
+
+struct ReplayResult {
+    std::size_t readings{};
+    bool ok{};
+};
+
+static int connect_to_server(const ReplayOptions& options) {
+    if (!options.unix_path.empty()) {
+        sockaddr_un address {};
+        address.sun_family = AF_UNIX;
+        std::strncpy(address.sun_path, options.unix_path.c_str(), sizeof(address.sun_path) - 1);
+        const int fd { ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0) };
+        if (fd >= 0 && ::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0) return fd;
+        if (fd >= 0) ::close(fd);
+        return -1;
+    }
+    sockaddr_in address {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(static_cast<std::uint16_t>(options.udp_port));
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    const int fd { ::socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0) };
+    // connected UDP socket so send() can be used
+    if (fd >= 0 && ::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0) return fd;
+    if (fd >= 0) ::close(fd);
+    return -1;
+}
+
+static bool send_all(int fd, const std::uint8_t* bytes, std::size_t size) {
+    while (size > 0) {
+        const ssize_t sent { ::send(fd, bytes, size, MSG_NOSIGNAL) };
+        if (sent < 0 && errno == EINTR) continue;
+        // a full UDP socket buffer on the loopback reports ENOBUFS, wait for the server to catch up
+        if (sent < 0 && errno == ENOBUFS) { ::usleep(50); continue; }
+        if (sent <= 0) return false;
+        bytes += sent;
+        size -= static_cast<std::size_t>(sent);
+    }
+    return true;
+}
+
+static ReplayResult replay_sensor(const ReplayOptions& options, SensorId id, ReplayClock& clock) {
+    ReplayResult result;
+    bool arrived {};
+    const int fd { connect_to_server(options) };
+    if (fd < 0) {
+        std::cerr << sensor_label(id) << ": could not connect: " << std::strerror(errno) << "\n";
+        if (options.speed > 0) clock.arrive(std::numeric_limits<std::int64_t>::max());
+        return result;
+    }
+
+    std::vector<std::uint8_t> frame;
+    frame.reserve(ingest_header_size + options.batch * ingest_record_size);
+    bool sent_all { true };
+    auto send_frame = [&] {
+        const auto count { static_cast<std::uint32_t>((frame.size() - ingest_header_size) / ingest_record_size) };
+        if (count == 0) return true;
+        std::memcpy(frame.data() + 4, &count, 4);
+        sent_all = send_all(fd, frame.data(), frame.size());
+        frame.resize(ingest_header_size);
+        return sent_all;
+    };
+    append_ingest_header(frame, 0);
+
+    StreamLoadOptions load_options;
+    std::fill(std::begin(load_options.sensors), std::end(load_options.sensors), false);
+    load_options.sensors[static_cast<std::size_t>(id)] = true;
+    const StreamLoadResult loaded { stream_sensordata(options.filename, [&](SensorId, std::span<const TimeDouble> readings) {
+        for (const TimeDouble& reading : readings) {
+            const std::int64_t ns { to_epoch_ns(reading.time_point) };
+            if (options.speed > 0) {
+                if (!arrived) {
+                    clock.arrive(ns);
+                    arrived = true;
+                }
+                const auto due { clock.start + std::chrono::nanoseconds {
+                    static_cast<std::int64_t>(static_cast<double>(ns - clock.first_ns.load()) / options.speed) } };
+                if (due > std::chrono::steady_clock::now()) {
+                    if (!send_frame()) return false;
+                    std::this_thread::sleep_until(due);
+                }
+            }
+            append_ingest_record(frame, static_cast<std::uint8_t>(id), options.arrival_times ? 0 : ns, reading.value);
+            if (frame.size() == ingest_header_size + options.batch * ingest_record_size && !send_frame()) return false;
+        }
+        return true;
+    }, load_options) };
+    // the other sensors must not wait for one without readings
+    if (options.speed > 0 && !arrived) clock.arrive(std::numeric_limits<std::int64_t>::max());
+    if (sent_all) send_frame();
+    ::close(fd);
+
+    result.readings = loaded.readings[static_cast<std::size_t>(id)];
+    if (!loaded.ok) std::cerr << options.filename << ": " << loaded.error << "\n";
+    else if (!sent_all) std::cerr << sensor_label(id) << ": send failed: " << std::strerror(errno) << "\n";
+    result.ok = loaded.ok && sent_all;
+    return result;
+}
+
+int main(int argc, char* argv[]) {
+    ReplayOptions options;
+    bool usage {};
+    try {
+        for (int i = 1; i < argc; i++) {
+            std::string arg { argv[i] };
+            if (arg == "--unix" && i + 1 < argc) options.unix_path = argv[++i];
+            else if (arg == "--udp" && i + 1 < argc) options.udp_port = std::stoi(argv[++i]);
+            else if (arg == "--speed" && i + 1 < argc) options.speed = std::stod(argv[++i]);
+            else if (arg == "--batch" && i + 1 < argc) options.batch = static_cast<std::uint32_t>(std::stoul(argv[++i]));
+            else if (arg == "--arrival-times") options.arrival_times = true;
+            else if (arg.starts_with("--") || !options.filename.empty()) usage = true;
+            else options.filename = arg;
+        }
+    } catch (const std::logic_error&) {
+        usage = true;
+    }
+    if (usage || options.filename.empty() || options.unix_path.empty() == (options.udp_port < 0)
+        || options.batch == 0 || options.speed < 0) {
+        std::cerr << "Usage: weather_replay <file> (--unix <path> | --udp <port>) [--speed <x>] [--batch <n>]\n"
+                     "                      [--arrival-times]\n";
+        return 1;
+    }
+    options.batch = std::min(options.batch, options.udp_port >= 0 ? ingest_max_datagram_records : ingest_max_records);
+
+    const auto start { std::chrono::steady_clock::now() };
+    ReplayClock clock;
+    ReplayResult results[sensor_count];
+    std::vector<std::thread> threads;
+    for (SensorId id : all_sensors) {
+        threads.emplace_back([&, id] { results[static_cast<std::size_t>(id)] = replay_sensor(options, id, clock); });
+    }
+    for (std::thread& thread : threads) thread.join();
+    const double seconds { std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() };
+
+    std::size_t total{};
+    bool ok { true };
+    for (SensorId id : all_sensors) {
+        const ReplayResult& result { results[static_cast<std::size_t>(id)] };
+        std::cout << sensor_label(id) << ": " << result.readings << " readings\n";
+        total += result.readings;
+        ok = ok && result.ok;
+    }
+    std::cout << "replayed " << total << " readings in " << seconds << " s, "
+              << static_cast<double>(total) / seconds << " readings/s\n";
+    return ok ? 0 : 1;
+}